@@ -0,0 +1,107 @@
+#!/usr/bin/python
+"""
+Test that a simulation stopped by a terminate signal, and restarted from its
+checkpoint, gives exactly the results it would have given had it never stopped
+"""
+from nose.tools import assert_equal, assert_true, assert_false
+import os
+import signal
+import subprocess as sp
+import time
+
+
+FET_FILES = 'fet/scl_fet.xyz fet/scl_fet.edge fet/occupiedMolecules.occ'
+REGENERATE_FILES = 'regenerate_occ/scl.xyz regenerate_occ/scl_trap.edge'
+
+
+def write_sim(original, sim, changes):
+    """Copy the sim file 'original' to 'sim', replacing the parameters in
+    the dictionary 'changes'"""
+    lines = [l for l in open(original).read().split('\n')
+             if l.split() == [] or l.split()[0] not in changes]
+    for key in changes:
+        lines.append(key + ' ' + changes[key])
+    open(sim, 'w').write('\n'.join(lines) + '\n')
+
+
+def results(file):
+    return [l for l in open(file).read().split('\n') if l.startswith('>')]
+
+
+class TestCheckpoint(object):
+
+
+    def setup(self):
+        self.sim = 'checkpoint.tmp.sim'
+        self.checkpoint = 'checkpoint.tmp.chk'
+        self.outputs = ['checkpoint.tmp.out', 'checkpoint.tmp.out1',
+                        'checkpoint.tmp.out2']
+
+
+    def teardown(self):
+        for file in [self.sim, self.checkpoint] + self.outputs:
+            if os.path.exists(file):
+                os.remove(file)
+
+
+    def run_with_restart(self, original, files, changes):
+        """Run 'original' right through, then again but stopped part of the
+        way through, and restarted from its checkpoint"""
+        write_sim(original, self.sim, changes)
+        command = 'tft ' + self.sim + ' ' + files
+        sp.call(command + ' > ' + self.outputs[0], shell=True)
+
+        changes['checkpoint'] = self.checkpoint
+        changes['checkpointMinutes'] = '1000'  # only when stopped
+        write_sim(original, self.sim, changes)
+        out = open(self.outputs[1], 'w')
+        proc = sp.Popen(command.split(), stdout=out)
+        while 'Beginning KMC' not in open(self.outputs[1]).read():
+            if proc.poll() is not None:
+                break
+            time.sleep(0.01)
+        time.sleep(0.2)
+        if proc.poll() is None:
+            proc.send_signal(signal.SIGTERM)
+        proc.wait()
+        out.close()
+        assert_true(os.path.exists(self.checkpoint),
+                    'The simulation finished before it could be stopped')
+
+        sp.call(command + ' > ' + self.outputs[2], shell=True)
+        assert_true('Restarting from checkpoint'
+                    in open(self.outputs[2]).read())
+        assert_false(os.path.exists(self.checkpoint))
+        assert_equal(results(self.outputs[0]), results(self.outputs[2]))
+
+
+    def test_fet(self):
+        self.run_with_restart('fet/fet.sim', FET_FILES,
+                              {'maxTime': '1e-8', 'tol': '1e-10'})
+
+
+    def test_fet_without_interactions(self):
+        # The rates then depend on the occupation, but not on the Coulomb energies
+        self.run_with_restart('fet/fet.sim', FET_FILES,
+                              {'maxTime': '1e-8', 'tol': '1e-10',
+                               'hopperInteractions': '0'})
+
+
+    def test_fet_with_cutoff(self):
+        # Only the electrodes within the cut-off of a hop are then tested, and
+        #   the others wait for the step they were scheduled to change at
+        self.run_with_restart('fet/fet.sim', FET_FILES,
+                              {'maxTime': '1e-8', 'tol': '1e-10',
+                               'coulombCutoff': '4'})
+
+
+    def test_regenerate(self):
+        self.run_with_restart('regenerate_occ/regenerate_occ.sim',
+                              REGENERATE_FILES,
+                              {'hoppers': '20', 'maxTime': '2e-10', 'maxRuns': '2'})
+
+
+    def test_regenerate_with_interactions(self):
+        self.run_with_restart('coulomb_test/coulomb_test.sim',
+                              'coulomb_test/scl_plane.xyz coulomb_test/scl_plane.edge',
+                              {'maxTime': '1e-8', 'rateUpdateTol': '0.001'})
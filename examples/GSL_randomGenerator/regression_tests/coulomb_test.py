@@ -21,7 +21,7 @@ class TestRegenerate(object):
     
 
     def test_run(self):
-        command = 'tftOccupation coulomb_test/coulomb_test.sim \
+        command = 'tft coulomb_test/coulomb_test.sim \
                  coulomb_test/scl_plane.edge coulomb_test/scl_plane.xyz'
         assert(run_and_check_sim(command, self.run_output))
         
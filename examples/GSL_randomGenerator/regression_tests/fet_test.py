@@ -21,7 +21,7 @@ class TestFeT(object):
     
 
     def test_run(self):
-        command = 'tftOccupation fet/fet.sim \
+        command = 'tft fet/fet.sim \
                  fet/scl_fet.edge\
         fet/scl_fet.xyz'
         assert(run_and_check_sim(command, self.run_output))
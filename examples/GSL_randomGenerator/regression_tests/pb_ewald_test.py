@@ -0,0 +1,56 @@
+#!/usr/bin/python
+"""
+Test Coulombic interactions in pb mode, summed over the nearest image of each
+hopper (coulombSum direct) and over every image (coulombSum ewald)
+"""
+from nose.tools import assert_equal, assert_true
+import os
+from test_functions import *
+
+
+def result(output, name):
+    for line in output.split('\n'):
+        if line.startswith('> ' + name):
+            return float(line.split('=')[-1])
+    return None
+
+
+class TestPBEwald(object):
+
+
+    def setup(self):
+        self.sim = 'pb_ewald.tmp.sim'
+        self.output = 'pb_ewald.tmp.out'
+
+
+    def teardown(self):
+        for file in [self.sim, self.output]:
+            if os.path.exists(file):
+                os.remove(file)
+
+
+    def run_sum(self, coulombSum):
+        sim = open('pb_ewald/pb_ewald.sim').read()
+        open(self.sim, 'w').write(sim + 'coulombSum ' + coulombSum + '\n')
+        command = 'tft ' + self.sim + ' pb_ewald/pb.xyz pb_ewald/pb.edge'
+        assert_true(run_and_check_sim(command, self.output))
+        return open(self.output).read()
+
+
+    def test_runs_to_maxTime(self):
+        # Each hop must give the hoppers new waitTimes from the new Coulomb
+        #   energies, or the simulation time runs away
+        for coulombSum in ['direct', 'ewald']:
+            output = self.run_sum(coulombSum)
+            time = result(output, 'TOTAL SIMULATION TIME')
+            assert_true(1e-9 <= time < 1.1e-9, coulombSum + ': time ' + str(time))
+
+
+    def test_ewald_against_direct(self):
+        # 20 hoppers in an 80 Angs box hardly feel their further images, so
+        #   the mobilities should be close
+        direct = result(self.run_sum('direct'), 'MOBILITY FROM TOTAL DISPLACEMENT')
+        ewald = result(self.run_sum('ewald'), 'MOBILITY FROM TOTAL DISPLACEMENT')
+        assert_true(direct > 0.0)
+        assert_true(abs(ewald - direct) < 0.25 * direct,
+                    'direct ' + str(direct) + ', ewald ' + str(ewald))
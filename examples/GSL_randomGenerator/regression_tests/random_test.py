@@ -0,0 +1,13 @@
+#!/usr/bin/python
+"""
+Test the uniform and exponential random numbers (see 'tft random')
+"""
+from nose.tools import assert_equal, assert_true
+import subprocess as sp
+
+
+def test_random():
+    proc = sp.Popen(['tft', 'random', '1000000'], stdout=sp.PIPE)
+    output = proc.communicate()[0]
+    assert_true('FAILED' not in output, output)
+    assert_equal(proc.returncode, 0)
@@ -21,7 +21,7 @@ class TestRegenerate(object):
     
 
     def test_run(self):
-        command = 'tftOccupation regenerate_occ/regenerate_occ.sim \
+        command = 'tft regenerate_occ/regenerate_occ.sim \
                  regenerate_occ/scl_trap.edge regenerate_occ/scl.xyz'
         assert(run_and_check_sim(command, self.run_output))
         
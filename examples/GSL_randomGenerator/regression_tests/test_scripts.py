@@ -14,7 +14,7 @@ def is_script_on_path(script):
 
 
 def test_scripts_on_path():
-    scripts = ['ls', 'tft', 'tftOccupation', 'tft_average_xy.py',
+    scripts = ['ls', 'tft', 'tft_average_xy.py',
                'tft_calc_sat_mu.py', 'tft_get_series.py', 
                'tft_make_cubic_lattice.py', 'tft_rotate_coords.py',
                'tft_calc_ecp.py', 'tft_define_types.py',
@@ -21,7 +21,7 @@ class TestTrackHoppers(object):
 
 
     def test_run(self):
-        command = 'tftOccupation \
+        command = 'tft \
                   track_hoppers/track.sim track track_hoppers/scl.xyz track_hoppers/scl.edge'
         assert(run_and_check_sim(command, self.run_output))
 
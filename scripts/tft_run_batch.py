@@ -57,12 +57,19 @@ robust way to include comments when using :mod:`tft_run_batch.py` is comment out
 in the :term:`sim file` file by including a # anywhere. Even if # isn`t at the beginning
 of the line it comments out the entire line.
 
-If you want to call :mod:`tft_occ` rather than :mod:`tft`, add occ to the argument
-list of :mod:`tft_run_batch.py`:
+:mod:`tft` can now do the same by itself, reading the :term:`XYZ file` and
+:term:`Edge file` only once, and running several simulations at once:
 
-.. code-block:: bash 
+.. code-block:: bash
+
+    tft  sweep  SIM  XYZ  EDGE
+
+Use :mod:`tft_run_batch.py` when each simulation should start from the
+.occ file left by the last.
 
-    tft_run_batch.py  SIM  XYZ  EDGE  occ
+:mod:`tft` keeps the occupation of each molecule itself whenever printOccupation,
+printEnergies or track is set, so the occ argument that used to choose
+:mod:`tft_occ` is no longer needed (it is still accepted, and ignored).
 
 """
         
@@ -82,7 +89,7 @@ def setup():
         elif ".edge" in arg: edge = arg
         elif ".occ" in arg: occ = arg
 
-        elif (arg=="occ"):   binary = "tftOccupation"
+        elif (arg=="occ"):   pass  # tft keeps occupations itself
 
     #Check that you've got all the input files:
     try: 
@@ -20,6 +20,12 @@
  ***********************/
 
 #include "IO.h"
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 void open(char *filename, ifstream &in) {
     in.open(filename);
     if (!in) {
@@ -37,44 +43,71 @@ void PrintAll(char *filename) {
         cout << "  : " << line << endl;
     }
 }
+
+/***********************
+ * Reading big files
+ ***********************/
 //
-string Read(char *filename, string name, string value) {
-    ifstream in;
-    open(filename, in);
-    string word;
-    while (in) {
-        in >> word; 
-        if (word==name) {
-            in >> value;
-            return value;
+mappedFile::mappedFile(char * filename) {
+    data = NULL;
+    size = 0;
+    int fd = open(filename, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        cout << "***ERROR***: Unable to open " << filename << endl;
+        exit(-1);
+    }
+    size = info.st_size;
+    if (size > 0) {
+        void * map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            cout << "***ERROR***: Unable to map " << filename << endl;
+            exit(-1);
         }
+        data = (const char *) map;
     }
-    if (value.empty()) {
-        cout << "***ERROR***: Didn't find " << name << " in " << filename << endl;
-        exit(-1);
+    close(fd);
+}
+//
+mappedFile::~mappedFile() {
+    if (data) munmap((void *) data, size);
+}
+// Words are separated as by 'istringstream >>'
+const char * NextWord(const char * & p, const char * end, const char * & wordEnd) {
+    while (p < end && *p != '\n' && isspace((unsigned char) *p)) p++;
+    if (p == end || *p == '\n') return NULL;
+    const char * word = p;
+    while (p < end && !isspace((unsigned char) *p)) p++;
+    wordEnd = p;
+    return word;
+}
+//
+const char * NextLine(const char * p, const char * end) {
+    const char * newline = (const char *) memchr(p, '\n', end - p);
+    return newline ? newline + 1 : end;
+}
+// The starts of the pieces, and the end of the last
+vector <const char *> SplitLines(const char * data, size_t size, unsigned int n) {
+    const char * end = data + size;
+    vector <const char *> starts(1, data);
+    for (unsigned int i = 1; i < n; i++) {
+        const char * start = NextLine(data + size / n * i, end);
+        if (start > starts.back() && start < end) starts.push_back(start);
     }
-    in.close();
+    starts.push_back(end);
+    return starts;
+}
+// Not a number gives 0, and a leading '+' is allowed
+double ParseDouble(const char * word, const char * wordEnd) {
+    double value = 0.0;
+    if (word < wordEnd && *word == '+') word++;
+    if (from_chars(word, wordEnd, value).ec != errc()) return 0.0;
     return value;
 }
 //
-vector <double> ReadVector(char* filename, string name) {
-    ifstream in;
-    open(filename, in);
-    string word;
-    double value;
-    vector <double> values;
-    while (in) {
-        in >> word;
-        if (word == name) {
-            while (in >> value)
-                values.push_back(value);
-            return values;
-        }
-    }
-    if (values.empty()) {
-        cout << "***ERROR***: Didn't find " << name << " in " << filename << endl;
-        exit(-1);
-    }
-    in.close();
-    return values;
+int ParseInt(const char * word, const char * wordEnd) {
+    long long value = 0;
+    if (word < wordEnd && *word == '+') word++;
+    if (from_chars(word, wordEnd, value).ec != errc()) return 0;
+    return (int) value;
 }
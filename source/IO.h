@@ -21,9 +21,23 @@
 
 using namespace std;
 
-string Read(char *, string, string value = ""); 
-vector <double> ReadVector(char*, string);
 void open(char *, ifstream &);
 void PrintAll(char *filename);
 
+// The whole of a file, memory-mapped (read only) for as long as this exists
+class mappedFile {
+    public:
+        const char * data;
+        size_t size;
+        mappedFile(char * filename);
+        ~mappedFile();
+};
+// For reading big files (see graph::ReadVertices): the next word of the 
+//   line at 'p' (moving 'p' past it), or NULL at the end of the line
+const char * NextWord(const char * & p, const char * end, const char * & wordEnd);
+const char * NextLine(const char * p, const char * end);  // just past the next '\n'
+vector <const char *> SplitLines(const char * data, size_t size, unsigned int n);  // into about n pieces of whole lines
+double ParseDouble(const char * word, const char * wordEnd);  // as atof would
+int ParseInt(const char * word, const char * wordEnd);  // as atoi would
+
 #endif /* _IO_H */
@@ -1,32 +0,0 @@
-///////////////////////////////////////////////////////////////////////
-//  This file is part of ToFeT.
-//  
-//  ToFeT is free software: you can redistribute it and/or modify
-//  it under the terms of the GNU Lesser General Public License as published by
-//  the Free Software Foundation, either version 3 of the License, or
-//  (at your option) any later version.
-//  
-//  ToFeT is distributed in the hope that it will be useful,
-//  but WITHOUT ANY WARRANTY; without even the implied warranty of
-//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-//  GNU Lesser General Public License for more details.
-//  
-//  You should have received a copy of the GNU Lesser General Public License
-//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
-///////////////////////////////////////////////////////////////////////
-#ifndef RANDOMB
-#define RANDOMB
-
-#include <cmath>
-#include "global.h"
-
-double Rndm(long *idum);
-double Uniform();
-double UniformPos();
-double RandLog();
-double RandConstLog(double constant);
-int RandPos(int n);
-double RandDouble(double maxSize);
-int Dice();
-
-#endif
@@ -0,0 +1,163 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "celllist.h"
+
+/*******************
+ * SETUP
+ *******************/
+// Which cell is 'pos' in?
+unsigned int cellList::CellIndex(const vec & pos) const {
+    double x[3] = {pos.getX(), pos.getY(), pos.getZ()};
+    unsigned int c[3];
+    for (int d = 0; d < 3; d++) {
+        double s = (x[d] - _min[d]) / _width[d];
+        if (_periodic) s -= _n[d] * floor(s / _n[d]);  // wrap into the box
+        int i = int(s);
+        if (i < 0) i = 0;
+        if (i >= int(_n[d])) i = _n[d] - 1;
+        c[d] = i;
+    }
+    return (c[0] * _n[1] + c[1]) * _n[2] + c[2];
+}
+// Divide the graph into cells no narrower than 'range'.  With periodic
+//   boundaries the cells fill the simulation volume, otherwise they 
+//   just cover the vertices.
+void cellList::Setup(graph * Graph, double range) {
+    unsigned int nVertices = Graph->GetNumberVertices();
+    _periodic = Graph->IsPeriodic();
+    double max[3];
+    if (_periodic) {
+        for (int d = 0; d < 3; d++) _min[d] = 0.0;
+        max[0] = Graph->GetSizeX();
+        max[1] = Graph->GetSizeY();
+        max[2] = Graph->GetSizeZ();
+    }
+    else {
+        for (int d = 0; d < 3; d++) {
+            _min[d] = 1e50;
+            max[d] = -1e50;
+        }
+        for (unsigned int v = 0; v < nVertices; v++) {
+            const vec & pos = Graph->GetVertex(v)->GetPos();
+            double x[3] = {pos.getX(), pos.getY(), pos.getZ()};
+            for (int d = 0; d < 3; d++) {
+                if (x[d] < _min[d]) _min[d] = x[d];
+                if (x[d] > max[d]) max[d] = x[d];
+            }
+        }
+    }
+    for (int d = 0; d < 3; d++) {
+        double length = max[d] - _min[d];
+        _n[d] = (range > 0.0) ? (unsigned int) (length / range) : 1;
+        if (_n[d] < 1) _n[d] = 1;
+        _width[d] = (length > 0.0) ? length / _n[d] : 1.0;
+    }
+    unsigned int nCells = _n[0] * _n[1] * _n[2];
+    _cells.assign(nCells, vector <vertex *>());
+
+    // Each cell and its (up to) 26 neighbours.  If there are fewer than 3
+    //   cells along a periodic direction, the same neighbour turns up 
+    //   more than once, so only keep it once.
+    _neighbourCells.assign(nCells, vector <unsigned int>());
+    for (unsigned int c = 0; c < nCells; c++) {
+        int i[3] = {int(c / (_n[1] * _n[2])), int((c / _n[2]) % _n[1]), int(c % _n[2])};
+        for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dz = -1; dz <= 1; dz++) {
+                    int j[3] = {i[0] + dx, i[1] + dy, i[2] + dz};
+                    bool inside = true;
+                    for (int d = 0; d < 3; d++) {
+                        if (_periodic) j[d] = (j[d] + _n[d]) % _n[d];
+                        else if (j[d] < 0 || j[d] >= int(_n[d])) inside = false;
+                    }
+                    if (!inside) continue;
+                    unsigned int neighbour = (j[0] * _n[1] + j[1]) * _n[2] + j[2];
+                    if (find(_neighbourCells[c].begin(), _neighbourCells[c].end(), neighbour) == _neighbourCells[c].end())
+                        _neighbourCells[c].push_back(neighbour);
+                }
+            }
+        }
+    }
+
+    // A cell can't hold more hoppers than it has vertices, so reserve that 
+    //   much now, and Insert never allocates during the simulation
+    _cellOf.resize(nVertices);
+    _slot.assign(nVertices, -1);
+    vector <unsigned int> size(nCells, 0);
+    for (unsigned int v = 0; v < nVertices; v++) {
+        _cellOf[v] = CellIndex(Graph->GetVertex(v)->GetPos());
+        size[_cellOf[v]]++;
+    }
+    for (unsigned int c = 0; c < nCells; c++) _cells[c].reserve(size[c]);
+
+    cout << "Sorted vertices into " << _n[0] << " x " << _n[1] << " x " << _n[2] 
+         << " cells for Coulombic interactions\n";
+}
+
+/*******************
+ * DO'S
+ *******************/
+//
+void cellList::Insert(vertex * v) {
+    unsigned int id = v->GetID();
+    if (_slot[id] >= 0) return;
+    vector <vertex *> & cell = _cells[_cellOf[id]];
+    _slot[id] = cell.size();
+    cell.push_back(v);
+}
+// Swap 'v' with the last vertex in its cell, and remove it
+void cellList::Remove(vertex * v) {
+    unsigned int id = v->GetID();
+    if (_slot[id] < 0) return;
+    vector <vertex *> & cell = _cells[_cellOf[id]];
+    vertex * last = cell.back();
+    cell[_slot[id]] = last;
+    _slot[last->GetID()] = _slot[id];
+    cell.pop_back();
+    _slot[id] = -1;
+}
+//
+void cellList::Clear() {
+    for (unsigned int c = 0; c < _cells.size(); c++) {
+        for (unsigned int i = 0; i < _cells[c].size(); i++)
+            _slot[_cells[c][i]->GetID()] = -1;
+        _cells[c].clear();
+    }
+}
+// The order of the vertices in each cell is kept, since it's the order 
+//   in which their Coulomb energies are added up
+void cellList::SaveState(stateBuffer & state) const {
+    state.Put((uint64_t) _cells.size());
+    for (unsigned int c = 0; c < _cells.size(); c++) {
+        vector <unsigned int> IDs(_cells[c].size());
+        for (unsigned int i = 0; i < _cells[c].size(); i++) IDs[i] = _cells[c][i]->GetID();
+        state.Put(IDs);
+    }
+}
+//
+void cellList::RestoreState(stateBuffer & state, graph * Graph) {
+    Clear();
+    state.Check((uint64_t) _cells.size(), "number of Coulomb cells");
+    vector <unsigned int> IDs;
+    for (unsigned int c = 0; c < _cells.size(); c++) {
+        state.Get(IDs);
+        for (unsigned int i = 0; i < IDs.size(); i++) {
+            _slot[IDs[i]] = i;
+            _cells[c].push_back(Graph->GetVertex(IDs[i]));
+        }
+    }
+}
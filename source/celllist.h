@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'cellList' sorts the occupied vertices into a grid of cells, each 
+ * at least as wide as the range over which hoppers interact.  All the
+ * occupied vertices within range of a given vertex are then in the 
+ * 27 cells surrounding it, so Coulombic interactions with a cut-off 
+ * don't need to look at every hopper.  Vertices are added and removed 
+ * in O(1).
+ ********************************************************************/
+#ifndef _CELLLIST_H
+#define	_CELLLIST_H
+#include "global.h"
+#include "graph.h"
+
+using namespace std;
+
+class cellList{
+    private:
+        vector <vector <vertex *> > _cells;  // occupied vertices in each cell
+        vector <vector <unsigned int> > _neighbourCells;  // each cell and those around it
+        vector <unsigned int> _cellOf;  // cell of each vertex (by ID)
+        vector <int> _slot;  // position of each vertex in its cell, or -1 if not in the list
+        unsigned int _n[3];  // number of cells along x, y and z
+        double _min[3];  // lower corner of the grid
+        double _width[3];  // width of a cell along x, y and z
+        bool _periodic;
+
+        unsigned int CellIndex(const vec & pos) const;
+    // end of private:
+
+    public:
+        cellList(){
+            _periodic=false;
+        }
+        ~cellList(){
+            _cells.clear();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Setup(graph *, double range);
+        void Insert(vertex *);
+        void Remove(vertex *);
+        void Clear();
+        void SaveState(stateBuffer &) const;  // for checkpoints
+        void RestoreState(stateBuffer &, graph *);
+
+        /***********************************
+        * GET'S
+        ************************************/
+        // The cells that hold every occupied vertex within range of 'v'
+        const vector <unsigned int> & GetNeighbourCells(const vertex * v) const {return _neighbourCells[_cellOf[v->GetID()]];}
+        const vector <vertex *> & GetCell(const unsigned int & c) const {return _cells[c];}
+        unsigned int GetNumberCells() const {return _cells.size();}
+    // end of public:
+};
+#endif	/* _CELLLIST_H */
@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "checkpoint.h"
+#include <unistd.h>
+
+/*******************
+ * THE FILE
+ *******************/
+// A checkpoint is this header, the parameters of the simulation that 
+//   wrote it and then its state.  The checksum covers both.
+static const char CHECKPOINT_MAGIC[8] = {'T', 'o', 'F', 'e', 'T', 'c', 'k', '\n'};
+static const uint32_t CHECKPOINT_VERSION = 7;  // 2: hopper IDs; 3: just the number of collections; 4: occupations kept by any binary; 5: rates in fet mode; 6: updates of each _rateToOccupied; 7: when each FET electrode next changes
+struct checkpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t occupation;  // unused (occupations are kept, or not, as the parameters say)
+    uint64_t parametersBytes;
+    uint64_t stateBytes;
+    uint64_t checksum;
+};
+// FNV-1a
+static uint64_t Checksum(const char * data, size_t bytes, uint64_t hash=14695981039346656037ULL) {
+    for (size_t i = 0; i < bytes; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+// Parameters that may be changed before restarting
+static bool MayChange(const string & key) {
+    return key == "checkpoint" || key == "checkpointMinutes" || key == "timeout" 
+        || key == "maxTime" || key == "maxRuns" || key == "verbosity";
+}
+
+/*******************
+ * SETUP
+ *******************/
+// 'prefix' is put in front of the file name (e.g. for each simulation of a sweep)
+checkpoint::checkpoint(const simParameters & sim, const string & prefix) {
+    _busy = false;
+    _failed = false;
+    _calls = 0;
+    if (sim.Has("checkpoint")) _filename = prefix + sim.Get("checkpoint");
+    double minutes = sim.GetNumber("checkpointMinutes");
+    if (minutes <= 0.0) ERROR(-1, "checkpointMinutes must be positive");
+    _interval = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(60.0 * minutes));
+    _lastWrite = chrono::steady_clock::now();
+    for (unsigned int k = 0; k < sim.GetKeys().size(); k++) {
+        const string & key = sim.GetKeys()[k];
+        if (MayChange(key)) continue;
+        _parameters += key;
+        for (unsigned int i = 0; i < sim.GetValues(key).size(); i++) _parameters += " " + sim.GetValues(key)[i];
+        _parameters += "\n";
+    }
+}
+
+/*******************
+ * DO'S
+ *******************/
+//
+bool checkpoint::Read(stateBuffer & state) {
+    if (!IsOn()) return false;
+    FILE * in = fopen(_filename.c_str(), "rb");
+    if (!in) return false;
+    checkpointHeader header;
+    bool ok = (fread(&header, sizeof(header), 1, in) == 1);
+    if (!ok || memcmp(header.magic, CHECKPOINT_MAGIC, 8) != 0)
+        ERROR(-1, _filename + " isn't a checkpoint.  Delete it, or change 'checkpoint', to start again");
+    if (header.version != CHECKPOINT_VERSION)
+        ERROR(-1, _filename + " is version " + to_string(header.version) + " of the checkpoint format; expected " 
+                  + to_string(CHECKPOINT_VERSION) + ".  Delete it to start again");
+    vector <char> parameters(header.parametersBytes);
+    state.Clear();
+    state.Data().resize(header.stateBytes);
+    ok = fread(parameters.data(), 1, parameters.size(), in) == parameters.size()
+      && fread(state.Data().data(), 1, state.Size(), in) == state.Size();
+    fclose(in);
+    if (!ok || Checksum(state.Data().data(), state.Size(), Checksum(parameters.data(), parameters.size())) != header.checksum)
+        ERROR(-1, _filename + " is corrupted.  Delete it to start again");
+    if (string(parameters.begin(), parameters.end()) != _parameters)
+        ERROR(-1, _filename + " was written by a simulation with different parameters.  Only checkpoint, checkpointMinutes, "
+                  "timeout, maxTime, maxRuns and verbosity may be changed before restarting.  Delete it to start again");
+    return true;
+}
+//
+void checkpoint::Write(stateBuffer & state) {
+    Finish();
+    _writing.Data().swap(state.Data());
+    state.Clear();
+    _busy = true;
+    _lastWrite = chrono::steady_clock::now();
+    _writer = thread(&checkpoint::WriteFile, this);
+}
+//
+void checkpoint::WriteNow(stateBuffer & state) {
+    Write(state);
+    Finish();
+    cout << "Wrote checkpoint " << _filename << "\n";
+}
+//
+void checkpoint::Remove() {
+    Finish();
+    remove(_filename.c_str());
+}
+//
+void checkpoint::Finish() {
+    if (_writer.joinable()) _writer.join();
+    if (_failed) {
+        cout << "!!! WARNING !!! : Couldn't write checkpoint " << _filename << endl;
+        WARNINGS++;
+        _failed = false;
+    }
+}
+// Write '_writing' to a temporary file, and only once it's all on disk, 
+//   put it in place of the last checkpoint
+void checkpoint::WriteFile() {
+    #ifdef countAllocations
+    COUNT_ALLOCATIONS = false;  // this thread isn't part of the KMC loop
+    #endif
+    string temporary = _filename + ".tmp";
+    checkpointHeader header;
+    memcpy(header.magic, CHECKPOINT_MAGIC, 8);
+    header.version = CHECKPOINT_VERSION;
+    header.occupation = 0;
+    header.parametersBytes = _parameters.size();
+    header.stateBytes = _writing.Size();
+    header.checksum = Checksum(_writing.Data().data(), _writing.Size(), Checksum(_parameters.data(), _parameters.size()));
+
+    FILE * out = fopen(temporary.c_str(), "wb");
+    bool ok = (out != NULL);
+    if (ok) {
+        ok = fwrite(&header, sizeof(header), 1, out) == 1
+          && fwrite(_parameters.data(), 1, _parameters.size(), out) == _parameters.size()
+          && fwrite(_writing.Data().data(), 1, _writing.Size(), out) == _writing.Size()
+          && fflush(out) == 0 
+          && fsync(fileno(out)) == 0;
+        ok = (fclose(out) == 0) && ok;
+    }
+    ok = ok && rename(temporary.c_str(), _filename.c_str()) == 0;
+    if (!ok) _failed = true;
+    _writing.Clear();
+    _busy = false;
+}
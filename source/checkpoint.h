@@ -0,0 +1,87 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+/*********************************************************************
+ * 'checkpoint' writes the whole state of a simulation (see kmc::
+ * SaveState) to the file named by 'checkpoint' in ***.sim, every 
+ * 'checkpointMinutes', and when the simulation is stopped by 'timeout'
+ * or a terminate signal.  If that file is there when the simulation 
+ * starts, it carries on from where the checkpoint left off, exactly as 
+ * if it had never stopped.
+ * Each checkpoint is written by a thread of its own, while the 
+ * simulation carries on, to a temporary file that then replaces the 
+ * last one, so there is always one complete checkpoint to go back to.
+ ********************************************************************/
+#ifndef _CHECKPOINT_H
+#define	_CHECKPOINT_H
+#include "global.h"
+#include "simparameters.h"
+#include "statebuffer.h"
+#include <atomic>
+
+using namespace std;
+
+class checkpoint{
+    private:
+        string _filename;  // empty if there are no checkpoints
+        string _parameters;  // that a restart must have in common with this simulation
+        chrono::steady_clock::duration _interval;
+        chrono::steady_clock::time_point _lastWrite;
+        unsigned int _calls;  // to Due, since the clock was last looked at
+        stateBuffer _writing;  // the state being written by '_writer'...
+        thread _writer;
+        atomic <bool> _busy;  // ... until it's done
+        atomic <bool> _failed;  // couldn't write the last one?
+
+        void WriteFile();
+        void Finish();  // wait for the last checkpoint to be written
+    // end of private:
+
+    public:
+        checkpoint(const simParameters & sim, const string & prefix="");
+        ~checkpoint(){
+            Finish();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        // The state of the simulation when the checkpoint was written, or false 
+        //   if there isn't one
+        bool Read(stateBuffer & state);
+        // Write 'state' (which is taken over) in the background, or now, 
+        //   when the simulation is about to stop
+        void Write(stateBuffer & state);
+        void WriteNow(stateBuffer & state);
+        // Delete the checkpoint once the simulation has finished, so that 
+        //   running it again starts from the beginning
+        void Remove();
+
+        /***********************************
+        * GET'S
+        ************************************/
+        bool IsOn() const {return !_filename.empty();}
+        // Is it time for the next checkpoint?  Called after every hop, so 
+        //   the clock is only looked at every so often.
+        bool Due() {
+            if (++_calls < 4096) return false;
+            _calls = 0;
+            return !_busy && chrono::steady_clock::now() - _lastWrite >= _interval;
+        }
+        const string & GetFilename() const {return _filename;}
+    // end of public:
+};
+#endif	/* _CHECKPOINT_H */
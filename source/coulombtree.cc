@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "coulombtree.h"
+
+/*******************
+ * SETUP
+ *******************/
+// Sort the vertices in box 'b' into its (up to) 8 octants, and carry on
+//   until there are no more than 'leafSize' vertices in each box.
+void coulombTree::Split(unsigned int b, unsigned int leafSize) {
+    unsigned int begin = _boxes[b]._begin;
+    unsigned int end = _boxes[b]._end;
+    double width = _boxes[b]._width;
+    // Stop when the box is small enough, or if many vertices sit on top of each other
+    if (end - begin <= leafSize || width < 1e-6) {
+        for (unsigned int r = begin; r < end; r++) _leafOf[r] = b;
+        return;
+    }
+    double centre[3] = {_boxes[b]._centre[0], _boxes[b]._centre[1], _boxes[b]._centre[2]};
+
+    // Counting sort by octant
+    vector <unsigned int> octant(end - begin);
+    unsigned int count[9] = {0};
+    for (unsigned int r = begin; r < end; r++) {
+        const double * x = &_pos[3 * r];
+        unsigned int o = (x[0] >= centre[0]) * 4 + (x[1] >= centre[1]) * 2 + (x[2] >= centre[2]);
+        octant[r - begin] = o;
+        count[o + 1]++;
+    }
+    for (unsigned int o = 0; o < 8; o++) count[o + 1] += count[o];
+    vector <unsigned int> order(end - begin);
+    vector <double> pos(3 * (end - begin));
+    unsigned int next[8];
+    for (unsigned int o = 0; o < 8; o++) next[o] = count[o];
+    for (unsigned int r = begin; r < end; r++) {
+        unsigned int s = next[octant[r - begin]]++;
+        order[s] = _order[r];
+        for (int d = 0; d < 3; d++) pos[3 * s + d] = _pos[3 * r + d];
+    }
+    for (unsigned int s = 0; s < end - begin; s++) {
+        _order[begin + s] = order[s];
+        for (int d = 0; d < 3; d++) _pos[3 * (begin + s) + d] = pos[3 * s + d];
+    }
+
+    // Children of the same box are kept together, so make them all before splitting any
+    _boxes[b]._firstChild = _boxes.size();
+    for (unsigned int o = 0; o < 8; o++) {
+        if (count[o + 1] == count[o]) continue;
+        box child = _boxes[b];
+        child._centre[0] = centre[0] + ((o & 4) ? 0.25 : -0.25) * width;
+        child._centre[1] = centre[1] + ((o & 2) ? 0.25 : -0.25) * width;
+        child._centre[2] = centre[2] + ((o & 1) ? 0.25 : -0.25) * width;
+        child._width = 0.5 * width;
+        child._begin = begin + count[o];
+        child._end = begin + count[o + 1];
+        child._nChildren = 0;
+        child._parent = b;
+        _boxes.push_back(child);
+        _boxes[b]._nChildren++;
+    }
+    for (unsigned int c = 0; c < _boxes[b]._nChildren; c++)
+        Split(_boxes[b]._firstChild + c, leafSize);
+}
+// Build the tree over all the vertices of the graph.  'theta' sets the
+//   accuracy: smaller is more accurate, but slower.
+void coulombTree::Setup(graph * Graph, double theta) {
+    unsigned int nVertices = Graph->GetNumberVertices();
+    _theta2 = theta * theta;
+    _order.resize(nVertices);
+    _pos.resize(3 * nVertices);
+    double min[3] = {1e50, 1e50, 1e50};
+    double max[3] = {-1e50, -1e50, -1e50};
+    for (unsigned int v = 0; v < nVertices; v++) {
+        const vec & pos = Graph->GetVertex(v)->GetPos();
+        double x[3] = {pos.getX(), pos.getY(), pos.getZ()};
+        _order[v] = v;
+        for (int d = 0; d < 3; d++) {
+            _pos[3 * v + d] = x[d];
+            if (x[d] < min[d]) min[d] = x[d];
+            if (x[d] > max[d]) max[d] = x[d];
+        }
+    }
+    box root;
+    root._width = 0.0;
+    for (int d = 0; d < 3; d++) {
+        root._centre[d] = (nVertices > 0) ? 0.5 * (min[d] + max[d]) : 0.0;
+        if (nVertices > 0 && max[d] - min[d] > root._width) root._width = max[d] - min[d];
+    }
+    root._width *= 1.0 + 1e-9;  // so that no vertex sits exactly on the edge
+    root._begin = 0;
+    root._end = nVertices;
+    root._firstChild = root._nChildren = 0;
+    root._parent = -1;
+    _boxes.clear();
+    _boxes.push_back(root);
+    _leafOf.resize(nVertices);
+    Split(0, 8);
+
+    _rank.resize(nVertices);
+    for (unsigned int r = 0; r < nVertices; r++) _rank[_order[r]] = r;
+    _occupied.assign(nVertices, 0);
+    Clear();
+
+    cout << "Built a tree of " << _boxes.size() << " boxes over the vertices for Coulombic interactions\n";
+}
+
+/*******************
+ * DO'S
+ *******************/
+// Add ('sign' = 1) or subtract ('sign' = -1) the vertex at position 'r'
+//   to the moments of every box that holds it.  Moments are taken about
+//   the centre of each box, to keep them small.
+void coulombTree::AddMoments(unsigned int r, int sign) {
+    const double * x = &_pos[3 * r];
+    for (int b = _leafOf[r]; b >= 0; b = _boxes[b]._parent) {
+        box & B = _boxes[b];
+        B._charges += sign;
+        if (B._charges == 0) {  // start again from zero, so rounding errors can't build up
+            for (int d = 0; d < 3; d++) B._sum[d] = 0.0;
+            for (int d = 0; d < 6; d++) B._sum2[d] = 0.0;
+            continue;
+        }
+        double a[3] = {x[0] - B._centre[0], x[1] - B._centre[1], x[2] - B._centre[2]};
+        for (int d = 0; d < 3; d++) B._sum[d] += sign * a[d];
+        B._sum2[0] += sign * a[0] * a[0];
+        B._sum2[1] += sign * a[1] * a[1];
+        B._sum2[2] += sign * a[2] * a[2];
+        B._sum2[3] += sign * a[0] * a[1];
+        B._sum2[4] += sign * a[0] * a[2];
+        B._sum2[5] += sign * a[1] * a[2];
+    }
+}
+//
+void coulombTree::Insert(vertex * v) {
+    unsigned int r = _rank[v->GetID()];
+    if (_occupied[r]) return;
+    _occupied[r] = 1;
+    AddMoments(r, 1);
+}
+//
+void coulombTree::Remove(vertex * v) {
+    unsigned int r = _rank[v->GetID()];
+    if (!_occupied[r]) return;
+    _occupied[r] = 0;
+    AddMoments(r, -1);
+}
+//
+void coulombTree::Clear() {
+    for (unsigned int b = 0; b < _boxes.size(); b++) {
+        _boxes[b]._charges = 0;
+        for (int d = 0; d < 3; d++) _boxes[b]._sum[d] = 0.0;
+        for (int d = 0; d < 6; d++) _boxes[b]._sum2[d] = 0.0;
+    }
+    _occupied.assign(_occupied.size(), 0);
+}
+// The moments are saved as they are, since they carry the rounding 
+//   errors of every Insert and Remove
+void coulombTree::SaveState(stateBuffer & state) const {
+    state.Put((uint64_t) _boxes.size());
+    state.Put(_boxes);
+    state.Put(_occupied);
+}
+//
+void coulombTree::RestoreState(stateBuffer & state) {
+    state.Check((uint64_t) _boxes.size(), "number of Coulomb tree boxes");
+    state.Get(_boxes);
+    state.Get(_occupied);
+}
+
+/*******************
+ * GET'S
+ *******************/
+// Walk down the tree from the top, treating each box as a whole if it's
+//   far enough away, and otherwise looking inside it.  Boxes holding
+//   'ignore' have it taken out of their moments first.
+double coulombTree::GetPotential(const vec & pos, const vertex * ignore) const {
+    double p[3] = {pos.getX(), pos.getY(), pos.getZ()};
+    unsigned int skip = (ignore != NULL) ? _rank[ignore->GetID()] : _order.size();
+    bool skipOccupied = (skip < _order.size() && _occupied[skip]);
+    double potential = 0.0;
+    _stack.clear();
+    if (!_boxes.empty()) _stack.push_back(0);
+    while (!_stack.empty()) {
+        const box & B = _boxes[_stack.back()];
+        _stack.pop_back();
+        if (B._charges == 0) continue;
+
+        if (B._nChildren == 0) {  // few enough to sum directly
+            for (unsigned int r = B._begin; r < B._end; r++) {
+                if (!_occupied[r] || r == skip) continue;
+                double dx = _pos[3 * r] - p[0];
+                double dy = _pos[3 * r + 1] - p[1];
+                double dz = _pos[3 * r + 2] - p[2];
+                double r2 = dx * dx + dy * dy + dz * dz;
+                if (r2 > 0.0) potential += 1.0 / sqrt(r2);  // a vertex doesn't interact with itself
+            }
+            continue;
+        }
+
+        double m = B._charges;
+        double s[3] = {B._sum[0], B._sum[1], B._sum[2]};
+        double s2[6] = {B._sum2[0], B._sum2[1], B._sum2[2], B._sum2[3], B._sum2[4], B._sum2[5]};
+        if (skipOccupied && skip >= B._begin && skip < B._end) {
+            const double * x = &_pos[3 * skip];
+            double a[3] = {x[0] - B._centre[0], x[1] - B._centre[1], x[2] - B._centre[2]};
+            m -= 1.0;
+            if (m == 0.0) continue;
+            for (int d = 0; d < 3; d++) s[d] -= a[d];
+            s2[0] -= a[0] * a[0];
+            s2[1] -= a[1] * a[1];
+            s2[2] -= a[2] * a[2];
+            s2[3] -= a[0] * a[1];
+            s2[4] -= a[0] * a[2];
+            s2[5] -= a[1] * a[2];
+        }
+        // Centre of charge, relative to the centre of the box, and from 'p'
+        double c[3] = {s[0] / m, s[1] / m, s[2] / m};
+        double d[3] = {p[0] - B._centre[0] - c[0], p[1] - B._centre[1] - c[1], p[2] - B._centre[2] - c[2]};
+        double r2 = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+        bool outside = (fabs(p[0] - B._centre[0]) > 0.5 * B._width
+                     || fabs(p[1] - B._centre[1]) > 0.5 * B._width
+                     || fabs(p[2] - B._centre[2]) > 0.5 * B._width);
+        if (outside && B._width * B._width < _theta2 * r2) {
+            // Charge at the centre of charge, plus the quadrupole (there's
+            //   no dipole about the centre of charge).  'M' is the sum of
+            //   the products of the coordinates about the centre of charge.
+            double M[6];
+            for (int k = 0; k < 3; k++) M[k] = s2[k] - m * c[k] * c[k];
+            M[3] = s2[3] - m * c[0] * c[1];
+            M[4] = s2[4] - m * c[0] * c[2];
+            M[5] = s2[5] - m * c[1] * c[2];
+            double dMd = M[0] * d[0] * d[0] + M[1] * d[1] * d[1] + M[2] * d[2] * d[2]
+                       + 2.0 * (M[3] * d[0] * d[1] + M[4] * d[0] * d[2] + M[5] * d[1] * d[2]);
+            double r = sqrt(r2);
+            potential += m / r + (3.0 * dMd - r2 * (M[0] + M[1] + M[2])) / (2.0 * r2 * r2 * r);
+            continue;
+        }
+        for (unsigned int k = 0; k < B._nChildren; k++) _stack.push_back(B._firstChild + k);
+    }
+    return potential;
+}
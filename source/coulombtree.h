@@ -0,0 +1,89 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'coulombTree' is a Barnes-Hut octree over the vertices of the graph.
+ * Each box keeps the number of occupied vertices inside it, and enough
+ * of their moments to give their potential far away as a charge at
+ * their centre plus a quadrupole.  The potential at any point is then
+ * found in O(log N): boxes that are small compared with their distance
+ * (width < theta * distance) are treated as a whole, and only nearby
+ * hoppers are summed one by one.  Vertices are inserted and removed
+ * in O(log N) by updating the boxes above them.
+ ********************************************************************/
+#ifndef _COULOMBTREE_H
+#define	_COULOMBTREE_H
+#include "global.h"
+#include "graph.h"
+
+using namespace std;
+
+class coulombTree{
+    private:
+        struct box {
+            double _centre[3];  // geometric centre
+            double _width;  // largest side
+            unsigned int _begin, _end;  // vertices inside, as positions in '_order'
+            unsigned int _firstChild, _nChildren;  // children are stored together
+            int _parent;
+            // Moments of the occupied vertices inside: number, sum of
+            //   positions and sum of the products of their coordinates
+            //   (xx, yy, zz, xy, xz, yz)
+            int _charges;
+            double _sum[3];
+            double _sum2[6];
+        };
+        vector <box> _boxes;  // _boxes[0] is the whole graph
+        vector <unsigned int> _order;  // vertex IDs, sorted so that each box is contiguous
+        vector <unsigned int> _rank;  // position of each vertex (by ID) in '_order'
+        vector <unsigned int> _leafOf;  // smallest box holding each position in '_order'
+        vector <double> _pos;  // x,y,z of each position in '_order'
+        vector <char> _occupied;  // of each position in '_order'
+        double _theta2;  // square of the opening angle
+        mutable vector <unsigned int> _stack;
+
+        void Split(unsigned int b, unsigned int leafSize);
+        void AddMoments(unsigned int r, int sign);
+    // end of private:
+
+    public:
+        coulombTree(){
+            _theta2=0.0;
+        }
+        ~coulombTree(){
+            _boxes.clear();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Setup(graph *, double theta);
+        void Insert(vertex *);
+        void Remove(vertex *);
+        void Clear();
+        void SaveState(stateBuffer &) const;  // for checkpoints
+        void RestoreState(stateBuffer &);
+
+        /***********************************
+        * GET'S
+        ************************************/
+        // Sum of 1/r (Ang^-1) from every occupied vertex except 'ignore'
+        double GetPotential(const vec & pos, const vertex * ignore) const;
+        unsigned int GetNumberBoxes() const {return _boxes.size();}
+    // end of public:
+};
+#endif	/* _COULOMBTREE_H */
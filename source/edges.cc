@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "edges.h"
+#include "vertex.h"
+
+/*******************
+ * DO'S
+ *******************/
+// Store an edge (in both directions) until 'Build' is called.
+void edges::Add(unsigned int v1, unsigned int v2, const double & J, const double & DE, const double & DZ, const unsigned int & m) {
+    _readFrom.push_back(v1);
+    _readTo.push_back(v2);
+    _readJs.push_back(J);
+    _readDEs.push_back(DE);
+    _readDZs.push_back(DZ);
+    _readReorgenums.push_back(m);
+}
+// Make room for 'n' edges to be added
+void edges::Reserve(size_t n) {
+    _readFrom.reserve(n);
+    _readTo.reserve(n);
+    _readJs.reserve(n);
+    _readDEs.reserve(n);
+    _readDZs.reserve(n);
+    _readReorgenums.reserve(n);
+}
+// Sort the edges by the vertex they leave from (keeping the order in
+//   which they were read), fill in the reverse indices, and point each 
+//   vertex at its own edges.
+void edges::Build(vector <vertex> & vertices) {
+    unsigned int n = vertices.size();
+    unsigned int nRead = _readFrom.size();
+    _first.assign(n + 1, 0);
+    for (unsigned int k = 0; k < nRead; k++) {
+        _first[_readFrom[k] + 1]++;
+        _first[_readTo[k] + 1]++;
+    }
+    for (unsigned int v = 0; v < n; v++) _first[v + 1] += _first[v];
+
+    unsigned int nEdges = _first[n];
+    _to.resize(nEdges);
+    _reverse.resize(nEdges);
+    _reorgenums.resize(nEdges);
+    _Js.resize(nEdges);
+    _DEs.resize(nEdges);
+    _DZs.resize(nEdges);
+
+    vector <unsigned int> next(_first.begin(), _first.end() - 1);
+    for (unsigned int k = 0; k < nRead; k++) {
+        unsigned int v1 = _readFrom[k], v2 = _readTo[k];
+        unsigned int a = next[v1]++;
+        unsigned int b = next[v2]++;
+        _to[a] = v2;
+        _to[b] = v1;
+        _reverse[a] = b - _first[v2];
+        _reverse[b] = a - _first[v1];
+        _reorgenums[a] = _reorgenums[b] = _readReorgenums[k];
+        _Js[a] = _Js[b] = _readJs[k];
+        _DEs[a] = _readDEs[k];
+        _DEs[b] = -_readDEs[k];
+        _DZs[a] = _readDZs[k];
+        _DZs[b] = -_readDZs[k];
+    }
+    _readFrom.clear(); _readTo.clear();
+    _readJs.clear(); _readDEs.clear(); _readDZs.clear();
+    _readReorgenums.clear();
+
+    // A neighbour seen twice from the same vertex is a duplicated edge
+    vector <unsigned int> seenFrom(n, n);
+    for (unsigned int v = 0; v < n; v++) {
+        for (unsigned int i = _first[v]; i < _first[v + 1]; i++) {
+            if (seenFrom[_to[i]] == v) {
+                cout << "***ERROR***: Duplicated edges\n";
+                exit(-1);
+            }
+            seenFrom[_to[i]] = v;
+        }
+    }
+    Link(vertices);
+}
+// Make the arrays that aren't read in (rates etc.), and point each vertex 
+//   at its own edges.  Build calls this, but so does graph::ReadBinary, 
+//   which fills in the other arrays itself.
+void edges::Link(vector <vertex> & vertices) {
+    unsigned int nEdges = _to.size();
+    _rates.assign(nEdges, 0.0);
+    _occupied.assign(nEdges, 0);
+    _aliasProb.assign(nEdges, 1.0);
+    _alias.assign(nEdges, 0);
+    _maxNeighbours = 0;
+    for (unsigned int v = 0; v < vertices.size(); v++) {
+        vertices[v].SetEdges(this, _first[v], _first[v + 1] - _first[v]);
+        _maxNeighbours = max(_maxNeighbours, _first[v + 1] - _first[v]);
+    }
+}
+
+/*******************
+ * GET'S
+ *******************/
+// Memory used by all the edges
+size_t edges::GetBytes() const {
+    return _first.capacity() * sizeof(unsigned int)
+         + _to.capacity() * sizeof(unsigned int)
+         + _reverse.capacity() * sizeof(unsigned int)
+         + _reorgenums.capacity() * sizeof(unsigned char)
+         + (_Js.capacity() + _DEs.capacity() + _DZs.capacity() + _rates.capacity()
+            + _DCs.capacity() + _ratesPrefactor.capacity() + _ratesReorg.capacity() 
+            + _ratesScale.capacity() + _aliasProb.capacity()) * sizeof(double)
+         + _alias.capacity() * sizeof(unsigned int)
+         + _occupied.capacity() * sizeof(char);
+}
@@ -0,0 +1,84 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'edges' holds every edge of the graph in compressed sparse row 
+ * form.  The edges out of vertex v are stored contiguously, in 
+ * positions _first[v] to _first[v+1]-1 of each array, and each 
+ * 'vertex' just records where its own edges start.  This keeps 
+ * everything needed for a hop on one or two cache lines, and avoids
+ * the overhead of giving every vertex its own vectors.
+ ********************************************************************/
+#ifndef _EDGES_H
+#define	_EDGES_H
+#include "global.h"
+
+using namespace std;
+
+class vertex;
+
+class edges{
+    private:
+        // Edges as read in, before 'Build' sorts them by vertex
+        vector <unsigned int> _readFrom, _readTo;
+        vector <double> _readJs, _readDEs, _readDZs;
+        vector <unsigned char> _readReorgenums;
+    // end of private:
+
+    public:
+        vector <unsigned int> _first;  // first edge of each vertex, plus one past the last edge
+        vector <unsigned int> _to;  // ID of the neighbour
+        vector <unsigned int> _reverse;  // index of the same edge in the neighbour's list
+        vector <unsigned char> _reorgenums;  // enumerated edge type
+        vector <double> _Js;
+        vector <double> _DEs;  // deltaE between vertices
+        vector <double> _DZs;  // deltaZ between vertices
+        vector <double> _rates;
+        vector <char> _occupied;  // is the neighbour occupied?  (copies of the graph keep their own)
+        // The following are only allocated when 'hopperInteractions'
+        //   are enabled.
+        vector <double> _DCs;  // difference in Coulomb energies 
+        vector <double> _ratesPrefactor; 
+        vector <double> _ratesReorg;  // reorganisation energy (Marcus only)
+        vector <double> _ratesScale;  // -1/(4 lambda kT) (Marcus) or -1/kT (Miller-Abrahams)
+        // Alias tables (see vertex::BuildAliasTable)
+        vector <double> _aliasProb;
+        vector <unsigned int> _alias;
+        vector <double> _reorgs;  // reorganisation energy of each enumerated edge type
+        unsigned int _maxNeighbours;  // most edges out of any one vertex
+
+        edges(){
+            _maxNeighbours = 0;
+        }
+        ~edges(){}
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Add(unsigned int, unsigned int, const double &, const double &, const double &, const unsigned int &);
+        void Reserve(size_t);
+        void Build(vector <vertex> &);
+        void Link(vector <vertex> &);
+
+        /***********************************
+        * GET'S
+        ************************************/
+        unsigned int Size() const {return _to.size();}
+        size_t GetBytes() const;
+    // end of public:
+};
+#endif	/* _EDGES_H */
@@ -0,0 +1,195 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "eventqueue.h"
+
+/*******************
+ * HEAP MAINTENANCE
+ *******************/
+// Swap two entries, keeping each hopper's record of its position up to date
+void eventQueue::Swap(unsigned int i, unsigned int j) {
+    hopper * tmp = _heap[i];
+    _heap[i] = _heap[j];
+    _heap[j] = tmp;
+    _heap[i]->SetQueueIndex(i);
+    _heap[j]->SetQueueIndex(j);
+}
+// Move an entry towards the top until its parent hops no later than it does
+void eventQueue::SiftUp(unsigned int i) {
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (!Earlier(i, parent)) break;
+        Swap(i, parent);
+        i = parent;
+    }
+}
+// Move an entry towards the bottom until neither child hops before it does
+void eventQueue::SiftDown(unsigned int i) {
+    unsigned int n = _heap.size();
+    while (true) {
+        unsigned int earliest = i;
+        unsigned int left = 2 * i + 1;
+        unsigned int right = left + 1;
+        if (left < n && Earlier(left, earliest)) earliest = left;
+        if (right < n && Earlier(right, earliest)) earliest = right;
+        if (earliest == i) break;
+        Swap(i, earliest);
+        i = earliest;
+    }
+}
+// The entry at 'i' may be out of order in either direction
+void eventQueue::Restore(unsigned int i) {
+    if (i > 0 && Earlier(i, (i - 1) / 2)) SiftUp(i);
+    else SiftDown(i);
+}
+
+/*******************
+ * DO'S
+ *******************/
+//
+void eventQueue::Push(hopper * H) {
+    H->SetQueueIndex(_heap.size());
+    _heap.push_back(H);
+    SiftUp(_heap.size() - 1);
+}
+// The waitTime of 'H' has changed (either way), so restore the heap order
+void eventQueue::Update(hopper * H) {
+    Restore(H->GetQueueIndex());
+}
+// Remove 'H' by replacing it with the last entry, which is then re-sifted
+void eventQueue::Remove(hopper * H) {
+    unsigned int i = H->GetQueueIndex();
+    unsigned int last = _heap.size() - 1;
+    H->SetQueueIndex(-1);
+    if (i != last) {
+        _heap[i] = _heap[last];
+        _heap[i]->SetQueueIndex(i);
+        _heap.pop_back();
+        Restore(i);
+    }
+    else _heap.pop_back();
+}
+// Restore the heap order from scratch in O(N).  Used after every hopper
+//   has been given a new waitTime (e.g. 'hoppers::SetHops_C').
+void eventQueue::Rebuild() {
+    for (unsigned int i = 0; i < _heap.size(); i++)
+        _heap[i]->SetQueueIndex(i);
+    for (int i = int(_heap.size()) / 2 - 1; i >= 0; i--)
+        SiftDown(i);
+}
+//
+void eventQueue::Assign(const vector <hopper *> & heap) {
+    _heap = heap;
+    for (unsigned int i = 0; i < _heap.size(); i++)
+        _heap[i]->SetQueueIndex(i);
+}
+
+/*******************
+ * STEP QUEUE
+ *******************/
+// Swap two entries, keeping the record of their positions up to date
+void stepQueue::Swap(unsigned int i, unsigned int j) {
+    unsigned int tmp = _heap[i];
+    _heap[i] = _heap[j];
+    _heap[j] = tmp;
+    _slot[_heap[i]] = i;
+    _slot[_heap[j]] = j;
+}
+//
+void stepQueue::SiftUp(unsigned int i) {
+    while (i > 0) {
+        unsigned int parent = (i - 1) / 2;
+        if (!Earlier(i, parent)) break;
+        Swap(i, parent);
+        i = parent;
+    }
+}
+//
+void stepQueue::SiftDown(unsigned int i) {
+    unsigned int n = _heap.size();
+    while (true) {
+        unsigned int earliest = i;
+        unsigned int left = 2 * i + 1;
+        unsigned int right = left + 1;
+        if (left < n && Earlier(left, earliest)) earliest = left;
+        if (right < n && Earlier(right, earliest)) earliest = right;
+        if (earliest == i) break;
+        Swap(i, earliest);
+        i = earliest;
+    }
+}
+// Reserve room for every electrode, so the heap never allocates
+void stepQueue::Setup(unsigned int n) {
+    _heap.clear();
+    _heap.reserve(n);
+    _slot.assign(n, -1);
+    _step.assign(n, 0);
+}
+//
+void stepQueue::Set(unsigned int e, uint64_t step) {
+    if (_slot[e] < 0) {
+        _slot[e] = _heap.size();
+        _heap.push_back(e);
+        _step[e] = step;
+        SiftUp(_heap.size() - 1);
+        return;
+    }
+    bool earlier = (step < _step[e]);
+    _step[e] = step;
+    if (earlier) SiftUp(_slot[e]);
+    else SiftDown(_slot[e]);
+}
+// Replace 'e' by the last entry, which is then re-sifted
+void stepQueue::Remove(unsigned int e) {
+    int i = _slot[e];
+    if (i < 0) return;
+    unsigned int last = _heap.size() - 1;
+    _slot[e] = -1;
+    if ((unsigned int) i != last) {
+        _heap[i] = _heap[last];
+        _slot[_heap[i]] = i;
+        _heap.pop_back();
+        if (i > 0 && Earlier(i, (i - 1) / 2)) SiftUp(i);
+        else SiftDown(i);
+    }
+    else _heap.pop_back();
+}
+//
+void stepQueue::Clear() {
+    for (unsigned int i = 0; i < _heap.size(); i++) _slot[_heap[i]] = -1;
+    _heap.clear();
+}
+// Since ties are broken by number, the electrodes and their steps are 
+//   enough to give the same order after a restart
+void stepQueue::SaveState(stateBuffer & state) const {
+    vector <uint64_t> steps(_heap.size());
+    for (unsigned int i = 0; i < _heap.size(); i++) steps[i] = _step[_heap[i]];
+    state.Put(_heap);
+    state.Put(steps);
+}
+//
+void stepQueue::RestoreState(stateBuffer & state) {
+    vector <unsigned int> heap;
+    vector <uint64_t> steps;
+    state.Get(heap);
+    state.Get(steps);
+    Clear();
+    if (heap.size() != steps.size()) ERROR(-1, "Checkpoint is corrupted");
+    for (unsigned int i = 0; i < heap.size(); i++) {
+        if (heap[i] >= _slot.size()) ERROR(-1, "Checkpoint has more electrodes than this simulation");
+        Set(heap[i], steps[i]);
+    }
+}
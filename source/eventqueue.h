@@ -0,0 +1,118 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'eventQueue' is an indexed binary min-heap of hoppers, keyed on
+ * their waitTime (i.e. when they will next hop).  Each hopper knows
+ * its own position in the heap, so that when a hopper is rescheduled
+ * or removed it can be moved to the right place in O(log N), and the
+ * most imminent hop is always at the top.
+ ********************************************************************/
+#ifndef _EVENTQUEUE_H
+#define	_EVENTQUEUE_H
+#include "global.h"
+#include "hopper.h"
+#include "statebuffer.h"
+
+using namespace std;
+
+class eventQueue{
+    private:
+        vector <hopper *> _heap;
+
+        bool Earlier(unsigned int i, unsigned int j) const {
+            return _heap[i]->GetWaitTime() < _heap[j]->GetWaitTime();
+        }
+        void Swap(unsigned int, unsigned int);
+        void SiftUp(unsigned int);
+        void SiftDown(unsigned int);
+        void Restore(unsigned int);
+    // end of private:
+
+    public:
+        eventQueue(){}
+        ~eventQueue(){
+            _heap.clear();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Push(hopper *);
+        void Update(hopper *);  // call whenever waitTime changes
+        void Remove(hopper *);
+        void Rebuild();  // cheaper than many Update's if all waitTimes have changed
+        void Clear() {_heap.clear();}
+        void Assign(const vector <hopper *> &);  // exactly this heap (from a checkpoint)
+
+        /***********************************
+        * GET'S
+        ************************************/
+        hopper * Top() const {return _heap.front();}
+        hopper * At(unsigned int i) const {return _heap[i];}
+        bool Empty() const {return _heap.empty();}
+        unsigned int Size() const {return _heap.size();}
+    // end of public:
+};
+
+/*********************************************************************
+ * 'stepQueue' is the same kind of heap, of the electrodes of an FET
+ * (numbered as in hoppers::_electrodeCoulomb), keyed on the MC step 
+ * at which each will next change its occupation.  Electrodes due at 
+ * the same step come out lowest number first, so the order doesn't 
+ * depend on how the heap got there.
+ ********************************************************************/
+class stepQueue{
+    private:
+        vector <unsigned int> _heap;
+        vector <int> _slot;  // position of each electrode in '_heap', or -1
+        vector <uint64_t> _step;  // step of each electrode in '_heap'
+
+        bool Earlier(unsigned int i, unsigned int j) const {
+            unsigned int a = _heap[i], b = _heap[j];
+            return _step[a] < _step[b] || (_step[a] == _step[b] && a < b);
+        }
+        void Swap(unsigned int, unsigned int);
+        void SiftUp(unsigned int);
+        void SiftDown(unsigned int);
+    // end of private:
+
+    public:
+        stepQueue(){}
+        ~stepQueue(){
+            _heap.clear();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Setup(unsigned int);  // for this many electrodes, none in the heap
+        void Set(unsigned int, uint64_t);  // add the electrode, or move it to this step
+        void Remove(unsigned int);  // if it's there
+        void Clear();
+        void SaveState(stateBuffer &) const;  // for checkpoints
+        void RestoreState(stateBuffer &);
+
+        /***********************************
+        * GET'S
+        ************************************/
+        unsigned int Top() const {return _heap.front();}
+        uint64_t TopStep() const {return _step[_heap.front()];}
+        bool Empty() const {return _heap.empty();}
+    // end of public:
+};
+#endif	/* _EVENTQUEUE_H */
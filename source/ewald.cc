@@ -0,0 +1,171 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "ewald.h"
+
+/*******************
+ * SETUP
+ *******************/
+// Choose the splitting parameter and reciprocal lattice vectors, so that
+//   both sums converge to ~1e-7, then tabulate the smooth part of the
+//   potential.
+void ewald::Setup(const double & sizeX, const double & sizeY, const double & sizeZ, unsigned int n) {
+    if (sizeX <= 0.0 || sizeY <= 0.0 || sizeZ <= 0.0)
+        ERROR(-1, "Ewald summation needs sizeX, sizeY and sizeZ");
+    _L[0] = sizeX;
+    _L[1] = sizeY;
+    _L[2] = sizeZ;
+    _n = n;
+    for (int d = 0; d < 3; d++) _h[d] = 0.5 * _L[d] / _n;
+    double volume = _L[0] * _L[1] * _L[2];
+
+    // erfc(alpha * L/2) ~ 1e-6, so only the nearest images are needed in real space
+    _alpha = 7.0 / min(_L[0], min(_L[1], _L[2]));
+    _background = -pi / (_alpha * _alpha * volume);
+
+    // exp(-k^2 / 4 alpha^2) < 1e-7
+    unsigned int kMax[3];
+    for (int d = 0; d < 3; d++) kMax[d] = (unsigned int) ceil(1.3 * _alpha * _L[d]);
+    for (unsigned int i = 0; i <= kMax[0]; i++) {
+        for (unsigned int j = 0; j <= kMax[1]; j++) {
+            for (unsigned int l = 0; l <= kMax[2]; l++) {
+                if (i == 0 && j == 0 && l == 0) continue;
+                double kx = 2.0 * pi * i / _L[0];
+                double ky = 2.0 * pi * j / _L[1];
+                double kz = 2.0 * pi * l / _L[2];
+                double k2 = kx * kx + ky * ky + kz * kz;
+                double coefficient = 4.0 * pi / volume * exp(-k2 / (4.0 * _alpha * _alpha)) / k2;
+                if (coefficient < 1e-12 / volume) continue;
+                // The same term comes from every combination of +/- k
+                coefficient *= (i > 0 ? 2 : 1) * (j > 0 ? 2 : 1) * (l > 0 ? 2 : 1);
+                _kx.push_back(i);
+                _ky.push_back(j);
+                _kz.push_back(l);
+                _kCoefficient.push_back(coefficient);
+            }
+        }
+    }
+
+    // On the grid, the cosines in the reciprocal sum only need working 
+    //   out once along each axis
+    unsigned int m = _n + 1;
+    vector <vector <double> > cosines[3];
+    for (int d = 0; d < 3; d++) {
+        cosines[d].assign(kMax[d] + 1, vector <double> (m));
+        for (unsigned int k = 0; k <= kMax[d]; k++)
+            for (unsigned int i = 0; i < m; i++)
+                cosines[d][k][i] = cos(2.0 * pi * k * i * _h[d] / _L[d]);
+    }
+    _smooth.resize(m * m * m);
+    for (unsigned int i = 0; i < m; i++) {
+        for (unsigned int j = 0; j < m; j++) {
+            for (unsigned int l = 0; l < m; l++) {
+                double smooth = _background + RealSpace(i * _h[0], j * _h[1], l * _h[2]);
+                for (unsigned int k = 0; k < _kCoefficient.size(); k++)
+                    smooth += _kCoefficient[k] * cosines[0][_kx[k]][i] * cosines[1][_ky[k]][j] * cosines[2][_kz[k]][l];
+                _smooth[(i * m + j) * m + l] = smooth;
+            }
+        }
+    }
+
+    cout << "Tabulated Ewald sum over " << m << "^3 points (" << _kCoefficient.size() 
+         << " reciprocal lattice vectors)\n";
+}
+
+/*******************
+ * GET'S
+ *******************/
+// The real space part of 'Smooth'
+double ewald::RealSpace(double x, double y, double z) const {
+    double smooth = 0.0;
+    for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+            for (int l = -1; l <= 1; l++) {
+                double X = x + i * _L[0];
+                double Y = y + j * _L[1];
+                double Z = z + l * _L[2];
+                double r = sqrt(X * X + Y * Y + Z * Z);
+                if (i == 0 && j == 0 && l == 0) {
+                    // erfc(alpha r) / r - 1 / r
+                    if (r < 1e-10) smooth -= 2.0 * _alpha / sqrt(pi);
+                    else smooth -= erf(_alpha * r) / r;
+                }
+                else smooth += erfc(_alpha * r) / r;
+            }
+        }
+    }
+    return smooth;
+}
+// The potential due to a charge and its images (and the background), 
+//   minus the 1/r of the charge itself, at (x,y,z) from the charge.  
+//   (x,y,z) must be the minimum image.
+double ewald::Smooth(double x, double y, double z) const {
+    double smooth = _background + RealSpace(x, y, z);
+    for (unsigned int k = 0; k < _kCoefficient.size(); k++) {
+        smooth += _kCoefficient[k] * cos(2.0 * pi * _kx[k] * x / _L[0]) 
+                                   * cos(2.0 * pi * _ky[k] * y / _L[1]) 
+                                   * cos(2.0 * pi * _kz[k] * z / _L[2]);
+    }
+    return smooth;
+}
+// The potential at (dx,dy,dz) from a charge, in Ang^-1 (multiply by 
+//   graph::_coulombPrefactor to get eV).
+double ewald::GetPotential(double dx, double dy, double dz) const {
+    dx = Wrap(dx, 0);
+    dy = Wrap(dy, 1);
+    dz = Wrap(dz, 2);
+    double r = sqrt(dx * dx + dy * dy + dz * dz);
+    // The potential is even in x, y and z, so only the positive octant is stored
+    double s[3] = {fabs(dx) / _h[0], fabs(dy) / _h[1], fabs(dz) / _h[2]};
+    unsigned int c[3];
+    double f[3];
+    for (int d = 0; d < 3; d++) {
+        c[d] = (unsigned int) s[d];
+        if (c[d] >= _n) c[d] = _n - 1;
+        f[d] = s[d] - c[d];
+    }
+    unsigned int m = _n + 1;
+    const double * p = &_smooth[(c[0] * m + c[1]) * m + c[2]];
+    // Trilinear interpolation
+    double c00 = p[0]         * (1.0 - f[2]) + p[1]             * f[2];
+    double c01 = p[m]         * (1.0 - f[2]) + p[m + 1]         * f[2];
+    double c10 = p[m * m]     * (1.0 - f[2]) + p[m * m + 1]     * f[2];
+    double c11 = p[m * m + m] * (1.0 - f[2]) + p[m * m + m + 1] * f[2];
+    double c0 = c00 * (1.0 - f[1]) + c01 * f[1];
+    double c1 = c10 * (1.0 - f[1]) + c11 * f[1];
+    double smooth = c0 * (1.0 - f[0]) + c1 * f[0];
+    return 1.0 / r + smooth;
+}
+// Compare the interpolated potential with the Ewald sum in the middle of
+//   every 'stride'th grid cell, where interpolation is least accurate.  
+//   Return the largest difference (Ang^-1).
+double ewald::CheckAccuracy(unsigned int stride) const {
+    double maxError = 0.0;
+    if (stride < 1) stride = 1;
+    for (unsigned int i = 0; i < _n; i += stride) {
+        for (unsigned int j = 0; j < _n; j += stride) {
+            for (unsigned int l = 0; l < _n; l += stride) {
+                double x = (i + 0.5) * _h[0];
+                double y = (j + 0.5) * _h[1];
+                double z = (l + 0.5) * _h[2];
+                double r = sqrt(x * x + y * y + z * z);
+                double error = fabs(GetPotential(x, y, z) - (1.0 / r + Smooth(x, y, z)));
+                if (error > maxError) maxError = error;
+            }
+        }
+    }
+    return maxError;
+}
@@ -0,0 +1,73 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'ewald' gives the Coulomb potential between two charges in a 
+ * periodic box, including all their periodic images (against a 
+ * uniform neutralising background), from the Ewald sum.  The Ewald 
+ * sum is much too slow to do every time two hoppers interact, so it 
+ * is done once, on a grid covering all separations, and interpolated.
+ * Only the smooth part of the potential (everything except the 1/r 
+ * of the nearest image) is interpolated, so that hoppers close to 
+ * each other still feel the exact 1/r.
+ ********************************************************************/
+#ifndef _EWALD_H
+#define	_EWALD_H
+#include "global.h"
+
+using namespace std;
+
+class ewald{
+    private:
+        double _L[3];  // size of the periodic box (Ang)
+        unsigned int _n;  // number of grid intervals across half the box
+        double _h[3];  // grid spacing (Ang)
+        double _alpha;  // splits the sum between real and reciprocal space (Ang^-1)
+        double _background;  // from the neutralising background
+        vector <double> _smooth;  // potential minus 1/r, over a (_n+1)^3 grid of 0 <= x,y,z <= L/2
+        // Reciprocal lattice vectors (k>=0 only, since the potential is even in x, y and z)
+        vector <unsigned int> _kx, _ky, _kz;
+        vector <double> _kCoefficient;
+
+        double Smooth(double x, double y, double z) const;  // directly from the Ewald sum
+        double RealSpace(double x, double y, double z) const;
+        double Wrap(double x, int d) const {return x - _L[d] * floor(x / _L[d] + 0.5);}
+    // end of private:
+
+    public:
+        ewald(){
+            _n=0;
+            _alpha=0.0;
+            _background=0.0;
+        }
+        ~ewald(){
+            _smooth.clear();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Setup(const double & sizeX, const double & sizeY, const double & sizeZ, unsigned int n);
+
+        /***********************************
+        * GET'S
+        ************************************/
+        double GetPotential(double dx, double dy, double dz) const;  // Ang^-1
+        double CheckAccuracy(unsigned int stride) const;
+    // end of public:
+};
+#endif	/* _EWALD_H */
@@ -1,13 +1,22 @@
 #include "global.h"
 
-#ifndef RandomB
-gsl_rng * gslRand;
-#endif
-
 bool VERBOSITY_HIGH = false;
 int WARNINGS = 0;
 bool RECEIVED_TERM_SIGNAL = false;
 
+#ifdef countAllocations
+std::atomic<unsigned long> ALLOCATIONS(0);
+thread_local bool COUNT_ALLOCATIONS = true;
+void * operator new(size_t bytes) {
+    if (COUNT_ALLOCATIONS) ALLOCATIONS++;
+    void * memory = malloc(bytes ? bytes : 1);
+    if (!memory) throw std::bad_alloc();
+    return memory;
+}
+void operator delete(void * memory) noexcept {free(memory);}
+void operator delete(void * memory, size_t) noexcept {free(memory);}
+#endif
+
 void ERROR(int code, std::string msg) {
     std::cout << "!!! ERROR !!!: " << msg << std::endl;
     exit(code);
@@ -27,14 +27,10 @@
 #include <list>
 #include <string>
 #include <tuple>
+#include <functional>
 #include <cstring>
 #include <cmath>
-#include "RandomB.h"
-#ifndef RandomB
-#include "gsl/gsl_rng.h"
-#include "gsl/gsl_randist.h"
-extern gsl_rng * gslRand;
-#endif
+#include "randomstream.h"
 
 // Clean exit on timeout or program kill
 #include <mutex>
@@ -51,7 +47,16 @@ const double pi      = 3.14159265;
 const double e       = 1.60217646e-19;
 extern bool VERBOSITY_HIGH;
 extern int WARNINGS;
-//#define printTotalOccupation
+
+// Compile with -DcountAllocations to count every heap allocation, so 
+//   kmc can check that runs after the first don't make any.  Allocations
+//   aren't counted in a thread while its 'COUNT_ALLOCATIONS' is false 
+//   (when writing checkpoints).
+#ifdef countAllocations
+#include <atomic>
+extern std::atomic<unsigned long> ALLOCATIONS;
+extern thread_local bool COUNT_ALLOCATIONS;
+#endif
 
 // Print an error message and exit program.
 void ERROR(int code, std::string msg);
@@ -15,6 +15,8 @@
 //  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
 ///////////////////////////////////////////////////////////////////////
 #include "graph.h"
+#include "ratekernels.h"
+#include <limits.h>
 
 // 1D minimum image distance
 // Calculates shortest distance between two points, taking into account periodic boundaries at [0,size]
@@ -34,80 +36,463 @@ double min_img_dist(double s1, double s2, double size) {
  * SET-UP GRAPH
  * Read in from ***.xyz and ***.edge files and generate graph
  ************************************************************/
-// Read from ***.xyz
-void graph::ReadVertices(char * filename, vector <vertex *> &vertices, bool readEnergies=false) {
-    ifstream in;
-    open(filename, in);
-    string word;
-    double x, y, z, E;
-    string type;
-    int counter=0;
+// See graph.h
+graph::graph(const graph & master) : _vertices(master._vertices), _reorgs(master._reorgs) {
+    _Vg = master._Vg;
+    _fieldZ = master._fieldZ;
+    _temp = master._temp;
+    _sizeX = master._sizeX;
+    _sizeY = master._sizeY;
+    _sizeZ = master._sizeZ;
+    _applyPBs = master._applyPBs;
+    _hopperInteractions = master._hopperInteractions;
+    _occupationRates = master._occupationRates;
+    _kT = master._kT;
+    _millerAbrahams = master._millerAbrahams;
+    _keepOccupations = master._keepOccupations;
+    _sourceFermiEnergy = master._sourceFermiEnergy;
+    _drainFermiEnergy = master._drainFermiEnergy;
+    _coulombPrefactor = master._coulombPrefactor;
+    _readSiteEnergies = master._readSiteEnergies;
+    _generatorIDs = master._generatorIDs;
+    _generatorIndex = master._generatorIndex;
+    _emptyGenerators = master._emptyGenerators;
+    _neighbourOccupied = master._edges._occupied;
+    for (unsigned int v = 0; v < _vertices.size(); v++)
+        _vertices[v].SetOccupiedMask(_neighbourOccupied.data());
+}
+// Everything needed before the vertices and edges are read
+void graph::ReadParameters(const simParameters & sim) {
+    if (sim.Get("mode") != "fet") 
+        _fieldZ = sim.GetNumber("fieldZ"); 
+    else {
+        _fieldZ = 1e50;
+        _Vg = sim.GetNumber("Vg"); 
+        double Vds = sim.GetNumber("Vds");
+        _sourceFermiEnergy = _Vg;
+        _drainFermiEnergy  = _Vg + Vds;
+        cout << "Source Fermi energy = " << _sourceFermiEnergy
+             << ", drain Fermi energy = " << _drainFermiEnergy << endl;
+    }
 
-    for (string line; getline(in, line); ) {
-        istringstream iss(line);
-        iss >> word; x=atof(word.c_str());
-        iss >> word; y=atof(word.c_str());
-        iss >> word; z=atof(word.c_str());
-        iss >> word; type=word;
-        if (readEnergies) { iss >> word; E = atof(word.c_str()); }
+    _reorgs = sim.GetNumbers("reorg");
+    _temp = sim.GetNumber("temp");
+    _kT = _temp*k_eVK;
 
-        if (!iss) break;
+    _applyPBs = (sim.Get("mode") == "pb");
+    _hopperInteractions = sim.GetFlag("hopperInteractions");
 
-        vertex * newVertex = new vertex;
-        vec pos(x,y,z);
-        newVertex->SetPos(pos);
-        newVertex->SetType(type);
-        newVertex->SetID(counter);
-        if (readEnergies) newVertex->SetE(E);
+    if (_applyPBs) {
+        if (_hopperInteractions) {
+            cout << "Read simulation volume sizeX, sizeY, sizeZ ...\n";
+            _sizeX = sim.GetNumber("sizeX");
+            _sizeY = sim.GetNumber("sizeY");
+            _sizeZ = sim.GetNumber("sizeZ");
+        } 
+        else {
+            cout << "Read simulation volume sizeZ ...\n";
+            _sizeZ = sim.GetNumber("sizeZ");
+        }
+    }
 
-        vertices.push_back(newVertex);
-        counter++;
+    // If in FET mode or _hopperInteractions enabled, attempt to read site energies from .xyz, even if siteEnergies option is missing from .sim 
+    _readSiteEnergies = (sim.GetFlag("siteEnergies") || sim.Get("mode") == "fet" || _hopperInteractions);
+    if (VERBOSITY_HIGH) {
+        if (_readSiteEnergies) cout << "Reading E's from ***.xyz\n";
+        else cout << "Reading delta E's from ***.edge\n";
+    }
+}
+// Read input files, grabbing site energies from .xyz, or delta Es from .edge, as requested.
+// If reading site energies, calculate delta Es here as well.
+// If more than one reorg energy was provided, also read enumerated edge types.
+void graph::ReadGraph(char * xyz, char * edge) {
+    if (IsBinary(xyz)) ReadBinary(xyz);
+    else {
+        ReadVertices(xyz, _vertices, _readSiteEnergies);
+        ReadEdges(edge, _vertices, !_readSiteEnergies, (_reorgs.size() > 1) );
+    }
+    cout << "Graph uses " << (_vertices.capacity() * sizeof(vertex) + _edges.GetBytes()) / 1048576.0 
+         << " MB for " << _vertices.size() << " vertices and " << _edges.Size() << " edges\n";
+}
+// Everything that depends on the field, temperature and hopping model, 
+//   once the vertices and edges have been read
+void graph::SetEnergetics(const simParameters & sim) {
+    ModifyDEsUsingField();
+    _millerAbrahams = (sim.Get("hopRate") == "milabe");
+    _keepOccupations = (sim.GetFlag("printOccupation") || sim.GetFlag("printEnergies") || sim.GetFlag("track"));
+
+    _occupationRates = (_hopperInteractions || sim.Get("mode") == "fet");
+    if (_occupationRates) {
+        
+        // doesn't set the field!
+        if (_millerAbrahams)
+            SetRatesPrefactor_CMA();
+        else
+            SetRatesPrefactor_C();
+
+        // The Coulomb prefactor in eV.Ang/e^2:
+        _coulombPrefactor = 14.3996442 / sim.GetNumber("dielectric");
+        // The following should be uncommented if you want to use a look-up 
+        // table for the Coulombic interactions.  See also 'GetSingleCoulomb'
+        // in hoppers.cc
+        // MakeCoulombEnergyGrid(); 
+    }
+    else {
+        if (_millerAbrahams)
+            SetRates_MA();
+        else
+            SetRates_DE();
+        // Rates are now fixed, so the alias tables only need building once
+        BuildAliasTables();
+    }
+    IndexGenerators(sim.Get("mode") != "fet");
+    if (sim.GetFlag("printVertices")) PrintVertices(_readSiteEnergies);
+    if (sim.GetFlag("printEdges")) PrintEdges();
+}
+// Index the generators that hoppers can be generated on.  A hopper on a 
+//   generator without neighbours could never move, so they're left out 
+//   (with a warning, unless 'warn' is false: FETs don't generate hoppers 
+//   this way).
+void graph::IndexGenerators(bool warn) {
+    _generatorIDs.clear();
+    _generatorIndex.assign(_vertices.size(), -1);
+    unsigned int pruned = 0;
+    for (unsigned int v = 0; v < _vertices.size(); v++) {
+        if (!_vertices[v].IsGenerator()) continue;
+        if (_vertices[v].GetNumberNeighbours() == 0) {
+            pruned++;
+            continue;
+        }
+        _generatorIndex[v] = _generatorIDs.size();
+        _generatorIDs.push_back(v);
+    }
+    _emptyGenerators.Resize(_generatorIDs.size());
+    for (unsigned int g = 0; g < _generatorIDs.size(); g++) {
+        if (!_vertices[_generatorIDs[g]].IsOccupied()) _emptyGenerators.Set(g, 1.0);
+    }
+    if (warn && pruned > 0) {
+        cout << "!!! WARNING !!! : " << pruned << " generators have no neighbours, so no hoppers will be generated on them\n";
+        WARNINGS++;
+    }
+}
+// Read from ***.xyz.  The file is read in pieces of whole lines, on as 
+//   many threads as there are processors, which give the same vertices 
+//   as reading it line by line: every line with all its words is a vertex,
+//   and reading stops at the first line without.
+void graph::ReadVertices(char * filename, vector <vertex> &vertices, bool readEnergies=false) {
+    struct piece {
+        vector <double> x, y, z, E;
+        vector <const char *> types, typeEnds;
+        bool stopped = false;  // at a line without all its words?
+    };
+    mappedFile file(filename);
+    const char * end = file.data + file.size;
+    vector <const char *> starts = SplitLines(file.data, file.size, ReadThreads(file.size));
+    vector <piece> pieces(starts.size() - 1);
+
+    auto ReadPiece = [&](unsigned int k) {
+        piece & P = pieces[k];
+        const char * word, * wordEnd;
+        for (const char * line = starts[k]; line < starts[k + 1]; line = NextLine(line, end)) {
+            const char * p = line;
+            double x, y, z, E = 0.0;
+            const char * type, * typeEnd;
+            if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+            x = ParseDouble(word, wordEnd);
+            if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+            y = ParseDouble(word, wordEnd);
+            if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+            z = ParseDouble(word, wordEnd);
+            if (!(type = NextWord(p, end, typeEnd))) {P.stopped = true; return;}
+            if (readEnergies) {
+                if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+                E = ParseDouble(word, wordEnd);
+            }
+            P.x.push_back(x);  P.y.push_back(y);  P.z.push_back(z);
+            P.types.push_back(type);  P.typeEnds.push_back(typeEnd);
+            if (readEnergies) P.E.push_back(E);
+        }
+    };
+    ReadPieces(pieces.size(), ReadPiece);
+
+    int counter=0;
+    for (unsigned int k = 0; k < pieces.size(); k++) {
+        piece & P = pieces[k];
+        for (unsigned int i = 0; i < P.x.size(); i++) {
+            vertex newVertex;
+            vec pos(P.x[i], P.y[i], P.z[i]);
+            newVertex.SetPos(pos);
+            newVertex.SetType(string(P.types[i], P.typeEnds[i]));
+            newVertex.SetID(counter);
+            if (readEnergies) newVertex.SetE(P.E[i]);
+
+            vertices.push_back(newVertex);
+            counter++;
+        }
+        if (P.stopped) break;
     }
     cout << "Read in " << counter << " vertices from " << filename << "\n";
-    in.close();
 }
-// Read from ***.edge
-void graph::ReadEdges(char *filename, vector <vertex *> &vertices, bool readDeltaEnergies, bool readEdgeType) {
+// Read from ***.edge, and store the edges in '_edges'.  As ReadVertices, 
+//   the file is read in pieces on many threads, but any error is reported
+//   as if it had been read line by line.
+void graph::ReadEdges(char *filename, vector <vertex> &vertices, bool readDeltaEnergies, bool readEdgeType) {
     if (vertices.size() < 1)
         ERROR(-1, "You are trying to initialise edges before vertices");
+    if (_reorgs.size() > 256)
+        ERROR(-1, "Can't use more than 256 reorganisation energies");
+    _edges._reorgs = _reorgs;
+
+    struct piece {
+        vector <unsigned int> v1s, v2s, ms;
+        vector <double> Js, DEs, DZs;
+        bool stopped = false;  // at a line without all its words?
+        string error;  // ... or at an error
+    };
+    mappedFile file(filename);
+    const char * end = file.data + file.size;
+    vector <const char *> starts = SplitLines(file.data, file.size, ReadThreads(file.size));
+    vector <piece> pieces(starts.size() - 1);
+    unsigned int nVertices = vertices.size();
+
+    auto ReadPiece = [&](unsigned int k) {
+        piece & P = pieces[k];
+        const char * word, * wordEnd;
+        for (const char * line = starts[k]; line < starts[k + 1]; line = NextLine(line, end)) {
+            const char * p = line;
+            unsigned int v1, v2;
+            double J, DE = 0.0, DZ;
+            size_t m = 0;
+            if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+            v1 = ParseInt(word, wordEnd);
+            if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+            v2 = ParseInt(word, wordEnd);
+            if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+            J = ParseDouble(word, wordEnd);
+            if (readDeltaEnergies) {
+                if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+                DE = ParseDouble(word, wordEnd);
+            }
+            if (readEdgeType) {
+                if (!(word = NextWord(p, end, wordEnd))) {P.stopped = true; return;}
+                m = ParseInt(word, wordEnd);
+            }
+            if (m > _reorgs.size() - 1) {
+                P.error = "Trying to set an enumerated edge type (" + to_string(m) + ") which indexes outside the number of reorganisation energy values provided (" + to_string(_reorgs.size()) + ").";
+                return;
+            }
+            if (v1 >= nVertices || v2 >= nVertices || v1 == v2) {
+                P.error = "Trying to create an edge on non-existent vertex " + to_string(v1) + "->" + to_string(v2);
+                return;
+            }
+            if (!readDeltaEnergies) DE = vertices[v2].GetE() - vertices[v1].GetE();
+            if (_applyPBs) DZ = min_img_dist(vertices[v1].GetZ(), vertices[v2].GetZ(), _sizeZ);
+            else DZ = vertices[v2].GetZ() - vertices[v1].GetZ();
 
-    ifstream in;
-    open(filename, in);
-    string word;
-    unsigned int v1, v2;
-    double J, DE, DZ;
-    size_t m=0;
-    int counter=0;
-
-    for (string line; getline(in, line); ) {
-        istringstream iss(line);
-        iss >> word; v1 = atoi(word.c_str());
-        iss >> word; v2 = atoi(word.c_str());
-        iss >> word; J = atof(word.c_str());
-
-        if (readDeltaEnergies) { iss >> word; DE=atof(word.c_str()); }
-        else DE = vertices[v2]->GetE() - vertices[v1]->GetE();
-        
-        if (readEdgeType) { iss >> word; m = atoi(word.c_str()); }
-        if (m > _reorgs.size() - 1)
-            ERROR(-1, "Trying to set an enumerated edge type (" + to_string(m) + ") which indexes outside the number of reorganisation energy values provided (" + to_string(_reorgs.size()) + ").");
-
-        if (_applyPBs) DZ = min_img_dist(vertices[v1]->GetZ(), vertices[v2]->GetZ(), _sizeZ);
-        else DZ = vertices[v2]->GetZ() - vertices[v1]->GetZ();
+            P.v1s.push_back(v1);  P.v2s.push_back(v2);  P.ms.push_back(m);
+            P.Js.push_back(J);  P.DEs.push_back(DE);  P.DZs.push_back(DZ);
+        }
+    };
+    ReadPieces(pieces.size(), ReadPiece);
 
-        if (!iss) break;
+    size_t total = 0;
+    for (unsigned int k = 0; k < pieces.size(); k++) total += pieces[k].v1s.size();
+    _edges.Reserve(total);
+    int counter=0;
+    for (unsigned int k = 0; k < pieces.size(); k++) {
+        piece & P = pieces[k];
+        // The reorg energy is picked from '_reorgs' using the enumerated edge type.
+        for (unsigned int i = 0; i < P.v1s.size(); i++) 
+            _edges.Add(P.v1s[i], P.v2s[i], P.Js[i], P.DEs[i], P.DZs[i], P.ms[i]);
+        counter += P.v1s.size();
+        if (!P.error.empty()) ERROR(-1, P.error);
+        if (P.stopped) break;
+        // Free each piece as soon as it's been added
+        P = piece();
+    }
+    _edges.Build(vertices);
+    cout << "Read in " << counter << " edges from " << filename << "\n";
+}
+// Threads to read a file of 'bytes' with: at least 1MB each
+unsigned int graph::ReadThreads(size_t bytes) {
+    unsigned int threads = max(1u, thread::hardware_concurrency());
+    return (unsigned int) min((size_t) threads, bytes / 1048576 + 1);
+}
+// Read pieces 0 to n-1, each on its own thread
+void graph::ReadPieces(unsigned int n, const function <void(unsigned int)> & ReadPiece) {
+    if (n == 1) {
+        ReadPiece(0);
+        return;
+    }
+    vector <thread> threads;
+    for (unsigned int k = 0; k < n; k++) threads.push_back(thread(ReadPiece, k));
+    for (unsigned int k = 0; k < n; k++) threads[k].join();
+}
 
-        if (v1 >= vertices.size() || v2 >= vertices.size() || v1 == v2)
-            ERROR(-1, "Trying to create an edge on non-existent vertex " + to_string(v1) + "->" + to_string(v2));
+/***************************************************************
+ * BINARY GRAPHS
+ * 'tft convert' reads ***.xyz and ***.edge once, checks them, and 
+ * writes the vertices and the CSR arrays of the edges (see edges.h)
+ * as they are in memory.  Later runs just copy them back from a 
+ * memory map, with nothing to parse, sort or check.
+ * The layout is: a 'binaryHeader', then (each padded to 8 bytes)
+ *   x, y, z of each vertex      double[3 * vertices]
+ *   type of each vertex         char[vertices]
+ *   E of each vertex            double[vertices]   (siteEnergies only)
+ *   _first                      uint32[vertices + 1]
+ *   _to, _reverse               uint32[edges] each
+ *   _reorgenums                 uint8[edges]       (edgeTypes only)
+ *   _Js, _DEs (without field)   double[edges] each
+ * in the byte order of the machine that wrote it.
+ **************************************************************/
+static const char BINARY_MAGIC[8] = {'T', 'o', 'F', 'e', 'T', 'g', 'r', '\n'};
+static const uint32_t BINARY_VERSION = 1;
+struct binaryHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t siteEnergies;  // were E's read from the .xyz (rather than DE's from the .edge)?
+    uint32_t edgeTypes;  // were enumerated edge types read?
+    uint32_t spare;
+    uint64_t vertices;
+    uint64_t edges;  // counting each direction
+};
+static size_t Padded(size_t bytes) {return (bytes + 7) & ~(size_t)7;}
+//
+bool graph::IsBinary(char * filename) {
+    char magic[8];
+    FILE * in = fopen(filename, "rb");
+    if (!in) return false;
+    bool binary = (fread(magic, 1, 8, in) == 8 && memcmp(magic, BINARY_MAGIC, 8) == 0);
+    fclose(in);
+    return binary;
+}
+//
+void graph::WriteBinary(char * filename) {
+    FILE * out = fopen(filename, "wb");
+    if (!out) ERROR(-1, string("Can't write to ") + filename);
+    unsigned int n = _vertices.size();
+    binaryHeader header;
+    memcpy(header.magic, BINARY_MAGIC, 8);
+    header.version = BINARY_VERSION;
+    header.siteEnergies = _readSiteEnergies;
+    header.edgeTypes = (_reorgs.size() > 1);
+    header.spare = 0;
+    header.vertices = n;
+    header.edges = _edges.Size();
+
+    vector <double> pos(3 * n), E;
+    vector <char> types(n);
+    for (unsigned int v = 0; v < n; v++) {
+        pos[3*v] = _vertices[v].GetX();
+        pos[3*v+1] = _vertices[v].GetY();
+        pos[3*v+2] = _vertices[v].GetZ();
+        types[v] = _vertices[v].GetType();
+        if (_readSiteEnergies) E.push_back(_vertices[v].GetE());
+    }
+    // Write 'bytes' from 'data', padded to 8 bytes
+    static const char zeros[8] = {0};
+    bool ok = true;
+    auto Write = [&](const void * data, size_t bytes) {
+        ok = ok && fwrite(data, 1, bytes, out) == bytes;
+        ok = ok && fwrite(zeros, 1, Padded(bytes) - bytes, out) == Padded(bytes) - bytes;
+    };
+    Write(&header, sizeof(header));
+    Write(pos.data(), pos.size() * sizeof(double));
+    Write(types.data(), n);
+    if (header.siteEnergies) Write(E.data(), n * sizeof(double));
+    Write(_edges._first.data(), (n + 1) * sizeof(unsigned int));
+    Write(_edges._to.data(), _edges.Size() * sizeof(unsigned int));
+    Write(_edges._reverse.data(), _edges.Size() * sizeof(unsigned int));
+    if (header.edgeTypes) Write(_edges._reorgenums.data(), _edges.Size());
+    Write(_edges._Js.data(), _edges.Size() * sizeof(double));
+    Write(_edges._DEs.data(), _edges.Size() * sizeof(double));
+    if (fclose(out) != 0 || !ok) ERROR(-1, string("Couldn't write all of ") + filename);
+    cout << "Wrote " << n << " vertices and " << _edges.Size() << " edges to " << filename << endl;
+}
+//
+void graph::ReadBinary(char * filename) {
+    if (_reorgs.size() > 256)
+        ERROR(-1, "Can't use more than 256 reorganisation energies");
+    _edges._reorgs = _reorgs;
+
+    mappedFile file(filename);
+    const char * next = file.data, * end = next + file.size;
+    // The next 'bytes' of the file (padded to 8 bytes)
+    auto Next = [&](size_t bytes) {
+        const char * data = next;
+        if (Padded(bytes) > (size_t)(end - next)) ERROR(-1, string(filename) + " is truncated");
+        next += Padded(bytes);
+        return data;
+    };
+
+    binaryHeader header;
+    memcpy(&header, Next(sizeof(header)), sizeof(header));
+    if (header.version != BINARY_VERSION)
+        ERROR(-1, string(filename) + " is version " + to_string(header.version) + " of the binary graph format; expected " 
+                  + to_string(BINARY_VERSION) + ".  Convert it again with 'tft convert'");
+    if (header.siteEnergies != (uint32_t)_readSiteEnergies)
+        ERROR(-1, string(filename) + " was converted " + (header.siteEnergies ? "with" : "without") 
+                  + " site energies, but this simulation reads them " + (_readSiteEnergies ? "from the .xyz" : "from the .edge")
+                  + ".  Convert it again with this .sim");
+    if (_reorgs.size() > 1 && !header.edgeTypes)
+        ERROR(-1, string(filename) + " was converted without enumerated edge types, but this simulation has more than one reorganisation energy"
+                  + ".  Convert it again with this .sim");
+    if (header.vertices >= UINT_MAX || header.edges > UINT_MAX) 
+        ERROR(-1, string(filename) + " is corrupted (or has more vertices or edges than can be indexed)");
+    unsigned int n = header.vertices, nEdges = header.edges;
+
+    const double * pos = (const double *) Next(3 * (size_t) n * sizeof(double));
+    const char * types = Next(n);
+    const double * E = header.siteEnergies ? (const double *) Next(n * sizeof(double)) : NULL;
+    _vertices.resize(n);
+    for (unsigned int v = 0; v < n; v++) {
+        _vertices[v].SetPos(vec(pos[3*v], pos[3*v+1], pos[3*v+2]));
+        _vertices[v].SetType(string(1, types[v]));
+        _vertices[v].SetID(v);
+        if (E) _vertices[v].SetE(E[v]);
+    }
 
-        // Pick reorg energy from vector using enumerated edge type.
-        vertices[v1] -> AddNeighbour(vertices[v2],J, DE, DZ, _reorgs[m],m);
-        vertices[v2] -> AddNeighbour(vertices[v1],J,-DE, -DZ, _reorgs[m],m);
-        
-        counter++;
+    const unsigned int * first = (const unsigned int *) Next((n + 1) * sizeof(unsigned int));
+    const unsigned int * to = (const unsigned int *) Next(nEdges * sizeof(unsigned int));
+    const unsigned int * reverse = (const unsigned int *) Next(nEdges * sizeof(unsigned int));
+    _edges._first.assign(first, first + n + 1);
+    _edges._to.assign(to, to + nEdges);
+    _edges._reverse.assign(reverse, reverse + nEdges);
+    if (header.edgeTypes) {
+        const unsigned char * reorgenums = (const unsigned char *) Next(nEdges);
+        if (_reorgs.size() > 1) _edges._reorgenums.assign(reorgenums, reorgenums + nEdges);
+        else _edges._reorgenums.assign(nEdges, 0);
     }
-    in.close();
-    cout << "Read in " << counter << " edges from " << filename << "\n";
+    else _edges._reorgenums.assign(nEdges, 0);
+    const double * Js = (const double *) Next(nEdges * sizeof(double));
+    const double * DEs = (const double *) Next(nEdges * sizeof(double));
+    _edges._Js.assign(Js, Js + nEdges);
+    _edges._DEs.assign(DEs, DEs + nEdges);
+
+    // Check the indices, since vertex::SetOccupied writes through them.
+    //   Each edge's '_reverse' is its position in the neighbour's list, 
+    //   where the edge must lead back to this vertex, and to this edge.
+    if (_edges._first[0] != 0 || _edges._first[n] != nEdges) ERROR(-1, string(filename) + " is corrupted");
+    for (unsigned int v = 0; v < n; v++)
+        if (_edges._first[v + 1] < _edges._first[v]) ERROR(-1, string(filename) + " is corrupted");
+    // DZ depends on the periodic boundaries of this simulation, so isn't stored
+    _edges._DZs.resize(nEdges);
+    for (unsigned int v = 0; v < n; v++) {
+        for (unsigned int i = _edges._first[v]; i < _edges._first[v + 1]; i++) {
+            unsigned int w = _edges._to[i];
+            if (w >= n || w == v) ERROR(-1, string(filename) + " is corrupted");
+            unsigned int r = _edges._reverse[i];
+            if (r >= _edges._first[w + 1] - _edges._first[w] || _edges._to[_edges._first[w] + r] != v
+                || _edges._reverse[_edges._first[w] + r] != i - _edges._first[v])
+                ERROR(-1, string(filename) + " is corrupted");
+            if (_edges._reorgenums[i] > _reorgs.size() - 1)
+                ERROR(-1, "Trying to set an enumerated edge type (" + to_string(_edges._reorgenums[i]) + ") which indexes outside the number of reorganisation energy values provided (" + to_string(_reorgs.size()) + ").");
+            if (_applyPBs) _edges._DZs[i] = min_img_dist(_vertices[v].GetZ(), _vertices[w].GetZ(), _sizeZ);
+            else _edges._DZs[i] = _vertices[w].GetZ() - _vertices[v].GetZ();
+        }
+    }
+    _edges.Link(_vertices);
+    cout << "Read in " << n << " vertices and " << nEdges << " edges from " << filename << "\n";
 }
 
 /***************************************************************
@@ -116,19 +501,23 @@ void graph::ReadEdges(char *filename, vector <vertex *> &vertices, bool readDelt
  **************************************************************/
 // Modify DE's to reflect an applied field.
 void graph::ModifyDEsUsingField() {
-    vector <vertex *>::iterator it=_vertices.begin();
+    vector <vertex>::iterator it=_vertices.begin();
     for (; it!=_vertices.end(); it++)
-	    (*it)->ModifyDEsUsingField(_fieldZ);
+	    it->ModifyDEsUsingField(_fieldZ);
 }
 // Marcus hopping model
 // When Coulombic interactions are enabled, only pre-factor 
 //   is constant.
 void graph::SetRatesPrefactor_C() {
-    if (VERBOSITY_HIGH) cout << "Setting rates pre-factors\n";
+    if (VERBOSITY_HIGH) cout << "Setting rates pre-factors (" << GetRateKernels() << " rate kernels)\n";
+    _edges._ratesPrefactor.resize(_edges.Size());
+    _edges._ratesReorg.resize(_edges.Size());
+    _edges._ratesScale.resize(_edges.Size());
+    _edges._DCs.assign(_edges.Size(), 0.0);
 
-    vector <vertex *>::iterator it=_vertices.begin();
+    vector <vertex>::iterator it=_vertices.begin();
     for (; it!=_vertices.end(); it++)
-        (*it)->SetRatesPrefactor_C(_kT);
+        it->SetRatesPrefactor_C(_kT);
 }
 // Marcus hopping model
 // Without Coulombic interactions rates are constant
@@ -136,19 +525,22 @@ void graph::SetRatesPrefactor_C() {
 void graph::SetRates_DE() {
     if (VERBOSITY_HIGH) cout << "Setting rates using DEs\n"; 
 
-    vector <vertex *>::iterator it=_vertices.begin();
+    vector <vertex>::iterator it=_vertices.begin();
     for (; it!=_vertices.end(); it++)
-        (*it)->SetRates_DE(_kT);
+        it->SetRates_DE(_kT);
 }
 // Miller-Abrahams hopping model
 // When Coulombic interactions are enabled, only pre-factor 
 //   is constant.
 void graph::SetRatesPrefactor_CMA() {
-    if (VERBOSITY_HIGH) cout << "Setting rates pre-factors\n";
+    if (VERBOSITY_HIGH) cout << "Setting rates pre-factors (" << GetRateKernels() << " rate kernels)\n";
+    _edges._ratesPrefactor.resize(_edges.Size());
+    _edges._ratesScale.resize(_edges.Size());
+    _edges._DCs.assign(_edges.Size(), 0.0);
 
-    vector <vertex*>::iterator it = _vertices.begin();
+    vector <vertex>::iterator it = _vertices.begin();
     for (; it != _vertices.end(); it++)
-        (*it)->SetRatesPrefactor_CMA();
+        it->SetRatesPrefactor_CMA(_kT);
 }
 // Miller-Abrahams hopping model
 // Without Coulombic interactions rates are constant
@@ -156,29 +548,39 @@ void graph::SetRatesPrefactor_CMA() {
 void graph::SetRates_MA() {
     if (VERBOSITY_HIGH) cout << "Setting rates using DEs\n";
 
-    vector <vertex*>::iterator it = _vertices.begin();
+    vector <vertex>::iterator it = _vertices.begin();
     for (; it != _vertices.end(); it++)
-        (*it)->SetRates_MA(_kT);
+        it->SetRates_MA(_kT);
+}
+// Build the alias tables used by vertex::ChooseNeighbour, and report
+//   how much memory they take.
+void graph::BuildAliasTables() {
+    size_t bytes = 0;
+    vector <vertex>::iterator it = _vertices.begin();
+    for (; it != _vertices.end(); it++) {
+        it->BuildAliasTable();
+    }
+    bytes = _edges._aliasProb.capacity() * sizeof(double) + _edges._alias.capacity() * sizeof(unsigned int);
+    cout << "Built alias tables for " << _vertices.size() << " vertices, using " 
+         << bytes / 1048576.0 << " MB\n";
 }
 // Set all difference in Coulomb energies to 0.0
 void graph::ClearDCs() {
-    vector <vertex *>::iterator it=_vertices.begin();
-    for (; it!=_vertices.end(); it++)
-        (*it)->ClearDCs();
+    fill(_edges._DCs.begin(), _edges._DCs.end(), 0.0);
 }
 // Construct a lookup table for Coulombic interactions
 // See hoppers.cc for discussion of the relative merits of this approach
 void graph::MakeCoulombEnergyGrid() { 
     vector <double > tmp;
-    vector <vertex *>::iterator it_i = _vertices.begin();
+    vector <vertex>::iterator it_i = _vertices.begin();
     for (; it_i != _vertices.end(); ++it_i) {
-        vector <vertex *>::iterator it_j = _vertices.begin();
+        vector <vertex>::iterator it_j = _vertices.begin();
         tmp.clear();
         for (; it_j != _vertices.end(); ++it_j) {
-            if ((*it_i) == (*it_j))
+            if (it_i == it_j)
                 tmp.push_back(0.0);
             else
-                tmp.push_back(_coulombPrefactor/GetDistance((*it_i), (*it_j))); 
+                tmp.push_back(_coulombPrefactor/GetDistance(&(*it_i), &(*it_j))); 
         }
 	_CoulombGrid.push_back(tmp);
     }
@@ -200,37 +602,30 @@ void graph::PrintEdges() {
 
     for (unsigned int i=0; i<_vertices.size(); i++) {
         cout << i << endl;
-        vector <vertex *> Neighbours = (*_vertices.at(i)).GetNeighbours();
-        vector <vertex *>::iterator it=Neighbours.begin();
-        int neigh=0;
-        for (; it<Neighbours.end(); it++,neigh++) {
-            for (unsigned int j=0; j<_vertices.size(); j++) {
-                if (_vertices.at(j) == *it) {      // This is baroque!
-                    cout << '\t' << j << '\t';
-                    cout << _vertices.at(i)->GetDZ(neigh);
-                    cout << '\t' << _vertices.at(i)->GetJ(neigh);
-                    if (!_hopperInteractions) {  
-                        cout << '\t' << _vertices.at(i)->GetDE(neigh);
-                        cout << '\t' << (*_vertices.at(i)).GetRate(neigh);
-                    }
-                    cout << endl;
-                    break;
-                }
+        vertex & v = _vertices[i];
+        for (unsigned int neigh=0; neigh<v.GetNumberNeighbours(); neigh++) {
+            cout << '\t' << v.GetNeighbour(neigh)->GetID() << '\t';
+            cout << v.GetDZ(neigh);
+            cout << '\t' << v.GetJ(neigh);
+            if (!_hopperInteractions) {  
+                cout << '\t' << v.GetDE(neigh);
+                cout << '\t' << v.GetRate(neigh);
             }
+            cout << endl;
         }
     }
 }
 // Print vertices, including site energies if necessary.
 void graph::PrintVertices(bool printSiteEnergies){
-    vector <vertex *>::iterator it=_vertices.begin();
+    vector <vertex>::iterator it=_vertices.begin();
     for (; it!=_vertices.end(); it++) {
-        cout << (*it)->GetX() << '\t' << (*it)->GetY() << '\t' << (*it)->GetZ() << '\t';
+        cout << it->GetX() << '\t' << it->GetY() << '\t' << it->GetZ() << '\t';
         
-        if ((*it)->IsCollector()) cout << "c";
-        else if ((*it)->IsGenerator()) cout << "g";
+        if (it->IsCollector()) cout << "c";
+        else if (it->IsGenerator()) cout << "g";
         else cout << "-";
 
-        if (printSiteEnergies) cout << '\t' << (*it)->GetE();
+        if (printSiteEnergies) cout << '\t' << it->GetE();
         cout << endl;
     }
 }
@@ -239,28 +634,28 @@ void graph::PrintVertices(bool printSiteEnergies){
 void graph::PrintEnergies() {
     cout << "> ENERGY (static + Coulomb)\n"
          << "\tx (Ang)\ty (Ang)\tz (Ang)\tE (eV)\n";
-    vector <vertex *>::iterator it_outer = _vertices.begin();
+    vector <vertex>::iterator it_outer = _vertices.begin();
     for (; it_outer!=_vertices.end(); it_outer++) {
-        cout << '\t' << (*it_outer)->GetX() << '\t'
-             << (*it_outer)->GetY() << '\t' 
-             << (*it_outer)->GetZ() << '\t'
-             << (*it_outer)->GetE() + (*it_outer)->GetEC_time() << endl;
+        cout << '\t' << it_outer->GetX() << '\t'
+             << it_outer->GetY() << '\t' 
+             << it_outer->GetZ() << '\t'
+             << it_outer->GetE() + it_outer->GetEC_time() << endl;
     }
 }
 // Simply print all vertices that are occupied.
 void graph::PrintOccupied(){
     for (unsigned int i =0; i < _vertices.size(); ++i)
-        if(_vertices[i]-> IsOccupied()) cout << i << '\t' << _vertices[i] << endl;
+        if(_vertices[i].IsOccupied()) cout << i << '\t' << &_vertices[i] << endl;
 }
 //
 void graph::PrintTotalOccupationTimes() {
     cout << "> TOTAL OCCUPATION TIMES AND TIMES VISITED\n"
     << "\tx (Ang)\ty (Ang)\tz (Ang)\ttime (fraction of maxTime)\ttimes visited\n";
     for (unsigned int i =0; i < _vertices.size(); ++i){
-         cout << '\t' << _vertices[i]->GetX() << '\t'
-              << _vertices[i]->GetY() << '\t' << _vertices[i]->GetZ() << '\t'
-              << _vertices[i]->GetTotalOccupationTime() << "\t\t"   
-              << _vertices[i]->GetTimesOccupied() << endl;
+         cout << '\t' << _vertices[i].GetX() << '\t'
+              << _vertices[i].GetY() << '\t' << _vertices[i].GetZ() << '\t'
+              << _vertices[i].GetTotalOccupationTime() << "\t\t"   
+              << _vertices[i].GetTimesOccupied() << endl;
     }
 }
 
@@ -281,12 +676,23 @@ double graph::GetDistance(vertex * v1, vertex * v2) {
     }
     return sqrt(_tmpX * _tmpX + _tmpY * _tmpY + _tmpZ * _tmpZ);
 }
+// Get the longest distance between two neighbouring vertices
+double graph::GetMaxEdgeLength() {
+    double maxLength = 0.0;
+    for (unsigned int i = 0; i < _vertices.size(); i++) {
+        for (unsigned int j = 0; j < _vertices[i].GetNumberNeighbours(); j++) {
+            double length = GetDistance(&_vertices[i], _vertices[i].GetNeighbour(j));
+            if (length > maxLength) maxLength = length;
+        }
+    }
+    return maxLength;
+}
 // 
 int graph::CountTotalElectrodes() {
     int total=0;
-    vector <vertex *>::iterator it=_vertices.begin();
+    vector <vertex>::iterator it=_vertices.begin();
     for(;it!=_vertices.end(); ++it) {
-        if ( (*it)->_electrode ) total++;
+        if ( it->_electrode ) total++;
     }
     return total;
 }
@@ -308,58 +714,47 @@ vector <vertex *> graph::GetPreviouslyOccupied(char * filename) {
         if (v > _vertices.size()-1 || v < 0)
             ERROR(-1, "Don't understand vertex " + to_string(v) + " in inFile.out");
 
-        generateOnMe.push_back(_vertices.at(v));
+        generateOnMe.push_back(&_vertices.at(v));
     }
     return generateOnMe; 
 }
-// Return a vector of generators
+// Return a random empty generator, with at least 1 neighbour (otherwise 
+//   we will get an infinite waitTime until next hop).  The empty ones are 
+//   counted in order of ID, as they used to be listed.  O(log N).
 vertex * graph::GetEmptyGenerator(){
-    vector <vertex *>::iterator it_vert;
-    vector <vertex *> plausibleCandidate;
-    for (it_vert = _vertices.begin(); it_vert != _vertices.end() ; ++it_vert ){
-        if ( !((*it_vert)->IsOccupied()) && (*it_vert)->IsGenerator() )
-            plausibleCandidate.push_back(*it_vert);
-    }
-
-    // Make sure we pick a generator with at least 1 neighbour.
-    // Otherwise we will get an infinite waitTime until next hop.
-    while(plausibleCandidate.size() > 0) {
-
-        #ifdef RandomB
-        it_vert = plausibleCandidate.begin() + RandPos(plausibleCandidate.size()); //samples in range [0,n-1]
-        #else
-        it_vert = plausibleCandidate.begin() + gsl_rng_uniform_int(gslRand, plausibleCandidate.size()); //samples in range [0,n-1]
-        #endif
-        
-        // Found a suitable candidate.
-        if ((*it_vert)->GetNumberNeighbours() > 0)
-            return *it_vert;
-
-        // Not suitable, remove from contention.
-        plausibleCandidate.erase(it_vert);
-
-    }
-    ERROR(-1, "Failed to find an empty generator with at least one edge! Size of _vertices=" + to_string(_vertices.size()));
-    return 0;
+    unsigned int empty = (unsigned int) _emptyGenerators.GetTotal();  // exact: a sum of 1's
+    if (empty == 0)
+        ERROR(-1, "Failed to find an empty generator with at least one edge! Size of _vertices=" + to_string(_vertices.size()));
+    double residual;
+    unsigned int g = _emptyGenerators.Find(Random.UniformInt(empty) + 0.5, residual);  // the n'th empty one
+    return &_vertices[_generatorIDs[g]];
 }
 // Return a vector of collectors
 vector <vertex *> graph::GetCollectors() {
     vector <vertex *> collectors;
-    vector <vertex *>::iterator it = _vertices.begin();
+    vector <vertex>::iterator it = _vertices.begin();
     for (; it!=_vertices.end(); ++it) {
-        if ( (*it)->IsCollector() ) collectors.push_back(*it);
+        if ( it->IsCollector() ) collectors.push_back(&(*it));
     }
     return collectors;
 }
 // Return a vector of generators
 vector <vertex *> graph::GetGenerators() {
     vector <vertex *> generators;
-    vector <vertex *>::iterator it = _vertices.begin();
+    vector <vertex>::iterator it = _vertices.begin();
     for (; it!=_vertices.end(); ++it) {
-        if ( (*it)->IsGenerator()) generators.push_back(*it);
+        if ( it->IsGenerator()) generators.push_back(&(*it));
     }
     return generators;
 }
+// Would this graph read the vertices and edges in the same way as 'other'?  
+//   (The delta Z's of edges depend on 'sizeZ' with periodic boundaries.)
+bool graph::ReadsLike(const graph & other) const {
+    return _readSiteEnergies == other._readSiteEnergies
+        && (_reorgs.size() > 1) == (other._reorgs.size() > 1)
+        && _applyPBs == other._applyPBs
+        && (!_applyPBs || _sizeZ == other._sizeZ);
+}
 // Get the depth of the graph along the 'z' axis
 double graph::GetDepth() {
     static double depth = -1.0;
@@ -368,10 +763,10 @@ double graph::GetDepth() {
     if (depth < 0.0) {
         double zMin = 1e50;
         double zMax = -1e50;
-        vector <vertex*>::iterator it = _vertices.begin();
+        vector <vertex>::iterator it = _vertices.begin();
         for (; it != _vertices.end(); ++it) {
-            if ((*it)->GetZ() < zMin) zMin = (*it)->GetZ();
-            if ((*it)->GetZ() > zMax) zMax = (*it)->GetZ();
+            if (it->GetZ() < zMin) zMin = it->GetZ();
+            if (it->GetZ() > zMax) zMax = it->GetZ();
         }
         depth = zMax - zMin;
     }
@@ -380,7 +775,35 @@ double graph::GetDepth() {
 }
 // Wrap the same function in vertex.cc
 void graph::NormaliseOccupationTimes(double maxTime, int totalHoppers ){
-    vector <vertex *>::iterator it_all = _vertices.begin();
+    vector <vertex>::iterator it_all = _vertices.begin();
     for (; it_all!=_vertices.end(); it_all++)
-        (*it_all) -> NormaliseTotalOccupationTime( maxTime, totalHoppers );
+        it_all-> NormaliseTotalOccupationTime( maxTime, totalHoppers );
+}
+
+/*****************************
+ * CHECKPOINTS (see checkpoint.h)
+ ****************************/
+// The occupation of every vertex, and with hopperInteractions or in fet 
+//   mode, the DCs and rates that depend on it (which are not recalculated 
+//   on restart)
+void graph::SaveState(stateBuffer & state) const {
+    state.Put((uint64_t) _vertices.size());
+    state.Put((uint64_t) _edges.Size());
+    state.Put(_edges._occupied);
+    if (_occupationRates) {
+        state.Put(_edges._rates);
+        state.Put(_edges._DCs);
+    }
+    for (unsigned int v = 0; v < _vertices.size(); v++) _vertices[v].SaveState(state, _keepOccupations);
+}
+//
+void graph::RestoreState(stateBuffer & state) {
+    state.Check((uint64_t) _vertices.size(), "number of vertices");
+    state.Check((uint64_t) _edges.Size(), "number of edges");
+    state.Get(_edges._occupied);
+    if (_occupationRates) {
+        state.Get(_edges._rates);
+        state.Get(_edges._DCs);
+    }
+    for (unsigned int v = 0; v < _vertices.size(); v++) _vertices[v].RestoreState(state, _keepOccupations);
 }
@@ -25,10 +25,13 @@
 #include "vertex.h"
 #include "global.h"
 #include "IO.h"
+#include "simparameters.h"
+#include "ratetree.h"
 
 class graph{
     private:
-        vector <vertex *> _vertices;
+        vector <vertex> _vertices;  // contiguous, so never resized once the edges are built
+        edges _edges;
         double _Vg;  // V.Ang^-1 (sorry!)
         double _fieldZ;  // V.Ang^-1
         double _temp;  // K
@@ -36,97 +39,66 @@ class graph{
         bool _applyPBs;
         vector <vector <double> > _CoulombGrid;
         bool _hopperInteractions; 
+        bool _occupationRates;  // rates set from the occupation by hoppers::SetHops_C (hopperInteractions or fet)
         double _tmpX, _tmpY, _tmpZ;
+        vector <char> _neighbourOccupied;  // copies only: replaces _edges._occupied
+        bool _readSiteEnergies;  // site energies read from ***.xyz, rather than delta E's from ***.edge?
+        // Generators that hoppers may be generated on (those with neighbours), 
+        //   each with a 'rate' of 1 while it's empty, so that GetEmptyGenerator 
+        //   can pick one without looking through every vertex
+        vector <unsigned int> _generatorIDs;
+        vector <int> _generatorIndex;  // position of each vertex (by ID) in '_generatorIDs', or -1
+        rateTree _emptyGenerators;
+        void IndexGenerators(bool warn);
+        void ReadParameters(const simParameters & sim);  // everything needed to read the vertices and edges
+        void ReadGraph(char * xyz, char * edge);  // ... or, if 'xyz' is a binary graph, from that alone
+        void ReadBinary(char * filename);
+        void SetEnergetics(const simParameters & sim);  // ... and then the field, rates etc.
     // end of private:
     
     public:
         vector <double> _reorgs; // eV (A vector so that different edges may be given different lambda values - useful for polymer transport)
         double _kT;    // eV
+        bool _millerAbrahams;  // hopRate milabe, rather than Marcus
+        bool _keepOccupations;  // of every vertex ('printOccupation', 'printEnergies' or 'track': see kernel.h)
         double _sourceFermiEnergy;
         double _drainFermiEnergy;
         double _coulombPrefactor;
 
         graph(){}
 
-        graph(char * sim, char *xyz, char *edge){
-
-            if (Read(sim, "mode", "tof") != "fet") 
-                _fieldZ = atof(Read(sim, "fieldZ").c_str()); 
-            else {
-                _fieldZ = 1e50;
-                _Vg = atof(Read(sim, "Vg").c_str()); 
-                double Vds = atof(Read(sim, "Vds").c_str());
-                _sourceFermiEnergy = _Vg;
-                _drainFermiEnergy  = _Vg + Vds;
-                cout << "Source Fermi energy = " << _sourceFermiEnergy
-                     << ", drain Fermi energy = " << _drainFermiEnergy << endl;
-            }
-
-            _reorgs = ReadVector(sim, "reorg");
-            _temp = atof(Read(sim, "temp").c_str());
-            _kT = _temp*k_eVK;
-
-            _applyPBs = (Read(sim, "mode", "tof") == "pb");
-            _hopperInteractions = (Read(sim, "hopperInteractions", "0") == "1");
-
-            if (_applyPBs) {
-                if (_hopperInteractions) {
-                    cout << "Read simulation volume sizeX, sizeY, sizeZ ...\n";
-                    _sizeX = atof(Read(sim, "sizeX").c_str());
-                    _sizeY = atof(Read(sim, "sizeY").c_str());
-                    _sizeZ = atof(Read(sim, "sizeZ").c_str());
-                } 
-                else {
-                    cout << "Read simulation volume sizeZ ...\n";
-                    _sizeZ = atof(Read(sim, "sizeZ").c_str());
-                }
-            }
-
-            // If in FET mode or _hopperInteractions enabled, attempt to read site energies from .xyz, even if siteEnergies option is missing from .sim 
-            bool readSiteEnergies = (Read(sim, "siteEnergies", "0") == "1" || Read(sim, "mode", "tof") == "fet" || _hopperInteractions);
-            if (VERBOSITY_HIGH) {
-                if (readSiteEnergies) cout << "Reading E's from ***.xyz\n";
-                else cout << "Reading delta E's from ***.edge\n";
-            }
-
-            // Read input files, grabbing site energies from .xyz, or delta Es from .edge, as requested.
-            // If reading site energies, calculate delta Es here as well.
-            // If more than one reorg energy was provided, also read enumerated edge types.
-            ReadVertices(xyz, _vertices, readSiteEnergies);
-            ReadEdges(edge, _vertices, !readSiteEnergies, (_reorgs.size() > 1) );
-
-            ModifyDEsUsingField();
-
-            if (_hopperInteractions || Read(sim, "mode", "tof") == "fet") {
-                
-                // doesn't set the field!
-                if (Read(sim, "hopRate", "marcus") == "milabe")
-                    SetRatesPrefactor_CMA();
-                else
-                    SetRatesPrefactor_C();
+        graph(const simParameters & sim, char *xyz, char *edge, bool setEnergetics=true){
+            ReadParameters(sim);
+            ReadGraph(xyz, edge);
+            if (setEnergetics) SetEnergetics(sim);
+        }
 
-                // The Coulomb prefactor in eV.Ang/e^2:
-                _coulombPrefactor = 14.3996442 / atof(Read(sim, "dielectric").c_str());
-                // The following should be uncommented if you want to use a look-up 
-                // table for the Coulombic interactions.  See also 'GetSingleCoulomb'
-                // in hoppers.cc
-                // MakeCoulombEnergyGrid(); 
+        // For sweeps (see sweep.h): the same vertices and edges as 'read', 
+        //   which must have been made with 'setEnergetics' false, but the 
+        //   field, temperature, reorganisation energies and rates of 'sim'.  
+        //   If 'sim' would read them differently, they are read again.
+        graph(const simParameters & sim, const graph & read, char *xyz, char *edge){
+            ReadParameters(sim);
+            if (ReadsLike(read)) {
+                _vertices = read._vertices;
+                _edges = read._edges;
+                _edges._reorgs = _reorgs;
+                for (unsigned int v = 0; v < _vertices.size(); v++)
+                    _vertices[v].SetEdges(&_edges, _edges._first[v], _edges._first[v + 1] - _edges._first[v]);
+                cout << "Reusing the " << _vertices.size() << " vertices and " << _edges.Size() 
+                     << " edges read from " << xyz << (edge[0] ? " and " : "") << edge << endl;
             }
-            else {
-                if (Read(sim, "hopRate", "marcus") == "milabe")
-                    SetRates_MA();
-                else
-                    SetRates_DE();
-            }
-            if (Read(sim, "printVertices", "0") == "1") PrintVertices(readSiteEnergies);
-            if (Read(sim, "printEdges", "0") == "1") PrintEdges();
+            else ReadGraph(xyz, edge);
+            SetEnergetics(sim);
         }
 
-        ~graph(){
-            vector < vertex* >::iterator it = _vertices.begin();
-            for (; it!=_vertices.end(); it++)
-                delete (*it);
+        // A copy of 'master' for making runs in parallel (see kmc::FRM).  The 
+        //   copy has its own vertices, and keeps its own track of which 
+        //   neighbours are occupied, but shares the edges of 'master', so 
+        //   nothing must change the edges (rates, DCs...) once it is made.
+        graph(const graph & master);
 
+        ~graph(){
             _vertices.clear();
         }
 
@@ -139,6 +111,12 @@ class graph{
     void SetRatesPrefactor_CMA();  // set prefactors (no energies), Miller-Abrahams hopping model
     void SetRates_DE();  // set rates from deltaE's, Marcus hopping model
     void SetRates_MA();  // set rates from deltaE's, Miller-Abrahams hopping model
+    void BuildAliasTables();  // for choosing neighbours in O(1)
+    // Keep the index of empty generators up to date (called by hoppers)
+    void SetGeneratorEmpty(const vertex * v, bool empty) {
+        int g = _generatorIndex[v->GetID()];
+        if (g >= 0) _emptyGenerators.Set(g, empty ? 1.0 : 0.0);
+    }
     void NormaliseOccupationTimes(const double, int);  
     void MakeCoulombEnergyGrid();  
     double const &GetCoulomb(vertex *, vertex *);  // ... from a grid
@@ -146,24 +124,42 @@ class graph{
     /*****************************
      * PRINTS AND READS 
      ****************************/
-    void ReadEdges(char *, vector <vertex *> &, bool, bool);
-    void ReadVertices(char *, vector <vertex *> &, bool);
+    void ReadEdges(char *, vector <vertex> &, bool, bool);
+    void ReadVertices(char *, vector <vertex> &, bool);
+    static unsigned int ReadThreads(size_t);  // threads to read a text file with
+    static void ReadPieces(unsigned int, const function <void(unsigned int)> &);
+    void WriteBinary(char *);  // for 'tft convert': must be made with 'setEnergetics' false
+    static bool IsBinary(char *);  // is this a binary graph (rather than a .xyz)?
     void PrintEdges();
     void PrintVertices(bool);
     void PrintEnergies();  // print average sum of static + coulomb energies
     void PrintOccupied();  // print all occupied molecules	
     void PrintTotalOccupationTimes();
 
+    /*****************************
+     * CHECKPOINTS
+     ****************************/
+    void SaveState(stateBuffer &) const;
+    void RestoreState(stateBuffer &);
+
     /*****************************
      * GETS 
      ****************************/
     vector <vertex *> GetPreviouslyOccupied(char *);  // read occupied vertices from file
-    vertex * GetEmptyGenerator();  // returns random empty generator
+    vertex * GetEmptyGenerator();  // returns random empty generator (with neighbours)
     double GetDepth();  // get the depth of the graph in the z direction
     double GetDistance(vertex *, vertex *);  // get the distance between two vertices
     int CountTotalElectrodes();
+    unsigned int GetNumberVertices() const {return _vertices.size();}
+    vertex * GetVertex(const unsigned int & i) {return &_vertices[i];}
     const double & GetFieldZ() 	const {return _fieldZ;}
+    bool IsPeriodic() const {return _applyPBs;}
+    const double & GetSizeX() const {return _sizeX;}
+    const double & GetSizeY() const {return _sizeY;}
+    const double & GetSizeZ() const {return _sizeZ;}
+    double GetMaxEdgeLength();  // longest distance between neighbours
     vector <vertex *> GetCollectors();
+    bool ReadsLike(const graph &) const;  // would read the vertices and edges in the same way?
     vector <vertex *> GetGenerators(); 
 };
 #endif	/* _GRAPH_H */
@@ -34,21 +34,30 @@ class hopper{
         double _waitTime;  // when the hopper will hop
         double _dZ;  // how far along the 'z' axis the hopper will hop
         double _timeGenerated;  // the time at which the hopper was generated
+        int _queueIndex;  // position in hoppers::_queue (-1 if not queued)
+        int _ID;  // number of the hopper, which it keeps until it's removed (see hoppers::NewID)
      
     public:
         hopper() {
             _waitTime=0.0;
             _dZ=0.0;
             _timeGenerated = 0.0;
+            _queueIndex=-1;
+            _ID=-1;
         }
         hopper(vertex * V, const double & time) {
             _from = V;
-            _from->SetOccupied(time);
+            _from->SetOccupied();
             _timeGenerated = time;
+            _waitTime = time;  // until SetHop is called
+            _to = V;
             _along=-1;
+            _dZ=0.0;
+            _queueIndex=-1;
+            _ID=-1;
         }
         ~hopper() {
-            _from->SetUnoccupied(_waitTime);
+            _from->SetUnoccupied();
             _waitTime=2e10;
             _timeGenerated = 2e10;
         }
@@ -68,15 +77,11 @@ class hopper{
     void SetHopOccNeigh(vertex * V, const double &time) {
         Move(V);
         double totalRate=_from->CalcTotalRateToUnoccupied();  // recalculate total rate
-        #ifdef RandomB
-        _waitTime = time - log( UniformPos() ) / totalRate;
-        #else
-        _waitTime = time - log( gsl_rng_uniform_pos(gslRand) ) / totalRate;
-        #endif
+        _waitTime = time + Random.Exponential() / totalRate;
         if (totalRate>0 && !_from->IsCollector()) {
             int neigh = _from->ChooseNeighbourUnoccupied(totalRate);
-            _to = _from->GetNeighbours()[neigh];
-            _along = _from->GetReorgEnums()[neigh];
+            _to = _from->GetNeighbour(neigh);
+            _along = _from->GetReorgEnum(neigh);
             _dZ = _from->GetDZ(neigh);
         }
         else {
@@ -86,15 +91,43 @@ class hopper{
         }
     }
     void SetHop(const double &time){
-#ifdef RandomB
-        _waitTime = time - log(UniformPos()) / _from->GetTotalRate();
-#else
-        _waitTime = time - log(gsl_rng_uniform_pos(gslRand)) / _from->GetTotalRate();
-#endif
+        _waitTime = time + Random.Exponential() / _from->GetTotalRate();
+        SetDestination();
+    }
+    // The rates out of '_from' have changed (from a total of 'oldTotalRate')
+    //   since the hop was set.  Since hopping is memoryless, the time left
+    //   until the hop can just be scaled by oldTotalRate / new total rate, 
+    //   rather than drawing a new one; only the destination is chosen again.
+    void RescaleHop(const double &time, const double &oldTotalRate){
+        double totalRate = _from->GetTotalRate();
+        if (oldTotalRate <= 0.0 || totalRate <= 0.0 || _waitTime < time) {
+            SetHop(time);
+            return;
+        }
+        _waitTime = time + (_waitTime - time) * oldTotalRate / totalRate;
+        SetDestination();
+    }
+    void SetDestination(){
         if (_from->GetTotalRate()>0 && ! _from->IsCollector()) {
             int neigh = _from->ChooseNeighbour();
-            _to = _from->GetNeighbours()[neigh];
-            _along = _from->GetReorgEnums()[neigh];
+            _to = _from->GetNeighbour(neigh);
+            _along = _from->GetReorgEnum(neigh);
+            _dZ = _from->GetDZ(neigh);
+        }
+        else {
+            _to = _from;
+            _along = -1;
+            _dZ = 0.0;
+        }
+    }
+    // Set the next hop directly, to neighbour 'neigh' of '_from' (or nowhere
+    //   if neigh < 0).  Used by the rejection-free algorithm, which chooses
+    //   both the hopper and its destination itself.
+    void SetEvent(const double &waitTime, const int &neigh) {
+        _waitTime = waitTime;
+        if (neigh >= 0) {
+            _to = _from->GetNeighbour(neigh);
+            _along = _from->GetReorgEnum(neigh);
             _dZ = _from->GetDZ(neigh);
         }
         else {
@@ -106,6 +139,38 @@ class hopper{
     void SetWaitTime(double time) {
         _waitTime=time;
     }
+    void SetQueueIndex(int i) {
+        _queueIndex=i;
+    }
+    void SetID(int ID) {
+        _ID=ID;
+    }
+    // For checkpoints: vertices are saved as their IDs, given the 
+    //   first vertex of the graph
+    void SaveState(stateBuffer & state, const vertex * vertices) const {
+        state.Put((uint32_t) (_from - vertices));
+        state.Put((uint32_t) (_to - vertices));
+        state.Put(_along);
+        state.Put(_waitTime);
+        state.Put(_dZ);
+        state.Put(_timeGenerated);
+        state.Put(_ID);
+    }
+    // The occupation of the vertices is restored by the graph, so isn't 
+    //   touched here
+    void RestoreState(stateBuffer & state, vertex * vertices) {
+        uint32_t from, to;
+        state.Get(from);
+        state.Get(to);
+        _from = vertices + from;
+        _to = vertices + to;
+        state.Get(_along);
+        state.Get(_waitTime);
+        state.Get(_dZ);
+        state.Get(_timeGenerated);
+        state.Get(_ID);
+        _queueIndex=-1;
+    }
 
     /**********
      * GET'S
@@ -128,5 +193,11 @@ class hopper{
     const int & GetAlong() const {
         return _along;
     }
+    const int & GetQueueIndex() const {
+        return _queueIndex;
+    }
+    const int & GetID() const {
+        return _ID;
+    }
 };
 #endif	/* _HOPPER_H */
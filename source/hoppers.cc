@@ -28,9 +28,8 @@ void hoppers::PrintOccupiedVertices(string dest) {
         fout.open("occVert.out");
         cout.rdbuf(fout.rdbuf()); 
     }
-    map <vertex *, hopper *> ::iterator it_vert = _mapVertexToHopper.begin();
-    for (; it_vert!=_mapVertexToHopper.end(); ++it_vert) {
-        cout << "\t" << it_vert->first->GetID() << endl;
+    for (unsigned int v = 0; v < _hopperOn.size(); v++) {
+        if (_hopperOn[v] >= 0) cout << "\t" << v << endl;
     }
     if (dest=="file") {
         fout.close();
@@ -48,31 +47,51 @@ void hoppers::PrintOccupiedVertices(string dest) {
  *     1) AddCoulomb, or
  *     2) DeleteCoulomb
  *
- *  TODO:  There are multiple, and substantial, improvements that can 
- *         be made to improve the speed and memory usage of these functions.
- *         However, I haven't got round to these because this section has 
- *         never yet been the bottleneck in my simulations.
+ *
+ *  With a 'coulombCutoff', only hoppers in the cells around the vertex 
+ *  are looked at, since hoppers further away don't interact with it.
+ *  Without one (coulombSum direct, ewald or tree), every hopper 
+ *  interacts with every other, so every other hopper's DCs change 
+ *  with each hop, and AddCoulomb is O(hoppers) on purpose: this is 
+ *  the exact mode, and a cutoff is only used when one is asked for.
+ *  With 'coulombSum tree', the sum over all other hoppers in 
+ *  'GetAllCoulombEnergies' (for the hopper that moved) comes from the 
+ *  Barnes-Hut tree instead, but the others are still each updated.
+ *  With 'occupation' (see kernel.h), the Coulomb energy of each 
+ *  occupied vertex is also kept, for 'printEnergies'.
  ***************************************************************************/
 // Given a 'newlyOccupied' vertex, update all the necessary DC's
+template <bool occupation>
 void hoppers::AddCoulomb(vertex * newlyOccupied, int sign) {
-    map <vertex *, hopper *> ::iterator it_vert = _mapVertexToHopper.begin();
-    for (; it_vert!=_mapVertexToHopper.end(); ++it_vert) {		 		
+    if (_coulombCutoff > 0.0) {
+        const vector <unsigned int> & cells = _cells.GetNeighbourCells(newlyOccupied);
+        for (unsigned int c = 0; c < cells.size(); c++) {
+            const vector <vertex *> & cell = _cells.GetCell(cells[c]);
+            for (unsigned int i = 0; i < cell.size(); i++) {
+                if (cell[i] == newlyOccupied) UpdateCoulomb_all<occupation>(newlyOccupied, sign);
+                else UpdateCoulomb_single<occupation>(cell[i], newlyOccupied, sign);
+            }
+        }
+        return;
+    }
+    for (unsigned int h = 0; h < _hopperVertices.size(); h++) {		 		
         // For the hopper that has just been added, need to calculate 
         //   Coulombic interactions with *all* other hoppers:
-    	if ( it_vert->first == newlyOccupied )	{  
-            UpdateCoulomb_all(newlyOccupied, sign); 
+    	if ( _hopperVertices[h] == newlyOccupied )	{  
+            UpdateCoulomb_all<occupation>(newlyOccupied, sign); 
         }
         // For other hoppers, only need to update the Coulombic 
         //   energy with the contribution from the most recently 
         //   added hopper
         else { 
-            UpdateCoulomb_single(it_vert->first, newlyOccupied, sign); 
+            UpdateCoulomb_single<occupation>(_hopperVertices[h], newlyOccupied, sign); 
         }
     }
 }
 // Given a 'newlyUnoccupied' vertex, update all the necessary DC's
+template <bool occupation>
 void hoppers::DeleteCoulomb(vertex * newlyUnoccupied) {
-    AddCoulomb(newlyUnoccupied,-1);
+    AddCoulomb<occupation>(newlyUnoccupied,-1);
     // If you're worried that something untoward is happening, uncomment
     //   this to check that DC for each hop is always reset to zero for 'newlyOccupied'
     /*for (int i=0; i < int (newlyUnoccupied->GetNumberNeighbours()); i++) {
@@ -85,41 +104,101 @@ void hoppers::DeleteCoulomb(vertex * newlyUnoccupied) {
 }
 // For a hopper on 'newlyOccupied', calculate the Coulombic interactions with 
 //   *all* other hoppers
+template <bool occupation>
 void hoppers::UpdateCoulomb_all(vertex * newlyOccupied, int sign) {
     if (sign==-1) {  // deleting a hopper...
         newlyOccupied -> ClearDCs(); 
-        newlyOccupied -> SetEC(0.0, _fastestTime);
+        if (occupation) newlyOccupied -> SetEC(0.0, _fastestTime);
+        // Hoppers next to it may have been waiting for it to leave 
+        //   (see hopper::SetHopOccNeigh), so give them new hops too
+        if (_rateUpdateTol > 0.0) {
+            for (unsigned int i=0; i<newlyOccupied->GetNumberNeighbours(); i++) {
+                if (newlyOccupied->IsNeighbourOccupied(i)) MarkRatesStale(newlyOccupied->GetNeighbour(i), 0.0, true);
+            }
+        }
     }
     else {  // adding a hopper...
         double deltaCurrentCoulomb, deltaNeighbourCoulomb;
         deltaCurrentCoulomb = GetAllCoulombEnergies(newlyOccupied, newlyOccupied); 
-        #ifdef printTotalOccupation
-        newlyOccupied->SetEC(deltaCurrentCoulomb,_fastestTime);
-        #endif
+        if (occupation) newlyOccupied->SetEC(deltaCurrentCoulomb,_fastestTime);
         // Update energetics for all reactions from 'newlyOccupied'
-        vector <vertex *> neighbours = newlyOccupied -> GetNeighbours();
-        vector <vertex *>::iterator neighbour = neighbours.begin();
-        for (int i=0; neighbour!=neighbours.end(); neighbour++,i++) {  			
-            deltaNeighbourCoulomb = GetAllCoulombEnergies(newlyOccupied, *neighbour);
+        for (unsigned int i=0; i<newlyOccupied->GetNumberNeighbours(); i++) {  			
+            deltaNeighbourCoulomb = GetAllCoulombEnergies(newlyOccupied, newlyOccupied->GetNeighbour(i));
             newlyOccupied -> IncrementDCs(i, (deltaNeighbourCoulomb - deltaCurrentCoulomb));
         }
+        if (_rateUpdateTol > 0.0) MarkRatesStale(newlyOccupied, 0.0, true);
     }
 }
 // Given a new hopper on 'newlyOccupied', update the Coulombic interactions of
 //   all other hoppers.
+template <bool occupation>
 void hoppers::UpdateCoulomb_single(vertex * interacting, vertex * newlyOccupied, int sign){
     double deltaCurrentCoulomb, deltaNeighbourCoulomb; 
     deltaCurrentCoulomb = GetSingleCoulombEnergy(interacting, newlyOccupied);
-    #ifdef printTotalOccupation
-	interacting->IncrementEC(sign*deltaCurrentCoulomb, _fastestTime);
-    #endif
+    if (occupation) interacting->IncrementEC(sign*deltaCurrentCoulomb, _fastestTime);
     // Update energetics for all reactions from 'interacting'
-    vector <vertex *> neighbours = interacting -> GetNeighbours();
-    vector <vertex *>::iterator neighbour = neighbours.begin();
-    for (int i=0; neighbour!=neighbours.end(); neighbour++,i++) {  			
-        deltaNeighbourCoulomb = GetSingleCoulombEnergy(*neighbour, newlyOccupied);
+    double change = 0.0;  // largest change of any DC
+    for (unsigned int i=0; i<interacting->GetNumberNeighbours(); i++) {  			
+        deltaNeighbourCoulomb = GetSingleCoulombEnergy(interacting->GetNeighbour(i), newlyOccupied);
         interacting -> IncrementDCs(i, sign*(deltaNeighbourCoulomb - deltaCurrentCoulomb) );
+        if (fabs(deltaNeighbourCoulomb - deltaCurrentCoulomb) > change) change = fabs(deltaNeighbourCoulomb - deltaCurrentCoulomb);
     }
+    if (_rateUpdateTol > 0.0) MarkRatesStale(interacting, change);
+}
+// A hopper has been added to (sign 1) or removed from (-1) 'v', so 
+//   update the Coulomb energy at each electrode (FETs only), and mark 
+//   those that have changed, including 'v' itself, to be tested at the 
+//   next step.  With a 'coulombCutoff', only the electrodes in the cells 
+//   around 'v' are looked at.
+void hoppers::UpdateElectrodeCoulomb(vertex * v, int sign) {
+    if (_electrodeOn[v->GetID()] >= 0) ElectrodeChanged(_electrodeOn[v->GetID()]);
+    double energy;
+    if (_coulombCutoff > 0.0) {
+        const vector <unsigned int> & cells = _electrodeCells.GetNeighbourCells(v);
+        for (unsigned int c = 0; c < cells.size(); c++) {
+            const vector <vertex *> & cell = _electrodeCells.GetCell(cells[c]);
+            for (unsigned int i = 0; i < cell.size(); i++) {
+                energy = GetSingleCoulombEnergy(cell[i], v);
+                if (energy == 0.0) continue;  // beyond the cut-off
+                unsigned int e = _electrodeOn[cell[i]->GetID()];
+                _electrodeCoulomb[e] += sign * energy;
+                ElectrodeChanged(e);
+            }
+        }
+        return;
+    }
+    for (unsigned int i = 0; i < _generators.size(); i++) {
+        _electrodeCoulomb[i] += sign * GetSingleCoulombEnergy(_generators[i], v);
+        ElectrodeChanged(i);
+    }
+    unsigned int offset = _generators.size();
+    for (unsigned int i = 0; i < _collectors.size(); i++) {
+        _electrodeCoulomb[offset + i] += sign * GetSingleCoulombEnergy(_collectors[i], v);
+        ElectrodeChanged(offset + i);
+    }
+}
+// Every electrode is tested at the first step
+void hoppers::ResetElectrodes() {
+    _electrodeStep = 0;
+    _electrodeSteps.Clear();
+    _testedElectrodes.clear();
+    _changedElectrodes.clear();
+    _electrodeChanged.assign(_electrodeCoulomb.size(), 1);
+    for (unsigned int e = 0; e < _electrodeCoulomb.size(); e++) _changedElectrodes.push_back(e);
+}
+// Electrode 'e', last tested before 'step', changes its occupation at 
+//   each step with a fixed chance, so the number of steps until it does 
+//   is geometric.  Draw it, or leave 'e' out of '_electrodeSteps' if it
+//   never will.
+void hoppers::ScheduleElectrode(unsigned int e, uint64_t step) {
+    vertex * v = (e < _generators.size()) ? _generators[e] : _collectors[e - _generators.size()];
+    double p = _electrodeOccupy[e];
+    double change = v->IsOccupied() ? 1.0 - p : p;
+    if (change <= 0.0) return;
+    double wait = 0.0;
+    if (change < 1.0) wait = floor(Random.Exponential() / -log1p(-change));
+    if (wait > 1e18) return;
+    _electrodeSteps.Set(e, step + (uint64_t) wait);
 }
 // Get the Coulomb energy between two vertices
 double const hoppers::GetSingleCoulombEnergy(vertex * v1, vertex * v2) {
@@ -130,64 +209,210 @@ double const hoppers::GetSingleCoulombEnergy(vertex * v1, vertex * v2) {
     //   'MakeCoulombEnergyGrid()' in 'graph.h'
     //return _graph->GetCoulomb( v1, v2 );			
 
-    // On the fly calculations could have a cutoff built in, but I've not dealt with 
-    //   large enough morphologies yet for this to be worthwhile.
-    if (v1 != v2 ) { // don't think we need this check....?
-        return _graph->_coulombPrefactor/_graph->GetDistance(v1, v2);  
-    }	
-    else return 0.0;
-
-    /** TODO:  Use trees to do this *really* fast... **/
+    if (v1 == v2 ) return 0.0;  // don't think we need this check....?
+    if (_ewaldSum) 
+        return _graph->_coulombPrefactor * _ewald.GetPotential(v2->_pos._x - v1->_pos._x, 
+                                                              v2->_pos._y - v1->_pos._y, 
+                                                              v2->_pos._z - v1->_pos._z);
+    double r = _graph->GetDistance(v1, v2);
+    if (_coulombCutoff <= 0.0) return _graph->_coulombPrefactor / r;
+    if (r >= _coulombCutoff) return 0.0;
+    if (_coulombDamping > 0.0) 
+        return _graph->_coulombPrefactor * (erfc(_coulombDamping * r) / r - _coulombShift);
+    return _graph->_coulombPrefactor * (1.0 / r - _coulombShift);
 }
 // Get the Coulomb energy between 'interacting' and every other occupied vertex except 'ignore'
 double hoppers::GetAllCoulombEnergies(vertex * ignore, vertex * interacting) {
     double coulomb=0;
-    map <vertex *, hopper *> ::iterator occupied = _mapVertexToHopper.begin();
-    for (; occupied!=_mapVertexToHopper.end(); ++occupied) { 						
-        if ( occupied->first != ignore ) {  // ignore interactions with self...
-            coulomb += GetSingleCoulombEnergy(interacting, occupied->first);	
+    if (_treeSum) return _graph->_coulombPrefactor * _tree.GetPotential(interacting->GetPos(), ignore);
+    if (_coulombCutoff > 0.0) {
+        const vector <unsigned int> & cells = _cells.GetNeighbourCells(interacting);
+        for (unsigned int c = 0; c < cells.size(); c++) {
+            const vector <vertex *> & cell = _cells.GetCell(cells[c]);
+            for (unsigned int i = 0; i < cell.size(); i++) {
+                if (cell[i] != ignore) coulomb += GetSingleCoulombEnergy(interacting, cell[i]);
+            }
+        }
+        return coulomb;
+    }
+    for (unsigned int h = 0; h < _hopperVertices.size(); h++) { 						
+        if ( _hopperVertices[h] != ignore ) {  // ignore interactions with self...
+            coulomb += GetSingleCoulombEnergy(interacting, _hopperVertices[h]);	
         }
     }
     return coulomb;
 }
-// Once all the Coulomb energies have been updated, need to 
-//   recalculate rates and reset all hops
-void hoppers::SetHops_C(const double & fastestTime) {
-    // C++ doesn't necessarily iterate through maps in the same order.
-    //   Rather, it depends on the size of the objects in the map.
-    //   If you're worried about this, use the following code instead...
-    /*list <hopper *>::iterator it_hop = _hoppers.begin();
-    for (; it_hop!=_hoppers.end(); ++it_hop) {
-        ( (*it_hop)->GetFrom() ) -> UpdateRates_C(_graph->_reorg, _graph->_kT);
-	    (*it_hop) -> SetHop(fastestTime);
-    }*/
+// Compare the Coulomb energies of the hoppers currently in the simulation, 
+//   and the change in energy of each of their hops, with the exact sums 
+//   over all other hoppers.  O(N^2), so only called at the end of runs.
+void hoppers::MeasureCoulombCutoffError() {
+    if (_coulombCutoff <= 0.0 && !_treeSum) return;
+    for (unsigned int h = 0; h < _hopperVertices.size(); h++) {
+        vertex * v = _hopperVertices[h];
+        double exact = 0.0;
+        for (unsigned int other = 0; other < _hopperVertices.size(); other++) {
+            if (_hopperVertices[other] != v) exact += _graph->_coulombPrefactor / _graph->GetDistance(v, _hopperVertices[other]);
+        }
+        double error = GetAllCoulombEnergies(v, v) - exact;
+        _cutoffSumSqError += error * error;
+        if (fabs(error) > _cutoffMaxError) _cutoffMaxError = fabs(error);
+        _cutoffSamples++;
 
-    // If you're not worried about the order of iteration, use this.
-    //   Note: If you change the size of your hoppers / vertex object
-    //         you may change the order of iteration and therefore your 
-    //         results...
-    map <vertex *, hopper *> ::iterator it_vert = _mapVertexToHopper.begin();
-    for (; it_vert!=_mapVertexToHopper.end(); ++it_vert) {
-        (it_vert->first)  -> UpdateRates_C(_graph->_kT);
-        (it_vert->second) -> SetHop(fastestTime);
+        for (unsigned int i=0; i<v->GetNumberNeighbours(); i++) {
+            vertex * neighbour = v->GetNeighbour(i);
+            double exactNeighbour = 0.0;
+            for (unsigned int other = 0; other < _hopperVertices.size(); other++) {
+                vertex * o = _hopperVertices[other];
+                if (o != v && o != neighbour) exactNeighbour += _graph->_coulombPrefactor / _graph->GetDistance(neighbour, o);
+            }
+            error = v->GetDC(i) - (exactNeighbour - exact);
+            _cutoffSumSqHopError += error * error;
+            if (fabs(error) > _cutoffMaxHopError) _cutoffMaxHopError = fabs(error);
+            _cutoffHopSamples++;
+        }
+    }
+}
+// The DCs of the hopper on 'v' have changed by up to 'change' (eV), or,
+//   if 'newHop', it has only just arrived.  Add it to the list of hoppers
+//   whose rates need updating once the changes since its rates were last 
+//   updated could add up to more than '_rateUpdateTol'.
+void hoppers::MarkRatesStale(vertex * v, double change, bool newHop) {
+    unsigned int id = v->GetID();
+    char state = _ratesStale[id];
+    if (newHop) {
+        _dcDrift[id] = 0.0;
+        _ratesStale[id] = 2;
+    }
+    else {
+        _dcDrift[id] += change;
+        if (state == 0 && _dcDrift[id] > _rateUpdateTol) _ratesStale[id] = 1;
     }
+    if (state == 0 && _ratesStale[id] != 0) _staleVertices.push_back(v);
+}
+// Once all the Coulomb energies have been updated, need to 
+//   recalculate rates and reset all hops.
+//   With a 'rateUpdateTol' only the hoppers in '_staleVertices' are 
+//   updated.  A hopper that has just arrived gets a new hop; the others 
+//   keep their waitTimes, rescaled to the new total rate.
+template <bool millerAbrahams>
+void hoppers::SetHops_C(const double & fastestTime) {
+    if (_rateUpdateTol > 0.0) {
+        // If many hoppers change, it's cheaper to reorder the queue in one go
+        bool rebuild = (_staleVertices.size() * 8 > (unsigned int) _nHoppers);
+        for (unsigned int i = 0; i < _staleVertices.size(); i++) {
+            vertex * v = _staleVertices[i];
+            unsigned int id = v->GetID();
+            char state = _ratesStale[id];
+            _ratesStale[id] = 0;
+            _dcDrift[id] = 0.0;
+            if (!v->IsOccupied()) continue;  // the hopper has since left
+            double oldTotalRate = v->GetTotalRate();
+            UpdateVertexRates<millerAbrahams>(v);
+            if (_rejectionFree) {
+                UpdateRate(v);
+                continue;
+            }
+            hopper * H = _hoppers[_hopperOn[id]];
+            if (state == 2) H->SetHop(fastestTime);
+            else H->RescaleHop(fastestTime, oldTotalRate);
+            if (_useQueue && !rebuild) _queue.Update(H);
+        }
+        _staleVertices.clear();
+        if (_useQueue && rebuild) _queue.Rebuild();
+        return;
+    }
+    // The order of '_hoppers' only depends on the order in which hoppers 
+    //   were generated and removed, so results are reproducible.
+    for (unsigned int h = 0; h < _hoppers.size(); h++) {
+        UpdateVertexRates<millerAbrahams>(_hopperVertices[h]);
+        if (_rejectionFree) UpdateRate(_hopperVertices[h]);
+        else _hoppers[h] -> SetHop(fastestTime);
+    }
+    // Every waitTime has changed, so it's cheaper to reorder the queue in one go
+    if (_useQueue) _queue.Rebuild();
 }
 
 /********************************
  * GENERATION / REMOVAL FUNCTIONS
  ********************************/ 
+// Keep '_hoppers', '_hopperVertices', '_hopperOn' and '_onGenerators' 
+//   in step.  O(1).
+void hoppers::AddHopper(hopper * H) {
+    _hopperOn[H->GetFrom()->GetID()] = _hoppers.size();
+    _hoppers.push_back(H);
+    _hopperVertices.push_back(H->GetFrom());
+    if (H->GetFrom()->IsGenerator()) {
+        _onGenerators++;
+        _graph->SetGeneratorEmpty(H->GetFrom(), false);
+    }
+    if (!_electrodeCoulomb.empty()) UpdateElectrodeCoulomb(H->GetFrom(), 1);
+}
+// Swap 'H' with the last hopper, and remove it
+void hoppers::RemoveHopper(hopper * H) {
+    unsigned int id = H->GetFrom()->GetID();
+    int h = _hopperOn[id];
+    int last = _hoppers.size() - 1;
+    _hoppers[h] = _hoppers[last];
+    _hopperVertices[h] = _hopperVertices[last];
+    _hopperOn[_hopperVertices[h]->GetID()] = h;
+    _hoppers.pop_back();
+    _hopperVertices.pop_back();
+    _hopperOn[id] = -1;
+    if (H->GetFrom()->IsGenerator()) {
+        _onGenerators--;
+        _graph->SetGeneratorEmpty(H->GetFrom(), true);
+    }
+    if (!_electrodeCoulomb.empty()) UpdateElectrodeCoulomb(H->GetFrom(), -1);
+}
+// Call before 'H' itself is moved to 'to'
+void hoppers::MoveHopper(hopper * H, vertex * to) {
+    unsigned int id = H->GetFrom()->GetID();
+    int h = _hopperOn[id];
+    _hopperOn[id] = -1;
+    _hopperOn[to->GetID()] = h;
+    _hopperVertices[h] = to;
+    if (H->GetFrom()->IsGenerator()) {
+        _onGenerators--;
+        _graph->SetGeneratorEmpty(H->GetFrom(), true);
+    }
+    if (to->IsGenerator()) {
+        _onGenerators++;
+        _graph->SetGeneratorEmpty(to, false);
+    }
+    if (!_electrodeCoulomb.empty()) {
+        UpdateElectrodeCoulomb(H->GetFrom(), -1);
+        UpdateElectrodeCoulomb(to, 1);
+    }
+}
 // Generate on a given vertex at a given time
+template <bool interactions, bool occupation>
 void hoppers::Generate(vertex * V, const double & time){
     hopper * newhopper;
-    newhopper = new hopper(V,time);
-    _hoppers.push_back(newhopper);
-    _mapVertexToHopper[V]=newhopper;
+    newhopper = new (HopperMemory()) hopper(V,time);
+    if (occupation) V->StartOccupation(time);
+    newhopper->SetID(NewID());
+    AddHopper(newhopper);
+    if (_coulombCutoff > 0.0) _cells.Insert(V);
+    if (_treeSum) _tree.Insert(V);
     _nHoppers++;
+    if (interactions) {
+        AddCoulomb<occupation>(V);
+    }
+    else if (!_rejectionFree) {
+        newhopper->SetHop(time);
+    }
+    if (_useQueue) _queue.Push(newhopper);
+    if (_rejectionFree) UpdateRatesAround(V);
+}
+// For setting up, before kmc has chosen the kernel (see kernel.h)
+void hoppers::Generate(vertex * V, const double & time) {
     if (_hopperInteractions) {
-        AddCoulomb(V);
+        if (_graph->_keepOccupations) Generate<true, true>(V, time);
+        else Generate<true, false>(V, time);
     }
     else {
-        newhopper->SetHop(time);
+        if (_graph->_keepOccupations) Generate<false, true>(V, time);
+        else Generate<false, false>(V, time);
     }
 }
 // Generate on previously occupied vertices
@@ -201,75 +426,92 @@ int hoppers::GenerateOnPreviouslyOccupied(char * filename, const double & time)
     return generateOnMe.size();
 }
 // Generate randomly on unoccupied vertices that are electrodes
+template <bool interactions, bool occupation>
 void hoppers::GenerateAll(const int & nHoppers, const double & time) {
     vertex * emptyGenerator;
     for (int i=0; i<nHoppers; i++) {
         emptyGenerator = _graph -> GetEmptyGenerator();
-        Generate(emptyGenerator, time);
+        Generate<interactions, occupation>(emptyGenerator, time);
     }
 }
 // Remove hopper 'H' at 'time'
-void hoppers::Remove(list <hopper *>::iterator H, const double & time){
-    vertex * from=(*H)->GetFrom();
-    if (_hopperInteractions) {
-        DeleteCoulomb(from);
-    }
-    _mapVertexToHopper.erase(from);
-    (*H)->SetWaitTime(time); 	
-    delete *H;
-    _hoppers.erase(H);		
+template <bool interactions, bool occupation>
+void hoppers::Remove(hopper * H, const double & time){
+    vertex * from=H->GetFrom();
+    if (interactions) {
+        DeleteCoulomb<occupation>(from);
+    }
+    RemoveHopper(H);
+    if (_coulombCutoff > 0.0) _cells.Remove(from);
+    if (_treeSum) _tree.Remove(from);
+    if (_useQueue) _queue.Remove(H);
+    H->SetWaitTime(time); 	
+    if (occupation) from->EndOccupation(time);
+    _freeIDs.push_back(H->GetID());
+    DeleteHopper(H);
     _nHoppers--;
+    if (_rejectionFree) UpdateRatesAround(from);
+}
+// Occupy electrode 'e', or not, counting the current through it
+template <bool interactions, bool occupation>
+void hoppers::SetElectrode(unsigned int e, bool occupy, const double & time) {
+    bool source = (e < _generators.size());
+    vertex * v = source ? _generators[e] : _collectors[e - _generators.size()];
+    if (occupy && !v->IsOccupied()) {
+        Generate<interactions, occupation>(v, time);
+        if (source) _generatorCurrent++;
+        else _collectorCurrent--;
+    }
+    else if (!occupy && v->IsOccupied()) {
+        Remove<interactions, occupation>(GetHopper(v), time);
+        if (source) _generatorCurrent--;
+        else _collectorCurrent++;
+    }
 }
 // Set the Fermi-level of the source and drain in FETs. 
-//   Called at every MC step
-//   TODO: This could be a lot nicer....
+//   Called at every MC step, so rather than testing every electrode (see
+//   '_electrodeSteps'), only test those that have changed, and change 
+//   those that are due to.  Changes made here are tested at the next step.
+template <bool interactions, bool occupation>
 int hoppers::SetSourceDrainOccupation(const double & time) {
-    double energy;
-    list <hopper *>::iterator it_hop;
-    vector <vertex *>::iterator it;
-    // Set occupation of the generators (the source)
-    for (it=_generators.begin(); it!=_generators.end(); ++it) {
-        energy = (*it)->GetE() + GetAllCoulombEnergies(*it, *it); 
-
-        #ifdef RandomB
-        if ( exp( (_graph->_sourceFermiEnergy-energy)/_graph->_kT ) > Uniform() ) { // vertex should be occupied...
-        #else
-        if ( exp( (_graph->_sourceFermiEnergy-energy)/_graph->_kT ) > gsl_rng_uniform(gslRand) ) { 
-        #endif
-            if ( !(*it)->IsOccupied() ) { 
-                Generate(*it, time); 
-                _generatorCurrent++;
-            }
-        }
-        else {  // vertex shouldn't be occupied...
-            if ( (*it)->IsOccupied() ) {	
-                Remove(GetHopperIterator(*it),time);  // BODGE: This ain't fast!
-                _generatorCurrent--;
-            }
-        }
-    }
-    // Do the same thing for the collectors (the drain)
-    for (it=_collectors.begin(); it!=_collectors.end(); ++it) {
-        energy = (*it)->GetE() + GetAllCoulombEnergies(*it, *it);
-        #ifdef RandomB
-        if ( exp( (_graph->_drainFermiEnergy - energy)/_graph->_kT ) > Uniform() ) {
-        #else
-        if ( exp( (_graph->_drainFermiEnergy - energy)/_graph->_kT ) > gsl_rng_uniform(gslRand) ) {
-        #endif
-            if ( !(*it)->IsOccupied() ) {
-                Generate(*it, time); 
-                _collectorCurrent--;
-            }
-        }
-        else {
-            if ( (*it)->IsOccupied() ) {
-                Remove(GetHopperIterator(*it),time); 
-                _collectorCurrent++;
-            }
-        }
+    uint64_t step = _electrodeStep++;
+    // Those tested at the last step and not changed since
+    for (unsigned int i = 0; i < _testedElectrodes.size(); i++) {
+        if (!_electrodeChanged[_testedElectrodes[i]]) ScheduleElectrode(_testedElectrodes[i], step);
+    }
+    _testedElectrodes.clear();
+    _testingElectrodes.swap(_changedElectrodes);
+    for (unsigned int i = 0; i < _testingElectrodes.size(); i++) _electrodeChanged[_testingElectrodes[i]] = 0;
+    for (unsigned int i = 0; i < _testingElectrodes.size(); i++) {
+        unsigned int e = _testingElectrodes[i];
+        bool source = (e < _generators.size());
+        vertex * v = source ? _generators[e] : _collectors[e - _generators.size()];
+        double fermiEnergy = source ? _graph->_sourceFermiEnergy : _graph->_drainFermiEnergy;
+        _electrodeOccupy[e] = exp((fermiEnergy - v->GetE() - _electrodeCoulomb[e]) / _graph->_kT);
+        _electrodeSteps.Remove(e);
+        SetElectrode<interactions, occupation>(e, _electrodeOccupy[e] > Random.Uniform(), time);
+        _testedElectrodes.push_back(e);
+    }
+    _testingElectrodes.clear();
+    while (!_electrodeSteps.Empty() && _electrodeSteps.TopStep() <= step) {
+        unsigned int e = _electrodeSteps.Top();
+        _electrodeSteps.Remove(e);
+        bool source = (e < _generators.size());
+        vertex * v = source ? _generators[e] : _collectors[e - _generators.size()];
+        SetElectrode<interactions, occupation>(e, !v->IsOccupied(), time);
+        _testedElectrodes.push_back(e);
     }
     return _nHoppers;
 }
+// For setting up, before kmc has chosen the kernel (see kernel.h)
+int hoppers::SetSourceDrainOccupation(const double & time) {
+    if (_hopperInteractions) {
+        if (_graph->_keepOccupations) return SetSourceDrainOccupation<true, true>(time);
+        return SetSourceDrainOccupation<true, false>(time);
+    }
+    if (_graph->_keepOccupations) return SetSourceDrainOccupation<false, true>(time);
+    return SetSourceDrainOccupation<false, false>(time);
+}
 
 /*************************************************
  * DETERMINE FET CONVERGENCE 
@@ -303,8 +545,8 @@ void hoppers::activeHoppersConvergence() {
 }
 void hoppers::FETConvergence() {
     // Update the current
-    _currentStore.pop_front();
-    _currentStore.push_back(e * (double(_collectorCurrent + _generatorCurrent))
+    rotate(_currentStore.begin(), _currentStore.begin() + 1, _currentStore.end());  // drop the oldest
+    _currentStore.back() = (e * (double(_collectorCurrent + _generatorCurrent))
                               / (2.0 * (GetFastestTime() - _activeHoppersConvergedTime))) ;
     if (VERBOSITY_HIGH) {
         cout << "Hoppers converged: time (s) = " << GetFastestTime() << "; hoppers = " << _nHoppers
@@ -331,181 +573,290 @@ void hoppers::FETConvergence() {
 
 /**********************************************************************
  * MOVE FUNCTIONS
- * The actual move is executed by 'Move', but this is wrapped by a 
- * 'MoveFastest' function which also takes care of everything else
- *  that has to be done before / after a 'Move'
- *
- * TODO: Some of the 'MoveFastest' functions should certainly be merged
+ * The actual move is executed by 'Move', but this is wrapped by 
+ * 'MoveFastest' (in hoppers.h) which also takes care of everything 
+ * else that has to be done before / after a 'Move'
  ***********************************************************************/
 // Actually move the charge.
-double hoppers::Move( list <hopper *>::iterator H, vertex * to, double &fastestTime){
-    vertex * from = (*H)->GetFrom() ;
-    #ifdef printTotalOccupation
-    if (_track) {
-        cout << GetHopperNumber(from) 
+template <bool interactions, bool occupation>
+double hoppers::Move( hopper * H, vertex * to, double &fastestTime){
+    vertex * from = H->GetFrom() ;
+    if (occupation && _track) {
+        cout << H->GetID() 
              << '\t' << fastestTime
              << '\t' << from->GetX() 
              << '\t' << from->GetY()
              << '\t' << from->GetZ() << endl;
     }
-    #endif
     double dz = GetFastestDz();
     if ( !to->IsOccupied() ) {
-        if (_hopperInteractions) DeleteCoulomb(from);
+        if (interactions) DeleteCoulomb<occupation>(from);
         
-        from->SetUnoccupied(fastestTime);  // Note: do this after DeleteCoulomb
-        _mapVertexToHopper.erase(from); 
-        to->SetOccupied(fastestTime);  // Note: do this before AddCoulomb
-        _mapVertexToHopper[to] = *H;
+        from->SetUnoccupied();  // Note: do this after DeleteCoulomb
+        if (occupation) from->EndOccupation(fastestTime);
+        MoveHopper(H, to);
+        to->SetOccupied();  // Note: do this before AddCoulomb
+        if (occupation) to->StartOccupation(fastestTime);
+        if (_coulombCutoff > 0.0) {
+            _cells.Remove(from);
+            _cells.Insert(to);
+        }
+        if (_treeSum) {
+            _tree.Remove(from);
+            _tree.Insert(to);
+        }
 
-        if(_hopperInteractions)	{
-            (*H) -> Move(to);
-            AddCoulomb(to);  // If 'to' is generator, shouldn't be here!
+        if(interactions)	{
+            H -> Move(to);
+            AddCoulomb<occupation>(to);  // If 'to' is generator, shouldn't be here!
+        }
+        else if (_rejectionFree) {
+            H -> Move(to);
         }
         else {
-            (*H)->SetHop(to, fastestTime);
+            H->SetHop(to, fastestTime);
+            if (_useQueue) _queue.Update(H);
+        }
+        if (_rejectionFree) {
+            UpdateRatesAround(from);
+            UpdateRatesAround(to);
         }
         return dz;
     }
+    // The rejection-free algorithm only ever chooses unoccupied destinations,
+    //   so the only way to get here is if no hopper can move at all.
+    else if (_rejectionFree) {
+        return 0.0;
+    }
     // If 'to' is occupied, don't move but just give a new waitTime
     //   (taking into account the disabled reaction).
     else {
-        (*H) -> SetHopOccNeigh(from, fastestTime);
+        H -> SetHopOccNeigh(from, fastestTime);
+        if (_useQueue) _queue.Update(H);
         return 0.0;
     }
 }
-// The MoveFastest function for simple ToF
-double hoppers::MoveFastest_C() {
-    vertex * to = (*_fastest)->GetTo();
-    double fastestTime=GetFastestTime();
-    double dz;
-    if ( to->IsCollector() ) {
-        _reciprocalCollectionTimes.push_back(1.0 / fastestTime);
-        _totalReciprocalCollectionTimes += (1.0 / fastestTime);
-        dz = GetFastestDz();
-        Remove(_fastest, fastestTime);
-    }
-    else dz = Move(_fastest, to, fastestTime);
-    FindFastest();
-    return dz;
-}
-// The MoveFastest function for simple Regenerate mode
-double hoppers::MoveFastest_R() {
-    vertex * to = (*_fastest)->GetTo();
-    double fastestTime = GetFastestTime();
-    double dz;
-    if ( to->IsCollector() ) {
-        double transitTime = fastestTime - (*_fastest)->GetGenerationTime();
-        _reciprocalCollectionTimes.push_back(1.0 / transitTime);
-        _totalReciprocalCollectionTimes += 1.0 / transitTime;
-        dz = GetFastestDz();
-        Remove(_fastest,fastestTime);
-        GenerateAll(1,fastestTime);
-    }
-    else dz = Move(_fastest, to, fastestTime);
-    FindFastest();
-    return dz;
-}
-// The 'MoveFastest' function for simple Regnerate mode, with 
-//   Coulombic interactions.  !!! WARNING !!! Poorly tested.
-//   TODO: Merge with above function
-double hoppers::MoveFastest_RCI() {
-    vertex * to = (*_fastest)->GetTo();	
-    double fastestTime=GetFastestTime();
-    double dz;
-    if ( to->IsCollector() ) {
-        double transitTime = fastestTime - (*_fastest)->GetGenerationTime();
-        _reciprocalCollectionTimes.push_back(1.0 / transitTime);
-        _totalReciprocalCollectionTimes += 1.0 / transitTime;
-        dz = GetFastestDz();
-        Remove(_fastest,fastestTime);
-        GenerateAll(1,fastestTime);
-    }
-    else dz = Move(_fastest, to, fastestTime);
-    SetHops_C(fastestTime);
-    FindFastest();        
-    return dz;
-}
-// The MoveFastest function for periodic boundary mode
-double hoppers::MoveFastest_PB() {
-    vertex* to = (*_fastest)->GetTo();
-    double fastestTime = GetFastestTime();
-    double dz;
-    // We might want to just ignore collection sites, in which case remove the block below.
-    //if (to->IsCollector()) {
-    //    _reciprocalCollectionTimes.push_back(1.0 / fastestTime);
-    //    _totalReciprocalCollectionTimes += (1.0 / fastestTime);
-    //    dz = GetFastestDz();
-    //    Remove(_fastest, fastestTime);
-    //}
-    //else dz = Move(_fastest, to, fastestTime);
-    dz = Move(_fastest, to, fastestTime);
-    FindFastest();
-    return dz;
-}
-// The 'MoveFastest' function for the FET mode
-double hoppers::MoveFastest_F() {
-    vertex * to = (*_fastest)->GetTo();	
-    double fastestTime=GetFastestTime();
-    double dz;
-    dz = Move(_fastest, to, fastestTime);
-    _totalCurrent = _generatorCurrent + _collectorCurrent;
-    SetSourceDrainOccupation(fastestTime); 
-    SetHops_C(fastestTime);
-    // Check there are still hoppers 
-    if (_nHoppers == 0) { 
-        cout << "!!! WARNING !!! : Ran out of hoppers\n";
-        WARNINGS++;
-        _run = false;
-        return .0;
-    }
-    FindFastest();        
-    ++_moves;
-    // Check if maxTime has been exceeded
-    if (GetFastestTime() > _maxTime) {
-        cout << "!!! WARNING !!! : maxTime exceeded!  Time = " << GetFastestTime() << endl;
-        WARNINGS++;
-        _run=false;
-        return .0;
-    }
-    // Check for convergence
-    if ( _moves==_movesCycle ) {
-	    _moves=0;
-	    if (_activeHoppersConverged) {
-            FETConvergence(); 
-        }
-	    else { 
-            activeHoppersConvergence();
-        }
+
+/**********************************************************************
+ * REJECTION-FREE ALGORITHM ('algorithm bkl')
+ * Rather than giving every hopper its own waitTime (the First Reaction 
+ * Method), keep the total rate to unoccupied neighbours of every 
+ * occupied vertex in '_rateTree'.  Each step then needs one random 
+ * number for the time of the next hop and one to choose which hopper 
+ * makes it and where to.  Hops to occupied vertices are never chosen, 
+ * so none are wasted.
+ **********************************************************************/
+// Set the rate out of 'v', which is zero unless 'v' is occupied.
+//   As in hopper::SetHop, hoppers never leave collectors.
+void hoppers::UpdateRate(vertex * v) {
+    if (v->IsOccupied() && !v->IsCollector())
+        _rateTree.Set(v->GetID(), v->CalcTotalRateToUnoccupied());
+    else
+        _rateTree.Set(v->GetID(), 0.0);
+}
+// 'v' has just been occupied or vacated.  This changes its own rate,
+//   and that of any hopper next to it.
+void hoppers::UpdateRatesAround(vertex * v) {
+    UpdateRate(v);
+    for (unsigned int i=0; i<v->GetNumberNeighbours(); i++) {
+        if (v->IsNeighbourOccupied(i)) UpdateRate(v->GetNeighbour(i));
     }
-    return dz;
 }
 
 /******************
  * TIME FUNCTIONS
  ******************/
-// Find the fastest hopper
+// Find the fastest hopper.  Normally this is just the top of the queue;
+//   'eventQueue scan' reverts to the old O(N) search, and 'eventQueue check'
+//   does both and makes sure they agree.
 void hoppers::FindFastest() {
     if (_hoppers.empty()) {
         _fastestTime = 1e50;
-    }
-    else{
-        list <hopper *>::iterator it_hop = _hoppers.begin();
-        _fastest = it_hop;
-        for ( ; it_hop != _hoppers.end(); ++it_hop){
-            if ( (*it_hop)->GetWaitTime() < (*_fastest)->GetWaitTime()) _fastest = it_hop;
+        return;
+    }
+    if (_rejectionFree) {
+        ChooseNextEvent();
+        return;
+    }
+    if (!_useQueue) {
+        ScanFastest();
+        return;
+    }
+    if (_checkQueue) {
+        ScanFastest();
+        if ( _queue.Top()->GetWaitTime() != _fastestTime || _queue.Size() != _hoppers.size() ) {
+            cout << scientific << "***ERROR*** : eventQueue has fastest time " << _queue.Top()->GetWaitTime()
+                 << " but scanning all hoppers gives " << _fastestTime << endl;
+            ERROR(-1, "eventQueue check failed");
         }
-        _fastestTime=(*_fastest)->GetWaitTime();
-        _alongReorgEnum=(*_fastest)->GetAlong();
     }
+    _fastest = _queue.Top();
+    _fastestTime=_fastest->GetWaitTime();
+    _alongReorgEnum=_fastest->GetAlong();
+}
+// Find the fastest hopper by checking every hopper
+void hoppers::ScanFastest() {
+    _fastest = _hoppers[0];
+    for (unsigned int h = 1; h < _hoppers.size(); h++) {
+        if ( _hoppers[h]->GetWaitTime() < _fastest->GetWaitTime()) _fastest = _hoppers[h];
+    }
+    _fastestTime=_fastest->GetWaitTime();
+    _alongReorgEnum=_fastest->GetAlong();
+}
+// Choose the next hop for the rejection-free algorithm (see below)
+void hoppers::ChooseNextEvent() {
+    double totalRate = _rateTree.GetTotal();
+    double waitTime = _fastestTime + Random.Exponential() / totalRate;
+    if (totalRate > 0.0) {
+        double residual;
+        unsigned int id = _rateTree.Find(Random.Uniform() * totalRate, residual);
+        vertex * from = _graph->GetVertex(id);
+        _fastest = GetHopper(from);
+        _fastest->SetEvent(waitTime, from->PickNeighbourUnoccupied(residual));
+    }
+    else {  // nothing can move, ever
+        _fastest = _hoppers[0];
+        _fastest->SetEvent(waitTime, -1);
+    }
+    _fastestTime=_fastest->GetWaitTime();
+    _alongReorgEnum=_fastest->GetAlong();
 }
 // Set all hoppers' waitTimes to 'time'.  
 //   Used at end of simulations, needed for occupation times.
 void hoppers::SetWaitTimes(double time) {
-    list <hopper *>::iterator it_hop = _hoppers.begin();
-    for (; it_hop!=_hoppers.end(); ++it_hop) {
-        (*it_hop)->SetWaitTime(time);
+    for (unsigned int h = 0; h < _hoppers.size(); h++) {
+        _hoppers[h]->SetWaitTime(time);
     }
+    if (_useQueue) _queue.Rebuild();
+}
+// Take over the collections of 'other' (see kmc::AddRun)
+void hoppers::AddCollections(hoppers & other) {
+    _collectionEvents += other._collectionEvents;
+    _totalReciprocalCollectionTimes += other._totalReciprocalCollectionTimes;
+    other._collectionEvents = 0;
+    other._totalReciprocalCollectionTimes = 0.0;
+}
+
+/***************************************
+ * CHECKPOINTS
+ * Hoppers are saved in the order of '_hoppers', and the queue by their 
+ * positions in it, so that ties between waitTimes are broken in the 
+ * same way after a restart.
+ ***************************************/
+void hoppers::SaveState(stateBuffer & state) const {
+    const vertex * vertices = _graph->GetVertex(0);
+    state.Put((int32_t) _nHoppers);
+    state.Put((uint64_t) _hoppers.size());
+    for (unsigned int h = 0; h < _hoppers.size(); h++) _hoppers[h]->SaveState(state, vertices);
+    state.Put(_freeIDs);
+    state.Put(_nextID);
+    state.Put(_collectionEvents);
+    state.Put(_totalReciprocalCollectionTimes);
+    int32_t fastest = -1;
+    if (!_hoppers.empty()) fastest = _hopperOn[_fastest->GetFrom()->GetID()];
+    state.Put(fastest);
+    state.Put(_fastestTime);
+    state.Put((int32_t) _alongReorgEnum);
+    if (_useQueue) {
+        vector <int32_t> heap(_queue.Size());
+        for (unsigned int i = 0; i < heap.size(); i++) heap[i] = _hopperOn[_queue.At(i)->GetFrom()->GetID()];
+        state.Put(heap);
+    }
+    if (_rejectionFree) _rateTree.SaveState(state);
+    if (_coulombCutoff > 0.0) _cells.SaveState(state);
+    if (_treeSum) _tree.SaveState(state);
+    state.Put(_cutoffSumSqError);
+    state.Put(_cutoffMaxError);
+    state.Put(_cutoffSumSqHopError);
+    state.Put(_cutoffMaxHopError);
+    state.Put(_cutoffSamples);
+    state.Put(_cutoffHopSamples);
+    if (_rateUpdateTol > 0.0) {
+        state.Put(_dcDrift);
+        state.Put(_ratesStale);
+        vector <unsigned int> stale(_staleVertices.size());
+        for (unsigned int i = 0; i < stale.size(); i++) stale[i] = _staleVertices[i]->GetID();
+        state.Put(stale);
+    }
+    state.Put(_collectorCurrent);
+    state.Put(_generatorCurrent);
+    state.Put(_totalCurrent);
+    state.Put(_currentStore);
+    state.Put(_moves);
+    state.Put(_activeHoppersConverged);
+    state.Put(_activeHoppersConvergedTime);
+    state.Put(_run);
+    state.Put(_electrodeCoulomb);
+    state.Put(_electrodeStep);
+    state.Put(_electrodeOccupy);
+    state.Put(_electrodeChanged);
+    state.Put(_changedElectrodes);
+    state.Put(_testedElectrodes);
+    _electrodeSteps.SaveState(state);
+}
+// Call after softClear
+void hoppers::RestoreState(stateBuffer & state) {
+    vertex * vertices = _graph->GetVertex(0);
+    int32_t nHoppers;
+    state.Get(nHoppers);
+    _nHoppers = nHoppers;
+    uint64_t n;
+    state.Get(n);
+    if (n > _hopperOn.size()) ERROR(-1, "Checkpoint has more hoppers than vertices");
+    for (unsigned int h = 0; h < n; h++) {
+        hopper * H = new (HopperMemory()) hopper();
+        H->RestoreState(state, vertices);
+        AddHopper(H);
+    }
+    state.Get(_freeIDs);
+    state.Get(_nextID);
+    state.Get(_collectionEvents);
+    state.Get(_totalReciprocalCollectionTimes);
+    int32_t fastest, along;
+    state.Get(fastest);
+    state.Get(_fastestTime);
+    state.Get(along);
+    _alongReorgEnum = along;
+    if (fastest >= 0) _fastest = _hoppers[fastest];
+    if (_useQueue) {
+        vector <int32_t> positions;
+        state.Get(positions);
+        vector <hopper *> heap(positions.size());
+        for (unsigned int i = 0; i < heap.size(); i++) heap[i] = _hoppers[positions[i]];
+        _queue.Assign(heap);
+    }
+    if (_rejectionFree) _rateTree.RestoreState(state);
+    if (_coulombCutoff > 0.0) _cells.RestoreState(state, _graph);
+    if (_treeSum) _tree.RestoreState(state);
+    state.Get(_cutoffSumSqError);
+    state.Get(_cutoffMaxError);
+    state.Get(_cutoffSumSqHopError);
+    state.Get(_cutoffMaxHopError);
+    state.Get(_cutoffSamples);
+    state.Get(_cutoffHopSamples);
+    if (_rateUpdateTol > 0.0) {
+        state.Get(_dcDrift);
+        state.Get(_ratesStale);
+        vector <unsigned int> stale;
+        state.Get(stale);
+        _staleVertices.resize(stale.size());
+        for (unsigned int i = 0; i < stale.size(); i++) _staleVertices[i] = _graph->GetVertex(stale[i]);
+    }
+    state.Get(_collectorCurrent);
+    state.Get(_generatorCurrent);
+    state.Get(_totalCurrent);
+    state.Get(_currentStore);
+    state.Get(_moves);
+    state.Get(_activeHoppersConverged);
+    state.Get(_activeHoppersConvergedTime);
+    state.Get(_run);
+    state.Get(_electrodeCoulomb);  // as it was, not as summed again by AddHopper
+    state.Get(_electrodeStep);
+    state.Get(_electrodeOccupy);
+    state.Get(_electrodeChanged);  // ... or marked by AddHopper
+    state.Get(_changedElectrodes);
+    state.Get(_testedElectrodes);
+    _electrodeSteps.RestoreState(state);
 }
 
 /***************************************
@@ -513,35 +864,67 @@ void hoppers::SetWaitTimes(double time) {
  *
  * TODO: Should merge these functions... 
  ***************************************/ 
-// Find the hopper iterator to pointer, given the vertex.  Return iterator.
-list <hopper *>::iterator hoppers::GetHopperIterator(vertex *v) {
-    map < vertex *, hopper * > :: iterator it_vert = _mapVertexToHopper.find(v);
-    list <hopper *>::iterator it_hop = _hoppers.begin();
-    for (int i=0; it_hop!=_hoppers.end(); i++, it_hop++) {
-        if ( *it_hop == it_vert->second ){ return it_hop; }
-    }
+// Find the hopper pointer, given the vertex.  Return Hopper.
+hopper* hoppers::GetHopper(vertex *v) {
+    if (_hopperOn[v->GetID()] >= 0) return _hoppers[_hopperOn[v->GetID()]];
     cout << "***ERROR*** : Thought vertex " << v->GetID() << " was occupied but can't find hopper\n";
     cout << "              " << v->IsOccupied() << '\t' << v->IsCollector() << '\t' << v->IsGenerator() << endl;
     cout << "Active hoppers = " << GetActive() << endl;
     cout << "Occupied vertices = "; _graph->PrintOccupied();
     exit(-1);
 }
-// Find the hopper pointer, given the vertex.  Return Hopper.
-hopper* hoppers::GetHopper(vertex* v) { return *GetHopperIterator(v); }
-// Find the hopper index, given the vertex. Return index.
-int hoppers::GetHopperNumber(vertex *v) { return distance(_hoppers.begin(), GetHopperIterator(v)); }
+// Find the hopper ID, given the vertex.  Return ID.
+int hoppers::GetHopperNumber(vertex *v) { 
+    int h = _hopperOn[v->GetID()];
+    return (h >= 0) ? _hoppers[h]->GetID() : -1;
+}
+// The most recently generated hopper that's still here
+double hoppers::GetGenerationTimeOfFinalHopper() {
+    if (_hoppers.empty()) return -1.0;
+    double time = _hoppers[0]->GetGenerationTime();
+    for (unsigned int h = 1; h < _hoppers.size(); h++) {
+        if (_hoppers[h]->GetGenerationTime() >= time) time = _hoppers[h]->GetGenerationTime();
+    }
+    return time;
+}
 
-tuple<int,int>hoppers::GetPop() {
-    int gen, trans;
-    gen = trans = 0;
-    list <hopper*>::iterator it_hop = _hoppers.begin();
-    for (int i = 0; it_hop != _hoppers.end(); i++, it_hop++) {
-        if ((*it_hop)->GetFrom()->IsGenerator())
-            gen++;
-        else
-            trans++;
-    }
-    tuple<int, int> pops = make_tuple(gen, trans);
-    return pops;
+// Report the errors found by 'MeasureCoulombCutoffError'
+void hoppers::PrintCoulombCutoffError() {
+    if ((_coulombCutoff <= 0.0 && !_treeSum) || _cutoffSamples == 0) return;
+    cout.precision(5);
+    cout << scientific;
+    if (_treeSum) cout << "> COULOMB TREE THETA = " << _coulombTheta << endl;
+    else cout << "> COULOMB CUT-OFF (Ang) = " << _coulombCutoff << endl;
+    cout << "> RMS / MAX ERROR IN COULOMB ENERGY OF EACH HOPPER (eV) = " 
+         << sqrt(_cutoffSumSqError / _cutoffSamples) << " / " << _cutoffMaxError << endl;
+    if (_cutoffHopSamples > 0) {
+        cout << "> RMS / MAX ERROR IN COULOMB ENERGY CHANGE OF EACH HOP (eV) = " 
+             << sqrt(_cutoffSumSqHopError / _cutoffHopSamples) << " / " << _cutoffMaxHopError << endl;
+    }
 }
 
+/***************************************
+ * KERNELS
+ * MoveFastest (see hoppers.h) is compiled into kmc for each kernel, 
+ * and calls these, compiled for the parts of the kernel that they 
+ * depend on.  The choices that aren't part of the kernel are still 
+ * made inside them (see kernel.h).
+ ***************************************/
+template void hoppers::SetHops_C<false>(const double &);
+template void hoppers::SetHops_C<true>(const double &);
+template void hoppers::GenerateAll<false, false>(const int &, const double &);
+template void hoppers::GenerateAll<false, true>(const int &, const double &);
+template void hoppers::GenerateAll<true, false>(const int &, const double &);
+template void hoppers::GenerateAll<true, true>(const int &, const double &);
+template void hoppers::Remove<false, false>(hopper *, const double &);
+template void hoppers::Remove<false, true>(hopper *, const double &);
+template void hoppers::Remove<true, false>(hopper *, const double &);
+template void hoppers::Remove<true, true>(hopper *, const double &);
+template double hoppers::Move<false, false>(hopper *, vertex *, double &);
+template double hoppers::Move<false, true>(hopper *, vertex *, double &);
+template double hoppers::Move<true, false>(hopper *, vertex *, double &);
+template double hoppers::Move<true, true>(hopper *, vertex *, double &);
+template int hoppers::SetSourceDrainOccupation<false, false>(const double &);
+template int hoppers::SetSourceDrainOccupation<false, true>(const double &);
+template int hoppers::SetSourceDrainOccupation<true, false>(const double &);
+template int hoppers::SetSourceDrainOccupation<true, true>(const double &);
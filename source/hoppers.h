@@ -27,6 +27,12 @@
 #include "graph.h"
 #include "vertex.h"
 #include "hopper.h"
+#include "eventqueue.h"
+#include "ratetree.h"
+#include "celllist.h"
+#include "ewald.h"
+#include "coulombtree.h"
+#include "kernel.h"
 #include "global.h"
 #include "vec.h"
 
@@ -35,24 +41,102 @@ using namespace std;
 class hoppers{
     private:
         int _nHoppers;  // number of active hoppers
-        list <hopper *> _hoppers; 
-        vector <double > _reciprocalCollectionTimes; 
+        vector <hopper *> _hoppers;  // active hoppers, in no particular order
+        vector <vertex *> _hopperVertices;  // where each of '_hoppers' is
+        int _onGenerators;  // how many of '_hoppers' are on generators (see GetPop)
+        // Each hopper is given an ID when it's generated, which it keeps 
+        //   however '_hoppers' is shuffled, and which is only given to 
+        //   another hopper once it has been removed
+        vector <int> _freeIDs;  // of hoppers that have been removed
+        int _nextID;  // the lowest ID never yet given out
+        // Memory for hoppers, kept from those that have been removed, so 
+        //   that regenerating them doesn't allocate.  Each spare holds a 
+        //   pointer to the next, so keeping them doesn't allocate either.
+        void * _spareHoppers;
+        void * HopperMemory() {
+            if (!_spareHoppers) return ::operator new(sizeof(hopper));
+            void * memory = _spareHoppers;
+            _spareHoppers = *(void **) memory;
+            return memory;
+        }
+        // Destroy 'H' (which unoccupies its vertex), but keep its memory
+        void DeleteHopper(hopper * H) {
+            H->~hopper();
+            *(void **) H = _spareHoppers;
+            _spareHoppers = H;
+        }
+        int NewID() {
+            if (_freeIDs.empty()) return _nextID++;
+            int ID = _freeIDs.back();
+            _freeIDs.pop_back();
+            return ID;
+        }
+        unsigned int _collectionEvents;  // number of hoppers collected
         double _totalReciprocalCollectionTimes;
-        list <hopper *>::iterator _fastest;  // hopper with most imminent hop time
+        hopper * _fastest;  // hopper with most imminent hop time
+        eventQueue _queue;  // hoppers ordered by waitTime
+        bool _useQueue;  // find _fastest from _queue rather than scanning _hoppers?
+        bool _checkQueue;  // ... and check the two agree (slow!)
+        bool _rejectionFree;  // choose hops with the BKL algorithm rather than FRM?
+        rateTree _rateTree;  // total rate to unoccupied neighbours of each occupied vertex (BKL only)
         double _fastestTime;  // time of most imminent hop
         int _alongReorgEnum; // index of reorganisation energy used for most imminent hop.
-        map < vertex *, hopper * >  _mapVertexToHopper;
+        vector <int> _hopperOn;  // position in '_hoppers' of the hopper on each vertex (by ID), or -1
         graph * _graph;
         int _printOccupation;  // track occupation of vertices?	
         bool _track;  // track the movement of charges?
         int _hopperInteractions;  // Coulombic interactions?
+        // Coulombic interactions may be cut off beyond '_coulombCutoff' 
+        //   (if > 0), in which case only hoppers in nearby '_cells' are 
+        //   looked at.  The potential is then 
+        //   erfc(_coulombDamping * r) / r - _coulombShift.
+        double _coulombCutoff;  // Ang
+        double _coulombDamping;  // Ang^-1
+        double _coulombShift;  // Ang^-1
+        cellList _cells;  // occupied vertices (only used with a cut-off)
+        bool _ewaldSum;  // include periodic images of hoppers ('pb' mode only)
+        ewald _ewald;
+        bool _treeSum;  // sum over distant hoppers with a Barnes-Hut tree?
+        double _coulombTheta;  // opening angle of the tree
+        coulombTree _tree;  // occupied vertices (only used with 'coulombSum tree')
+        // How well the cut-off (or tree) reproduces the exact Coulomb energies
+        double _cutoffSumSqError, _cutoffMaxError;  // energy of each hopper
+        double _cutoffSumSqHopError, _cutoffMaxHopError;  // change of energy of each hop
+        unsigned int _cutoffSamples, _cutoffHopSamples;
+        // With a 'rateUpdateTol' (eV) > 0, SetHops_C only updates the rates of 
+        //   hoppers that have just been generated or moved, or whose DCs may 
+        //   have drifted by more than '_rateUpdateTol' since their rates were
+        //   last updated.  The rest keep their waitTimes.
+        double _rateUpdateTol;
+        vector <double> _dcDrift;  // largest possible change of any DC of each vertex (by ID)
+        vector <char> _ratesStale;  // 0: up to date, 1: drifted, 2: needs a new hop (by ID)
+        vector <vertex *> _staleVertices;
         // These are just used in FET simulations
         vector <vertex *> _generators; 
         vector <vertex *> _collectors; 
+        // The Coulomb energy at each of '_generators' and then '_collectors' 
+        //   due to every hopper, kept up to date as hoppers come, go and 
+        //   move, rather than summed again for every electrode every step
+        vector <double> _electrodeCoulomb;
+        vector <int> _electrodeOn;  // position of each vertex (by ID) in '_electrodeCoulomb', or -1
+        cellList _electrodeCells;  // the electrodes (only used with a cut-off)
+        // At every step each electrode is occupied with probability 
+        //   exp((E_F - E) / kT), independently of the step before.  Only the
+        //   electrodes whose energy or occupation has changed are tested at 
+        //   the next step.  Each of the others changes with a fixed chance 
+        //   at each step, so when it will next change is drawn once, from 
+        //   the geometric distribution, and kept in '_electrodeSteps'.
+        vector <double> _electrodeOccupy;  // exp((E_F - E) / kT) of each electrode when it was last tested
+        vector <char> _electrodeChanged;
+        vector <unsigned int> _changedElectrodes;  // to be tested at the next step
+        vector <unsigned int> _testingElectrodes;  // ... at this step
+        vector <unsigned int> _testedElectrodes;  // at the last step
+        stepQueue _electrodeSteps;
+        uint64_t _electrodeStep;  // steps made so far
         int _collectorCurrent;  // drain current
         int _generatorCurrent;  // source current
         int _totalCurrent;  
-        deque <double> _currentStore;  // store current (not geometric time bins!)
+        vector <double> _currentStore;  // store current (not geometric time bins!), oldest first
         int _moves;  // number of MC moves
         int _movesCycle;  // check convergence, update current every '_movesCycle'
         int _cyclesForConvergence;  //  current must be stable over this many cycles for convergence
@@ -62,65 +146,204 @@ class hoppers{
         double _tol, _lowerTol, _upperTol;  // tolerance of FET simulation result	
 
         void SetMap(){
-             _mapVertexToHopper.clear();
-             list <hopper *>::iterator it_hop;
-             for (it_hop = _hoppers.begin(); it_hop != _hoppers.end(); ++it_hop){
-                 vertex * from = (*it_hop)->GetFrom();
-                _mapVertexToHopper[from] = *it_hop;
+             _hopperOn.assign(_graph->GetNumberVertices(), -1);
+             _hopperVertices.resize(_hoppers.size());
+             for (unsigned int h = 0; h < _hoppers.size(); h++) {
+                 _hopperVertices[h] = _hoppers[h]->GetFrom();
+                 _hopperOn[_hopperVertices[h]->GetID()] = h;
+             }
+             if (_coulombCutoff > 0.0) {
+                 _cells.Clear();
+                 for (unsigned int h = 0; h < _hoppers.size(); h++)
+                     _cells.Insert(_hoppers[h]->GetFrom());
+             }
+             if (_treeSum) {
+                 _tree.Clear();
+                 for (unsigned int h = 0; h < _hoppers.size(); h++)
+                     _tree.Insert(_hoppers[h]->GetFrom());
              }
          } 
     // end of private:
     
     public:
         bool _run;  // run FET simulations whilst(_run).  UGLY!	
-        hoppers(){}
-        hoppers(graph * Graph, char * sim){
+        hoppers(){
+            _spareHoppers=NULL;
+        }
+        hoppers(graph * Graph, const simParameters & sim){
+            _spareHoppers=NULL;
             _activeHoppersConverged=false;
-            _printOccupation=atoi(Read(sim, "printOccupation","0.0").c_str());
-            _hopperInteractions =atoi(Read(sim, "hopperInteractions", "0.0").c_str());
+            _printOccupation=sim.GetFlag("printOccupation");
+            _hopperInteractions =sim.GetFlag("hopperInteractions");
             _graph = Graph;
+            _hopperOn.assign(_graph->GetNumberVertices(), -1);
             _nHoppers=0;
+            _onGenerators=0;
+            _nextID=0;
+            _electrodeStep=0;
             _generatorCurrent=0;
             _collectorCurrent=0;
             _totalReciprocalCollectionTimes=0.0;
-            _track = (Read(sim, "track", "0") == "1");
-            if (Read(sim, "mode","tof")=="fet") {
+            _collectionEvents=0;
+            _totalCurrent=0;
+            _moves=0;
+            _activeHoppersConvergedTime=0.0;
+            _run=false;
+            _track = sim.GetFlag("track");
+            string queue = sim.Get("eventQueue");
+            if (queue != "heap" && queue != "scan" && queue != "check")
+                ERROR(-1, "Don't understand eventQueue " + queue + " (expect heap, scan or check)");
+            _useQueue = (queue != "scan");
+            _checkQueue = (queue == "check");
+            string algorithm = sim.Get("algorithm");
+            if (algorithm != "frm" && algorithm != "bkl")
+                ERROR(-1, "Don't understand algorithm " + algorithm + " (expect frm or bkl)");
+            _rejectionFree = (algorithm == "bkl");
+            if (_rejectionFree) {
+                _useQueue = false;  // waitTimes are no longer used to choose hops
+                _rateTree.Resize(_graph->GetNumberVertices());
+            }
+            _coulombCutoff = 0.0;
+            _coulombDamping = 0.0;
+            _coulombShift = 0.0;
+            _cutoffSumSqError = _cutoffMaxError = 0.0;
+            _cutoffSumSqHopError = _cutoffMaxHopError = 0.0;
+            _cutoffSamples = _cutoffHopSamples = 0;
+            if (_hopperInteractions) {
+                _coulombCutoff = sim.GetNumber("coulombCutoff");
+                if (_coulombCutoff < 0.0)
+                    ERROR(-1, "coulombCutoff must be positive (or 0 for no cut-off)");
+            }
+            _ewaldSum = false;
+            _treeSum = false;
+            _coulombTheta = 0.0;
+            if (_hopperInteractions) {
+                string sum = sim.Get("coulombSum");
+                if (sum != "direct" && sum != "ewald" && sum != "tree")
+                    ERROR(-1, "Don't understand coulombSum " + sum + " (expect direct, ewald or tree)");
+                _ewaldSum = (sum == "ewald");
+                _treeSum = (sum == "tree");
+            }
+            if (_treeSum) {
+                if (_graph->IsPeriodic())
+                    ERROR(-1, "coulombSum tree can't be used with periodic boundaries (use coulombSum ewald)");
+                if (_coulombCutoff > 0.0)
+                    ERROR(-1, "Can't use coulombCutoff with coulombSum tree");
+                _coulombTheta = sim.GetNumber("coulombTheta");
+                if (_coulombTheta <= 0.0 || _coulombTheta >= 1.0)
+                    ERROR(-1, "coulombTheta must be between 0 and 1");
+                _tree.Setup(_graph, _coulombTheta);
+            }
+            if (_ewaldSum) {
+                if (!_graph->IsPeriodic())
+                    ERROR(-1, "coulombSum ewald needs periodic boundaries (mode pb)");
+                if (_coulombCutoff > 0.0)
+                    ERROR(-1, "Can't use coulombCutoff with coulombSum ewald");
+                _ewald.Setup(_graph->GetSizeX(), _graph->GetSizeY(), _graph->GetSizeZ(),
+                             sim.GetInteger("ewaldGrid"));
+                cout << "Largest error in tabulated Ewald potential = " 
+                     << _ewald.CheckAccuracy(4) * _graph->_coulombPrefactor << " eV\n";
+            }
+            if (_coulombCutoff > 0.0) {
+                string potential = sim.Get("coulombPotential");
+                if (potential == "truncated") _coulombShift = 0.0;
+                else if (potential == "shifted") _coulombShift = 1.0 / _coulombCutoff;
+                else if (potential == "damped") {
+                    _coulombDamping = sim.Has("coulombDamping") ? sim.GetNumber("coulombDamping") : 2.0 / _coulombCutoff;
+                    _coulombShift = erfc(_coulombDamping * _coulombCutoff) / _coulombCutoff;
+                }
+                else
+                    ERROR(-1, "Don't understand coulombPotential " + potential + " (expect truncated, shifted or damped)");
+                // A hopper changes the energy of every hop that ends within the 
+                //   cut-off, so the cells must also reach the hopper making the hop.
+                _cells.Setup(_graph, _coulombCutoff + _graph->GetMaxEdgeLength());
+            }
+            if (sim.Get("mode")=="fet") {
                 _generators= _graph->GetGenerators();
                 _collectors= _graph->GetCollectors();
                 if (VERBOSITY_HIGH) {
                     cout << "Initialised " << _generators.size() 
                          << " generators and " << _collectors.size() << " collectors\n";
                 }
+                _electrodeCoulomb.assign(_generators.size() + _collectors.size(), 0.0);
+                _electrodeOn.assign(_graph->GetNumberVertices(), -1);
+                for (unsigned int i = 0; i < _generators.size(); i++) 
+                    _electrodeOn[_generators[i]->GetID()] = i;
+                for (unsigned int i = 0; i < _collectors.size(); i++) 
+                    _electrodeOn[_collectors[i]->GetID()] = _generators.size() + i;
+                if (_coulombCutoff > 0.0) {
+                    _electrodeCells.Setup(_graph, _coulombCutoff);
+                    for (unsigned int i = 0; i < _generators.size(); i++) _electrodeCells.Insert(_generators[i]);
+                    for (unsigned int i = 0; i < _collectors.size(); i++) _electrodeCells.Insert(_collectors[i]);
+                }
+                unsigned int nElectrodes = _electrodeCoulomb.size();
+                _electrodeOccupy.assign(nElectrodes, 0.0);
+                _changedElectrodes.reserve(nElectrodes);
+                _testingElectrodes.reserve(nElectrodes);
+                _testedElectrodes.reserve(nElectrodes);
+                _electrodeSteps.Setup(nElectrodes);
+                ResetElectrodes();
                 _currentStore.assign(15, 0);
-                _maxTime=atof(Read(sim,"maxTime").c_str());
+                _maxTime=sim.GetNumber("maxTime");
                 _activeHoppersConvergedTime=0.0;
                 _activeHoppersConverged=false;
                 _run=true;
-                _tol=atof(Read(sim,"tol","0.0").c_str());
+                _tol=sim.GetNumber("tol");
                 _upperTol=1.0+_tol;
                 _lowerTol=1.0-_tol;
                 _moves=0;
-                _movesCycle = (int) atof(Read(sim,"movesCycle","2e4").c_str());
-                _cyclesForConvergence = atoi(Read(sim,"cyclesForConvergence","15").c_str());
-                if (Read(sim,"converged","0")=="1") {
+                _movesCycle = (int) sim.GetNumber("movesCycle");
+                _cyclesForConvergence = sim.GetInteger("cyclesForConvergence");
+                if (sim.GetFlag("converged")) {
                     _activeHoppersConverged=true;
                     _activeHoppersConvergedTime=0.0;
                 }
             }	
+            _rateUpdateTol = 0.0;
+            if (_hopperInteractions) {
+                _rateUpdateTol = sim.GetNumber("rateUpdateTol");
+                if (_rateUpdateTol < 0.0)
+                    ERROR(-1, "rateUpdateTol must be positive (or 0 to update every hopper after every hop)");
+            }
+            if (_rateUpdateTol > 0.0) {
+                _dcDrift.assign(_graph->GetNumberVertices(), 0.0);
+                _ratesStale.assign(_graph->GetNumberVertices(), 0);
+            }
             _fastestTime=0.0;
+            _alongReorgEnum=-1;
         }
         ~hoppers(){
             softClear();
+            while (_spareHoppers) ::operator delete(HopperMemory());
         }
         void softClear() {
-            map < vertex *, hopper *>::iterator it_map = _mapVertexToHopper.begin();
-            for (; it_map != _mapVertexToHopper.end(); ++it_map){
-                delete (it_map -> second );            
+            for (unsigned int h = 0; h < _hoppers.size(); h++) {
+                _hopperOn[_hoppers[h]->GetFrom()->GetID()] = -1;
+                if (_graph->_keepOccupations) _hoppers[h]->GetFrom()->EndOccupation(_hoppers[h]->GetWaitTime());
+                if (_hoppers[h]->GetFrom()->IsGenerator()) _graph->SetGeneratorEmpty(_hoppers[h]->GetFrom(), true);
+                DeleteHopper(_hoppers[h]);
             }
             _hoppers.clear();
+            _hopperVertices.clear();
+            _onGenerators=0;
+            _freeIDs.clear();
+            _nextID=0;
+            fill(_electrodeCoulomb.begin(), _electrodeCoulomb.end(), 0.0);
+            ResetElectrodes();
+            _queue.Clear();
+            if (_coulombCutoff > 0.0) _cells.Clear();
+            if (_treeSum) _tree.Clear();
+            for (unsigned int i = 0; i < _staleVertices.size(); i++) {
+                _dcDrift[_staleVertices[i]->GetID()] = 0.0;
+                _ratesStale[_staleVertices[i]->GetID()] = 0;
+            }
+            _staleVertices.clear();
+            if (_rejectionFree) {
+                _rateTree.Clear();
+                _fastestTime=0.0;
+            }
             _nHoppers=0;
-            _mapVertexToHopper.clear();
-            if (_hoppers.size() != 0 || _mapVertexToHopper.size() != 0 ) {
+            if (_hoppers.size() != 0) {
                 cerr << "*** ERROR *** : softClear failed in hoppers.h\n"; 
                 exit(-1);
             }
@@ -128,54 +351,147 @@ class hoppers{
             
         /***********************************
         * DO'S
+        * Those made for every hop are compiled for each kernel (see 
+        * kernel.h), or for the parts of it that they depend on.
         ************************************/
-        void Generate(vertex * , const double &);
+        template <bool interactions, bool occupation> void Generate(vertex * , const double &);
+        void Generate(vertex * , const double &);  // for setting up, before the kernel is chosen
         int GenerateOnPreviouslyOccupied(char *, const double &); 
         int GenerateOccProb(const double & time);
-        void GenerateAll(const int & nHoppers, const double & time);	
+        template <bool interactions, bool occupation> void GenerateAll(const int & nHoppers, const double & time);	
+        void AddHopper(hopper *);
+        void RemoveHopper(hopper *);
+        void MoveHopper(hopper *, vertex *);
         void GenerateRandom_F(const int & nHoppers, const double & time);
-        int SetSourceDrainOccupation(const double & time);
-        void Remove(list <hopper *>::iterator, const double & );	 	
-        double Move(list <hopper *>::iterator , vertex *, double & );
-        double MoveFastest_C() ;						
-        double MoveFastest_RCI() ;					
-        double MoveFastest_R() ;				
-        double MoveFastest_PB() ;
-        double MoveFastest_F() ;			
+        template <bool interactions, bool occupation> int SetSourceDrainOccupation(const double & time);
+        int SetSourceDrainOccupation(const double & time);  // for setting up, before the kernel is chosen
+        template <bool interactions, bool occupation> void Remove(hopper *, const double & );	 	
+        template <bool interactions, bool occupation> double Move(hopper *, vertex *, double & );
+        template <class K> double MoveFastest();  // for kernel 'K' (see below)
         void FindFastest();				
+        void ScanFastest();				
+        void ChooseNextEvent();
+        void UpdateRate(vertex *);
+        void UpdateRatesAround(vertex *);
         void SetWaitTimes(double time);
+        void AddCollections(hoppers &);
         void SetActiveHoppersConverged() {_activeHoppersConverged=true;}
         void FETConvergence();
         void activeHoppersConvergence();
-        void SetHops_C(const double &);	
-        void AddCoulomb(vertex *, int sign=1 );	
-        void UpdateCoulomb_all(vertex *,int);
-        void UpdateCoulomb_single(vertex *, vertex *, int);
-        void DeleteCoulomb(vertex *);		
+        template <bool millerAbrahams> void SetHops_C(const double &);	
+        // The rates of 'v' after its DCs have changed
+        template <bool millerAbrahams> void UpdateVertexRates(vertex * v) {
+            if (millerAbrahams) v->UpdateRates_CMA();
+            else v->UpdateRates_C();
+        }
+        void MarkRatesStale(vertex *, double change, bool newHop=false);
+        template <bool occupation> void AddCoulomb(vertex *, int sign=1 );	
+        template <bool occupation> void UpdateCoulomb_all(vertex *,int);
+        template <bool occupation> void UpdateCoulomb_single(vertex *, vertex *, int);
+        void UpdateElectrodeCoulomb(vertex *, int);
+        void ResetElectrodes();
+        void ElectrodeChanged(unsigned int e) {
+            if (_electrodeChanged[e]) return;
+            _electrodeChanged[e] = 1;
+            _changedElectrodes.push_back(e);
+        }
+        void ScheduleElectrode(unsigned int, uint64_t);
+        template <bool interactions, bool occupation> void SetElectrode(unsigned int, bool, const double &);
+        template <bool occupation> void DeleteCoulomb(vertex *);		
         double const GetSingleCoulombEnergy(vertex *, vertex *);
         double GetAllCoulombEnergies(vertex *, vertex *);
+        void MeasureCoulombCutoffError();
+
+        /***********************************
+         * CHECKPOINTS
+         * The hoppers, and everything that depends on where they are.  
+         * The vertices are restored by the graph.
+        ************************************/
+        void SaveState(stateBuffer &) const;
+        void RestoreState(stateBuffer &);
 
         /***********************************
          * GET'S
         ************************************/
         double GetFETCurrent()  {return _currentStore.back();}
         hopper * GetHopper(vertex * v);
-        list <hopper *>::iterator GetHopperIterator(vertex * v);
-        int GetHopperNumber(vertex * v);
+        int GetHopperNumber(vertex * v);  // ID of the hopper on 'v', or -1
         const int GetActive() const  {return _nHoppers;}
-        const double & GetFastestTime () const	{return (*_fastest)->GetWaitTime();}
-        const int & GetFastestReorgEnum() const { return (*_fastest)->GetAlong(); }
-        vec GetFastestPos  () const  {return (*_fastest)->GetFrom()->GetPos();}
-        double  GetFastestZ  () const  {return (*_fastest)->GetFrom()->GetZ();}
-        const double  & GetFastestDz  () const  {return (*_fastest)->GetDz();}
+        const double & GetFastestTime () const	{return _fastest->GetWaitTime();}
+        const int & GetFastestReorgEnum() const { return _fastest->GetAlong(); }
+        vec GetFastestPos  () const  {return _fastest->GetFrom()->GetPos();}
+        double  GetFastestZ  () const  {return _fastest->GetFrom()->GetZ();}
+        const double  & GetFastestDz  () const  {return _fastest->GetDz();}
         double GetSumReciprocalCollTimes()  {return _totalReciprocalCollectionTimes;}
-        double GetGenerationTimeOfFinalHopper() { if (_hoppers.empty()) return -1.0; else return _hoppers.back()->GetGenerationTime(); }
-        unsigned int GetTotalCollectionEvents()  {return _reciprocalCollectionTimes.size();}
-        tuple<int,int> GetPop();
+        double GetGenerationTimeOfFinalHopper();
+        unsigned int GetTotalCollectionEvents()  {return _collectionEvents;}
+        // Hoppers on generators, and elsewhere.  O(1).
+        tuple<int,int> GetPop() const {return make_tuple(_onGenerators, (int) _hoppers.size() - _onGenerators);}
         void PrintOccupiedVertices(string dest="");
+        void PrintCoulombCutoffError();
         int GetCollectorCurrent()  {return _collectorCurrent;}
         int GetGeneratorCurrent()  {return _generatorCurrent;}
     // end of public:
 };
+
+/**********************************************************************
+ * MOVE FASTEST
+ * Make the most imminent hop, and everything else that has to be done 
+ * after it, for kernel 'K'.  Here, rather than in hoppers.cc, so that 
+ * it's compiled into kmc's loop for each kernel.  Returns the distance
+ * moved along 'z'.
+ ***********************************************************************/
+template <class K>
+double hoppers::MoveFastest() {
+    vertex * to = _fastest->GetTo();
+    double fastestTime = GetFastestTime();
+    double dz;
+    if (K::mode == MODE_FET) {
+        dz = Move<K::interactions, K::occupation>(_fastest, to, fastestTime);
+        _totalCurrent = _generatorCurrent + _collectorCurrent;
+        SetSourceDrainOccupation<K::interactions, K::occupation>(fastestTime); 
+        SetHops_C<K::millerAbrahams>(fastestTime);
+        // Check there are still hoppers 
+        if (_nHoppers == 0) { 
+            cout << "!!! WARNING !!! : Ran out of hoppers\n";
+            WARNINGS++;
+            _run = false;
+            return .0;
+        }
+        FindFastest();        
+        ++_moves;
+        // Check if maxTime has been exceeded
+        if (GetFastestTime() > _maxTime) {
+            cout << "!!! WARNING !!! : maxTime exceeded!  Time = " << GetFastestTime() << endl;
+            WARNINGS++;
+            _run=false;
+            return .0;
+        }
+        // Check for convergence
+        if ( _moves==_movesCycle ) {
+            _moves=0;
+            if (_activeHoppersConverged) FETConvergence(); 
+            else activeHoppersConvergence();
+        }
+        return dz;
+    }
+    // Hoppers are collected in the tof and regenerate modes (but not pb), 
+    //   and in regenerate mode, replaced
+    if ((K::mode == MODE_TOF || K::mode == MODE_REGENERATE) && to->IsCollector()) {
+        _collectionEvents++;
+        if (K::mode == MODE_TOF) _totalReciprocalCollectionTimes += 1.0 / fastestTime;
+        else _totalReciprocalCollectionTimes += 1.0 / (fastestTime - _fastest->GetGenerationTime());
+        dz = GetFastestDz();
+        Remove<K::interactions, K::occupation>(_fastest, fastestTime);
+        if (K::mode == MODE_REGENERATE) GenerateAll<K::interactions, K::occupation>(1, fastestTime);
+    }
+    else dz = Move<K::interactions, K::occupation>(_fastest, to, fastestTime);
+    // With interactions, the hop has changed the Coulomb energies, so update 
+    //   the rates, and give the hopper that has just moved a new hop 
+    //   (tof has no interactions: see CheckSim)
+    if (K::interactions) SetHops_C<K::millerAbrahams>(fastestTime);
+    FindFastest();
+    return dz;
+}
 #endif	/* _HOPPER_H */
 
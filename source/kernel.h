@@ -0,0 +1,59 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * A 'kernel' is what the hop-by-hop part of a simulation is compiled 
+ * for: its mode, whether hoppers interact, whether rates are 
+ * Miller-Abrahams rather than Marcus (which only matters when they are
+ * recalculated as hoppers move), and whether the occupation of each 
+ * vertex is kept ('printOccupation', 'printEnergies' or 'track').
+ * kmc::FRM and kmc::FRM_FET choose the kernel once, and its loop is
+ * compiled for it, so none of these choices is made again for each hop.
+ * hoppers::MoveFastest is inlined into that loop.  What it calls (Move,
+ * Remove, GenerateAll, SetHops_C and SetSourceDrainOccupation) is 
+ * compiled for the kernel too, but out of line (see the end of 
+ * hoppers.cc), to keep the binary small.
+ * 
+ * The kernel is not fully specialised: 'algorithm', 'eventQueue', 
+ * 'coulombCutoff', 'coulombSum' tree, 'rateUpdateTol' and 'track' are 
+ * still tested in those functions for each hop.  Each is a flag that 
+ * never changes during a simulation, so the branches are predicted, 
+ * and each would double the number of kernels.
+ ********************************************************************/
+#ifndef _KERNEL_H
+#define	_KERNEL_H
+#include <string>
+
+using namespace std;
+
+enum simMode {MODE_TOF, MODE_REGENERATE, MODE_PB, MODE_FET};
+
+template <int Mode, bool Interactions, bool MillerAbrahams, bool Occupation>
+struct kernel{
+    static const int mode = Mode;
+    static const bool interactions = Interactions;
+    static const bool millerAbrahams = MillerAbrahams;
+    static const bool occupation = Occupation;
+    static string Describe() {
+        const char * modes[] = {"tof", "regenerate", "pb", "fet"};
+        return string(modes[Mode]) 
+             + (Interactions ? ", with hopperInteractions" : "")
+             + (MillerAbrahams ? ", Miller-Abrahams rates" : "")
+             + (Occupation ? ", keeping occupations" : "");
+    }
+};
+#endif	/* _KERNEL_H */
@@ -18,8 +18,47 @@
 // TODO: merge these functions?
 // TODO: Make sure timeout functionality works correctly on different system types.
 // TODO: Display warning if simulation time exceeded when this is not the expected conditon for simulation finishing.
-// Simple First Reaction Method
+#ifdef countAllocations
+// Stop at any heap 'allocations' (see global.h)
+static void CheckAllocations(unsigned long allocations, const string & during) {
+    if (allocations == 0) return;
+    ERROR(-1, to_string(allocations) + " heap allocations during " + during);
+}
+#endif
+// Simple First Reaction Method.  Choose the kernel (see kernel.h) for 
+//   this simulation, once, and run the loop compiled for it.  Without 
+//   hopperInteractions, rates are never recalculated, so the hopping 
+//   model doesn't matter (and tof has no hopperInteractions: see CheckSim).
 void kmc::FRM() {
+    bool occupation = _graph->_keepOccupations;
+    bool millerAbrahams = _graph->_millerAbrahams;
+    if (_mode == "tof") ChooseFRM<MODE_TOF, false, false>(occupation);
+    else if (_mode == "regenerate") {
+        if (!_hopperInteractions) ChooseFRM<MODE_REGENERATE, false, false>(occupation);
+        else if (millerAbrahams) ChooseFRM<MODE_REGENERATE, true, true>(occupation);
+        else ChooseFRM<MODE_REGENERATE, true, false>(occupation);
+    }
+    else if (_mode == "pb") {
+        if (!_hopperInteractions) ChooseFRM<MODE_PB, false, false>(occupation);
+        else if (millerAbrahams) ChooseFRM<MODE_PB, true, true>(occupation);
+        else ChooseFRM<MODE_PB, true, false>(occupation);
+    }
+    else ERROR(-1, "Don't understand mode " + _mode + " (expect tof, regenerate, pb or fet)");
+}
+//
+template <int mode, bool interactions, bool millerAbrahams>
+void kmc::ChooseFRM(bool occupation) {
+    if (occupation) FRM_Kernel<kernel<mode, interactions, millerAbrahams, true> >();
+    else FRM_Kernel<kernel<mode, interactions, millerAbrahams, false> >();
+}
+// FRM for kernel 'K'
+template <class K>
+void kmc::FRM_Kernel() {
+    if (VERBOSITY_HIGH) cout << "Using the kernel for " << K::Describe() << endl;
+    if (_threads > 1) {
+        FRM_Parallel<K>();
+        return;
+    }
     _mu = 1e50;
     double prevMu = 1e50;
     double changeInMu = 1e50;
@@ -33,30 +72,36 @@ void kmc::FRM() {
     }
     
     _run = 0;
+    bool resumed = Resume();  // part of the way through run '_run'
     while (!interrupted) {  // entire simulation...
+        #ifdef countAllocations
+        unsigned long allocations = ALLOCATIONS;
+        #endif
 
-        if (_run >= _maxRuns) {
-            cout << "!!! WARNING !!! : Mobility not converged, maxRuns reached.\n";
-            WARNINGS++;
-            break;
-        }
-        else _run++;
+        if (!resumed) {
+            if (_run >= _maxRuns) {
+                cout << "!!! WARNING !!! : Mobility not converged, maxRuns reached.\n";
+                WARNINGS++;
+                break;
+            }
+            else _run++;
 
-        _Hoppers->GenerateAll(_nHoppers, 0.0);
-        if (_hopperInteractions) _Hoppers->SetHops_C(0.0);
-        _Hoppers->FindFastest();
-        _time=0.0;
+            // Each run has its own stream of random numbers (see FRM_Parallel)
+            Random.SetStream(_run);
+            _Hoppers->GenerateAll<K::interactions, K::occupation>(_nHoppers, 0.0);
+            if (K::interactions) _Hoppers->SetHops_C<K::millerAbrahams>(0.0);
+            _Hoppers->FindFastest();
+            _time=0.0;
+        }
+        resumed = false;
         while (_Hoppers->GetActive()>0) {  // single run...
             _time = _Hoppers->GetFastestTime();
             hopReorgEnum = _Hoppers->GetFastestReorgEnum();
             if (hopReorgEnum >= 0) _hops[hopReorgEnum]++;
-            dz = (_Hoppers->*moveFastest)();
+            dz = _Hoppers->MoveFastest<K>();
             _sum_dz+=dz;
 
-            auto pop = _Hoppers->GetPop();
-            int popgen, poptran;
-            tie(popgen, poptran) = pop;
-            UpdatePhotocurrent(dz,popgen,poptran);
+            UpdatePhotocurrent(dz);
             if (_time > _maxTime) break;
             if (_timeoutMinutes) {
                 if (_mutex.try_lock()) {
@@ -66,6 +111,7 @@ void kmc::FRM() {
                     WARNINGS++;
                     interrupted = true;
                     _mutex.unlock();
+                    if (_checkpoint) WriteCheckpoint(true);
                     break;
                 }
             }
@@ -73,10 +119,17 @@ void kmc::FRM() {
                 cout << "!!! WARNING !!! : Received interrupt or terminate signal, ending KMC...\n";
                 WARNINGS++;
                 interrupted = true;
+                if (_checkpoint) WriteCheckpoint(true);
                 break;
             }
+            if (_checkpoint && _checkpoint->Due()) WriteCheckpoint(false);
         }
+        #ifdef countAllocations
+        allocations = ALLOCATIONS - allocations;  // before the message is made
+        if (_run > 1) CheckAllocations(allocations, "run " + to_string(_run));
+        #endif
         _totalTimeOverAllRuns += _time;
+        if (K::interactions) _Hoppers->MeasureCoulombCutoffError();
         
         AveragePopOverRuns();
 
@@ -101,20 +154,224 @@ void kmc::FRM() {
         _Hoppers->softClear();
         _graph->ClearDCs();
     }
+    if (_checkpoint && !interrupted) _checkpoint->Remove();
 }
-// First reaction method with all the necessary ancillary functions to handle FETs
-void kmc::FRM_FET() {
-    _Hoppers->SetHops_C(0.0);
+// FRM, making '_threads' independent runs at once.  Each thread has its 
+//   own copy of the kmc, the hoppers and the vertices (the edges are 
+//   shared), and each run has its own stream of random numbers, just as 
+//   in FRM.  The runs of each batch are then added up in order, so the 
+//   results are the same as FRM's, whatever the number of threads.
+template <class K>
+void kmc::FRM_Parallel() {
+    _mu = 1e50;
+    double prevMu = 1e50;
+    double changeInMu = 1e50;
+
+    if (_timeoutMinutes) {
+        thread timeoutThread(&kmc::SleepUntilTimeout, this);
+        timeoutThread.detach();
+    }
+
+    vector <graph *> graphs(_threads);
+    vector <hoppers *> hoppersOf(_threads);
+    vector <kmc *> copies(_threads);
+    for (int t = 0; t < _threads; t++) {
+        graphs[t] = new graph(*_graph);
+        hoppersOf[t] = new hoppers(graphs[t], *_sim);
+        copies[t] = new kmc(*_sim, hoppersOf[t], _nHoppers, graphs[t], 0);
+        copies[t]->_master = this;
+    }
+    cout << "Making up to " << _threads << " runs at once\n";
+
+    _run = 0;
+    bool finished = false;
+    bool interrupted = false;
+    while (!finished) {  // entire simulation...
+
+        if (_run >= _maxRuns) {
+            cout << "!!! WARNING !!! : Mobility not converged, maxRuns reached.\n";
+            WARNINGS++;
+            break;
+        }
+        int batch = _threads;
+        if (_maxRuns - _run < batch) batch = int(_maxRuns - _run);
+
+        vector <thread> pool;
+        for (int t = 0; t < batch; t++) 
+            pool.push_back(thread(&kmc::SingleRun<K>, copies[t], _run + t + 1, Random.GetSeed()));
+        for (int t = 0; t < batch; t++) 
+            pool[t].join();
+
+        for (int t = 0; t < batch && !finished; t++) {
+            _run++;
+            AddRun(*copies[t]);
+
+            prevMu = _mu;
+            _mu = _sum_dz * 1e-16 / (_totalTimeOverAllRuns * _nHoppers * -_graph->GetFieldZ());
+            changeInMu = _mu / prevMu;
+
+            if (VERBOSITY_HIGH) {
+                cout << "Run number " << _run
+                     << ": Hoppers left = " << copies[t]->_hoppersLeft
+                     << "; Mobility (cm^2/V.s) = " << _mu;
+                if (_run > 1) cout << "; Fractional change of mob. = " << changeInMu;
+                cout << endl << flush;
+            }
+
+            if (copies[t]->_interrupted) {
+                interrupted = true;
+                finished = true;
+            }
+            if (_run > 1 && changeInMu > _lowerTol && changeInMu < _upperTol) {
+                cout << "Mobility converged" << endl;
+                finished = true;
+            }
+        }
+    }
+    if (interrupted) {
+        if (RECEIVED_TERM_SIGNAL) 
+            cout << "!!! WARNING !!! : Received interrupt or terminate signal, ending KMC...\n";
+        else
+            cout << "!!! WARNING !!! : Timeout triggered, ending KMC...\n";
+        WARNINGS++;
+    }
+
+    for (int t = 0; t < _threads; t++) {
+        delete copies[t];
+        delete hoppersOf[t];
+        delete graphs[t];
+    }
+}
+// Make run number 'run' on this copy of the kmc (see FRM_Parallel), 
+//   starting from nothing.
+template <class K>
+void kmc::SingleRun(int run, uint64_t seed) {
+    double dz;
+    int hopReorgEnum;
+    Random.Seed(seed, run);
+
+    fill(_current.begin(), _current.end(), 0.0);
+    fill(_popgen_run.begin(), _popgen_run.end(), 0);
+    fill(_poptrans_run.begin(), _poptrans_run.end(), 0);
+    fill(_popgen.begin(), _popgen.end(), 0);
+    fill(_poptrans.begin(), _poptrans.end(), 0);
+    fill(_hops.begin(), _hops.end(), 0);
+    _sum_dz = 0.0;
+    _geometricBin = 0;
+    _interrupted = false;
+
+    _Hoppers->GenerateAll<K::interactions, K::occupation>(_nHoppers, 0.0);
     _Hoppers->FindFastest();
     _time=0.0;
+    while (_Hoppers->GetActive()>0) {  // single run...
+        _time = _Hoppers->GetFastestTime();
+        hopReorgEnum = _Hoppers->GetFastestReorgEnum();
+        if (hopReorgEnum >= 0) _hops[hopReorgEnum]++;
+        dz = _Hoppers->MoveFastest<K>();
+        _sum_dz+=dz;
+
+        UpdatePhotocurrent(dz);
+        if (_time > _maxTime) break;
+        if (_master->_timedOut || RECEIVED_TERM_SIGNAL) {
+            _interrupted = true;
+            break;
+        }
+    }
+    AveragePopOverRuns();
+    _hoppersLeft = _Hoppers->GetActive();
+    _Hoppers->softClear();
+}
+// Add the results of the last run made by 'copy' to the totals
+void kmc::AddRun(kmc & copy) {
+    if (copy._nLogTimeBins > _nLogTimeBins) {
+        _nLogTimeBins = copy._nLogTimeBins;
+        _current.resize(_nLogTimeBins);
+        _popgen_run.resize(_nLogTimeBins);
+        _poptrans_run.resize(_nLogTimeBins);
+        _popgen.resize(_nLogTimeBins);
+        _poptrans.resize(_nLogTimeBins);
+    }
+    for (int i = 0; i < copy._nLogTimeBins; i++) {
+        _current[i] += copy._current[i];
+        _popgen[i] += copy._popgen[i];
+        _poptrans[i] += copy._poptrans[i];
+    }
+    for (unsigned int k = 0; k < _hops.size(); k++) _hops[k] += copy._hops[k];
+    _sum_dz += copy._sum_dz;
+    _time = copy._time;
+    _totalTimeOverAllRuns += copy._time;
+    _Hoppers->AddCollections(*copy._Hoppers);
+}
+// First reaction method with all the necessary ancillary functions to handle FETs.
+//   As FRM, the kernel is chosen once.
+void kmc::FRM_FET() {
+    bool occupation = _graph->_keepOccupations;
+    bool millerAbrahams = _graph->_millerAbrahams;
+    if (!_hopperInteractions) {
+        if (millerAbrahams) ChooseFRM_FET<false, true>(occupation);
+        else ChooseFRM_FET<false, false>(occupation);
+    }
+    else if (millerAbrahams) ChooseFRM_FET<true, true>(occupation);
+    else ChooseFRM_FET<true, false>(occupation);
+}
+//
+template <bool interactions, bool millerAbrahams>
+void kmc::ChooseFRM_FET(bool occupation) {
+    if (occupation) FRM_FET_Kernel<kernel<MODE_FET, interactions, millerAbrahams, true> >();
+    else FRM_FET_Kernel<kernel<MODE_FET, interactions, millerAbrahams, false> >();
+}
+// FRM_FET for kernel 'K'
+template <class K>
+void kmc::FRM_FET_Kernel() {
+    if (VERBOSITY_HIGH) cout << "Using the kernel for " << K::Describe() << endl;
+    bool interrupted = false;
+    if (_timeoutMinutes) {
+        thread timeoutThread(&kmc::SleepUntilTimeout, this);
+        timeoutThread.detach();
+    }
+    if (!Resume()) {
+        _Hoppers->SetHops_C<K::millerAbrahams>(0.0);
+        _Hoppers->FindFastest();
+        _time=0.0;
+    }
+    #ifdef countAllocations
+    const unsigned int warmUp = 100000;  // moves, before allocations are counted
+    unsigned int moves = 0;
+    unsigned long allocations = 0;
+    #endif
     while ( _Hoppers->_run ) {
         _time  = _Hoppers->GetFastestTime();
-        (_Hoppers->*moveFastest)();
+        _Hoppers->MoveFastest<K>();
+        #ifdef countAllocations
+        if (++moves == warmUp) allocations = ALLOCATIONS;
+        #endif
+        if (!_Hoppers->_run) break;
+        if (_timeoutMinutes && _timedOut) {
+            cout << "!!! WARNING !!! : Timeout triggered, ending KMC...\n";
+            WARNINGS++;
+            interrupted = true;
+            if (_checkpoint) WriteCheckpoint(true);
+            break;
+        }
+        if (RECEIVED_TERM_SIGNAL) {
+            cout << "!!! WARNING !!! : Received interrupt or terminate signal, ending KMC...\n";
+            WARNINGS++;
+            interrupted = true;
+            if (_checkpoint) WriteCheckpoint(true);
+            break;
+        }
+        if (_checkpoint && _checkpoint->Due()) WriteCheckpoint(false);
     }
+    #ifdef countAllocations
+    allocations = ALLOCATIONS - allocations;
+    if (moves > warmUp) CheckAllocations(allocations, "the last " + to_string(moves - warmUp) + " moves");
+    #endif
+    if (_checkpoint && !interrupted) _checkpoint->Remove();
+    _Hoppers->MeasureCoulombCutoffError();
     _Hoppers->SetWaitTimes(_time);
 }
 // 
-void kmc::UpdatePhotocurrent(const double & dz, const int& gen, const int& trans){
+void kmc::UpdatePhotocurrent(const double & dz){
     _geometricBin = int ((log(_time) - _logDt) / _logAlpha);
     if ( _geometricBin<0 ) _geometricBin=0;
     else if (_geometricBin >= _nLogTimeBins) {
@@ -128,11 +385,11 @@ void kmc::UpdatePhotocurrent(const double & dz, const int& gen, const int& trans
         _poptrans.resize(_nLogTimeBins);
     }
     _current[_geometricBin] += dz;
-    _popgen_run[_geometricBin] = gen;
-    _poptrans_run[_geometricBin] = trans;
+    if (_trackPop) tie(_popgen_run[_geometricBin], _poptrans_run[_geometricBin]) = _Hoppers->GetPop();
 }
 
 void kmc::AveragePopOverRuns() {
+    if (!_trackPop) return;
     for (int i = 0; i < _geometricBin - 1; i++) {
         _popgen.at(i) += _popgen_run.at(i);
         _poptrans.at(i) += _poptrans_run.at(i);
@@ -143,6 +400,73 @@ void kmc::AveragePopOverRuns() {
 void kmc::SleepUntilTimeout() {
     _mutex.lock();
     this_thread::sleep_for(chrono::minutes(_timeoutMinutes));
+    _timedOut = true;
     _mutex.unlock();
 }
 
+/***************************************************
+ * CHECKPOINTS
+ **************************************************/
+void kmc::SaveState(stateBuffer & state) const {
+    state.Put(_time);
+    state.Put(_totalTimeOverAllRuns);
+    state.Put(_geometricBin);
+    state.Put(_nLogTimeBins);
+    state.Put(_run);
+    state.Put(_sum_dz);
+    state.Put(_mu);
+    state.Put(_hops);
+    state.Put(_current);
+    state.Put(_popgen_run);
+    state.Put(_poptrans_run);
+    state.Put(_popgen);
+    state.Put(_poptrans);
+    state.Put(Random);
+    _graph->SaveState(state);
+    _Hoppers->SaveState(state);
+}
+//
+void kmc::RestoreState(stateBuffer & state) {
+    state.Get(_time);
+    state.Get(_totalTimeOverAllRuns);
+    state.Get(_geometricBin);
+    state.Get(_nLogTimeBins);
+    state.Get(_run);
+    state.Get(_sum_dz);
+    state.Get(_mu);
+    state.Get(_hops);
+    state.Get(_current);
+    state.Get(_popgen_run);
+    state.Get(_poptrans_run);
+    state.Get(_popgen);
+    state.Get(_poptrans);
+    state.Get(Random);
+    _Hoppers->softClear();  // before the vertices are restored
+    _graph->RestoreState(state);
+    _Hoppers->RestoreState(state);
+    if (!state.AtEnd()) ERROR(-1, "Checkpoint is longer than expected");
+}
+//
+bool kmc::Resume() {
+    if (!_checkpoint) return false;
+    stateBuffer state;
+    if (!_checkpoint->Read(state)) return false;
+    RestoreState(state);
+    cout << "Restarting from checkpoint " << _checkpoint->GetFilename() << " at time " << _time << " (s)";
+    if (_mode != "fet") cout << " of run " << _run;
+    cout << endl;
+    return true;
+}
+// Write a checkpoint in the background, or 'now' if the simulation is stopping
+void kmc::WriteCheckpoint(bool now) {
+    #ifdef countAllocations
+    COUNT_ALLOCATIONS = false;
+    #endif
+    stateBuffer state;
+    SaveState(state);
+    if (now) _checkpoint->WriteNow(state);
+    else _checkpoint->Write(state);
+    #ifdef countAllocations
+    COUNT_ALLOCATIONS = true;
+    #endif
+}
@@ -18,13 +18,18 @@
 /**********************************************************************
  * 'kmc' is the central kinetic Monte Carlo class.
  * At the moment it contains two 'First Reaction Method' algorithms 
- * to cater for time-of-flight and variants, and FETs. 
+ * to cater for time-of-flight and variants, and FETs.  Each is 
+ * compiled for every kernel (see kernel.h), and chooses one at the 
+ * start of the simulation.
  *********************************************************************/
 
 #ifndef _KMC_H
 #define	_KMC_H
 #include "hoppers.h"
 #include "graph.h"
+#include "checkpoint.h"
+#include <atomic>
+#include <cfloat>
 
 using namespace std;
 
@@ -53,93 +58,117 @@ class kmc{
         vector <int> _poptrans_run;  // Hoppers in transport zone
         vector <int> _popgen;  // Hoppers in generation zone
         vector <int> _poptrans;  // Hoppers in transport zone
+        bool _trackPop;  // keep the populations above ('trackpop')?
         int _nHoppers;  // initial number of hoppers.  NOTE: this is not updated as hoppers are collected
         string _mode;  // mode of simulation (FET, tof, regenerate...)
         bool _hopperInteractions;  // Coulombic interactions?
     
-        void UpdatePhotocurrent(const double &, const int& , const int&);
+        void UpdatePhotocurrent(const double &);
         void AveragePopOverRuns();
-        double (hoppers::*moveFastest)();  // pointer to appropriate MoveFastest_* function
+        // FRM and FRM_FET for each kernel, and the choice between them
+        template <class K> void FRM_Kernel();
+        template <class K> void FRM_FET_Kernel();
+        template <int mode, bool interactions, bool millerAbrahams> void ChooseFRM(bool occupation);
+        template <bool interactions, bool millerAbrahams> void ChooseFRM_FET(bool occupation);
+
+       /***************************************************
+        * PARALLEL RUNS
+        * With 'threads' > 1, FRM makes that many runs at once, each 
+        * with its own copy of the kmc, hoppers and graph (see 
+        * FRM_Parallel).
+        **************************************************/
+        int _threads;
+        const simParameters * _sim;
+        kmc * _master;  // for the copies only
+        int _hoppersLeft;  // at the end of the last run (copies only)
+        bool _interrupted;  // was the last run cut short? (copies only)
+        template <class K> void FRM_Parallel();
+        template <class K> void SingleRun(int run, uint64_t seed);
+        void AddRun(kmc &);
 
        /***************************************************
         * TIMEOUT
         **************************************************/
         int _timeoutMinutes;
         std::mutex _mutex;
+        std::atomic<bool> _timedOut;  // for the copies, which can't share '_mutex'
         void SleepUntilTimeout();
 
+       /***************************************************
+        * CHECKPOINTS
+        * The state of the kmc, the graph and the hoppers, from which 
+        * FRM or FRM_FET can carry on exactly (see checkpoint.h).  Only 
+        * made without parallel runs.
+        **************************************************/
+        checkpoint * _checkpoint;  // NULL if there are no checkpoints
+        void SaveState(stateBuffer &) const;
+        void RestoreState(stateBuffer &);
+        bool Resume();  // from the last checkpoint, if there is one
+        void WriteCheckpoint(bool now);
+
     //end of private:
 
     public:
         kmc(){}
-        kmc(char * sim, hoppers * Hoppers, int totalHoppers, graph * Graph, int timeoutMinutes){
+        kmc(const simParameters & sim, hoppers * Hoppers, int totalHoppers, graph * Graph, int timeoutMinutes){
             _totalTimeOverAllRuns = 0.0;
             _sum_dz = 0.0;
             _graph = Graph;
             _Hoppers = Hoppers;
+            _sim = &sim;
+            _master = NULL;
+            _hoppersLeft = 0;
+            _interrupted = false;
+            _timedOut = false;
+            _checkpoint = NULL;
+            _run = 0;
             _hops = vector <unsigned int> (_graph->_reorgs.size(), 0);
-            _maxTime=atof(Read(sim,"maxTime").c_str());
+            _maxTime=sim.GetNumber("maxTime");
             _timeoutMinutes = timeoutMinutes;
-            _mode = Read(sim, "mode", "tof");
-            if (Read(sim, "hopperInteractions", "0") == "1") {
-                _hopperInteractions = true;
-            }
-            else {
-                _hopperInteractions = false;
+            _mode = sim.Get("mode");
+            _hopperInteractions = sim.GetFlag("hopperInteractions");
+            _trackPop = sim.GetFlag("trackpop");
+            _threads = sim.GetInteger("threads");
+            if (_threads < 1)
+                ERROR(-1, "threads must be at least 1");
+            if (_threads > 1 && (_hopperInteractions || _mode == "fet" || _graph->_keepOccupations)) {
+                cout << "!!! WARNING !!! : Runs can only be made in parallel in tof, regenerate or pb modes, "
+                     << "without hopperInteractions, track, printOccupation or printEnergies.  Using one thread.\n";
+                WARNINGS++;
+                _threads = 1;
             }
             if (_mode == "tof" || _mode == "regenerate" || _mode == "pb") {
-                _dt=atof(Read(sim,"deltaTime").c_str());
+                _dt=sim.GetNumber("deltaTime");
                 if (_dt > _maxTime) {
                     cout << "*** ERROR *** : deltaTime > maxTime!\n";
                     exit(-1);
                 }
-                _alpha=atof(Read(sim,"alpha").c_str());
+                _alpha=sim.GetNumber("alpha");
                 _nHoppers=totalHoppers;
-                _tol=atof(Read(sim,"tol","0.0").c_str());
+                _tol=sim.GetNumber("tol");
                 _upperTol=1.0+_tol;
                 _lowerTol=1.0-_tol;
-                _maxRuns=atof(Read(sim,"maxRuns","inf").c_str()); 
+                _maxRuns=sim.GetNumber("maxRuns"); 
                 _logAlpha = log(_alpha);
                 _logDt = log(_dt);
                 _nLogTimeBins = int ( (log(_maxTime)  - _logDt ) / _logAlpha );
+                // The last hop of a run can be any time after maxTime, so make
+                //   room for bins up to the largest time there is, and 
+                //   UpdatePhotocurrent never has to allocate
+                int maxBins = int ( (log(DBL_MAX) - _logDt ) / _logAlpha ) + 1;
+                _current.reserve(maxBins);
+                _popgen_run.reserve(maxBins);
+                _poptrans_run.reserve(maxBins);
+                _popgen.reserve(maxBins);
+                _poptrans.reserve(maxBins);
                 _current.resize(_nLogTimeBins);
                 _popgen_run.resize(_nLogTimeBins);
                 _poptrans_run.resize(_nLogTimeBins);
                 _popgen.resize(_nLogTimeBins);
                 _poptrans.resize(_nLogTimeBins);
             }
-            if (_mode=="tof") { 
-                if (VERBOSITY_HIGH) {
-                    cout << "Setting to MoveFastest_C" << endl;
-                }
-                moveFastest=&hoppers::MoveFastest_C;
-            }
-            if (_mode=="regenerate") {
-                if (_hopperInteractions) { 
-                    if (VERBOSITY_HIGH) {
-                        cout << "Setting moveFastest to 'MoveFastest_RCI'" << endl;
-                    }
-                    moveFastest=&hoppers::MoveFastest_RCI;
-                }
-                else {
-                    if (VERBOSITY_HIGH) {
-                        cout << "Setting moveFastest to 'MoveFastest_R'" << endl;
-                    }
-                    moveFastest=&hoppers::MoveFastest_R;
-                }
-            }
-            if (_mode == "pb") {
-                if (VERBOSITY_HIGH) {
-                    cout << "Setting to MoveFastest_PB" << endl;
-                }
-                moveFastest=&hoppers::MoveFastest_PB;
-            }
             if (_mode=="fet") {
-                if ( VERBOSITY_HIGH ) {
-                    cout << "Setting moveFasest to 'MoveFastest_F'" << endl;
-                }
-                moveFastest=&hoppers::MoveFastest_F; 
-                if (Read(sim,"converged","0")=="1") {
+                if (sim.GetFlag("converged")) {
                     _Hoppers->SetActiveHoppersConverged();
                     cout << "Assuming the charge density is already converged\n";
                 }
@@ -155,6 +184,14 @@ class kmc{
          **************************************************/
         void FRM();  // simple First Reaction Method	
         void FRM_FET();  // FRM with all necessary add-ons for FET simulations
+        void SetCheckpoint(checkpoint * Checkpoint) {
+            if (_threads > 1) {
+                cout << "!!! WARNING !!! : Checkpoints can't be written with threads > 1, so there won't be any.\n";
+                WARNINGS++;
+                return;
+            }
+            _checkpoint = Checkpoint;
+        }
         
         /***************************************************
          * GET'S
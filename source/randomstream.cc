@@ -0,0 +1,425 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "randomstream.h"
+#include <string.h>
+#include <math.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(scalarRandom)
+#define AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+thread_local randomStream Random;
+
+/*******************
+ * SCALAR KERNELS
+ *******************/
+// The scalar and AVX2 kernels do exactly the same arithmetic, so give exactly
+//   the same numbers (as long as the compiler doesn't fuse multiplies and 
+//   adds in only one of them; it won't unless told to with e.g. -mfma, and 
+//   then there is nothing for the scalar kernels to run on).
+
+// Four 32-bit words of Philox4x32-10 for 'counter' (c0,c1,c2,c3) and 'key' (k0,k1)
+static void Philox(uint32_t * c, uint32_t k0, uint32_t k1) {
+    for (int round = 0; round < 10; round++) {
+        uint64_t p0 = (uint64_t)0xD2511F53 * c[0];
+        uint64_t p1 = (uint64_t)0xCD9E8D57 * c[2];
+        uint32_t c0 = (uint32_t)(p1 >> 32) ^ c[1] ^ k0;
+        uint32_t c2 = (uint32_t)(p0 >> 32) ^ c[3] ^ k1;
+        c[0] = c0;  c[1] = (uint32_t)p1;
+        c[2] = c2;  c[3] = (uint32_t)p0;
+        k0 += 0x9E3779B9;
+        k1 += 0xBB67AE85;
+    }
+}
+// The top 52 of 64 random bits, offset by half a bit so that they are never
+//   0 (or 1).  v+0.5 is made exactly by subtracting 2^52-0.5 from the double 
+//   whose bits are those of 2^52, plus v.
+static double ToUniform(uint64_t bits) {
+    uint64_t v = (bits >> 12) | 0x4330000000000000ULL;
+    double d;
+    memcpy(&d, &v, sizeof(d));
+    return (d - 4503599627370495.5) * (1.0 / 4503599627370496.0);
+}
+// 2 uniforms from each of 'blocks' blocks of the stream, starting at 'block'
+static void UniformsScalar(uint64_t seed, uint64_t stream, uint64_t block, 
+                           unsigned int blocks, double * x) {
+    for (unsigned int b = 0; b < blocks; b++) {
+        uint32_t c[4] = {(uint32_t)(block + b), (uint32_t)((block + b) >> 32), 
+                         (uint32_t)stream, (uint32_t)(stream >> 32)};
+        Philox(c, (uint32_t)seed, (uint32_t)(seed >> 32));
+        x[2*b] = ToUniform(c[0] | ((uint64_t)c[1] << 32));
+        x[2*b+1] = ToUniform(c[2] | ((uint64_t)c[3] << 32));
+    }
+}
+// -log(u), for u in (0,1).  u = 2^e*f, with f in [sqrt(1/2),sqrt(2)), and 
+//   log(f) = 2*atanh(s) = 2s(1 + s^2/3 + s^4/5 + ...), with s = (f-1)/(f+1) 
+//   and s^2 < 0.0295 (so that 10 terms are good to within rounding).
+//   ln(2) is split in two so that e*ln(2) is exact.
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+static const double SQRT2 = 1.41421356237309504880;
+static const double ATANH[10] = {1.0, 1.0/3, 1.0/5, 1.0/7, 1.0/9, 
+                                 1.0/11, 1.0/13, 1.0/15, 1.0/17, 1.0/19};
+static double NegLog(double u) {
+    uint64_t bits, exponent, mantissa;
+    memcpy(&bits, &u, sizeof(bits));
+    exponent = (bits >> 52) | 0x4330000000000000ULL;
+    mantissa = (bits & 0x000FFFFFFFFFFFFFULL) | 0x3FF0000000000000ULL;
+    double e, f;
+    memcpy(&e, &exponent, sizeof(e));
+    memcpy(&f, &mantissa, sizeof(f));
+    e = e - 4503599627371519.0;  // 2^52 + 1023
+    if (f > SQRT2) {
+        f = f * 0.5;
+        e = e + 1.0;
+    }
+    double s = (f - 1.0) / (f + 1.0);
+    double z = s * s;
+    double p = ATANH[9];
+    for (int i = 8; i >= 0; i--) p = p * z + ATANH[i];
+    return -(e * LN2_HI + (e * LN2_LO + 2.0 * s * p));
+}
+static void NegLogsScalar(double * x, unsigned int n) {
+    for (unsigned int i = 0; i < n; i++) x[i] = NegLog(x[i]);
+}
+
+/*******************
+ * AVX2 KERNELS
+ *******************/
+#ifdef AVX2_KERNELS
+__attribute__((target("avx2")))
+static __m256d ToUniformsAVX2(__m256i bits) {
+    __m256i v = _mm256_or_si256(_mm256_srli_epi64(bits, 12), 
+                                _mm256_set1_epi64x(0x4330000000000000LL));
+    __m256d d = _mm256_sub_pd(_mm256_castsi256_pd(v), _mm256_set1_pd(4503599627370495.5));
+    return _mm256_mul_pd(d, _mm256_set1_pd(1.0 / 4503599627370496.0));
+}
+// As UniformsScalar, 4 blocks at a time: each 64-bit lane holds one 32-bit 
+//   word of a block.
+__attribute__((target("avx2")))
+static void UniformsAVX2(uint64_t seed, uint64_t stream, uint64_t block, 
+                         unsigned int blocks, double * x) {
+    const __m256i low = _mm256_set1_epi64x(0xFFFFFFFFLL);
+    const __m256i m0 = _mm256_set1_epi64x(0xD2511F53LL);
+    const __m256i m1 = _mm256_set1_epi64x(0xCD9E8D57LL);
+    const __m256i s0 = _mm256_set1_epi64x((uint32_t)stream);
+    const __m256i s1 = _mm256_set1_epi64x((uint32_t)(stream >> 32));
+    unsigned int b = 0;
+    for (; b + 4 <= blocks; b += 4) {
+        uint64_t n = block + b;
+        __m256i counter = _mm256_set_epi64x(n + 3, n + 2, n + 1, n);
+        __m256i c0 = _mm256_and_si256(counter, low);
+        __m256i c1 = _mm256_srli_epi64(counter, 32);
+        __m256i c2 = s0, c3 = s1;
+        uint32_t k0 = (uint32_t)seed, k1 = (uint32_t)(seed >> 32);
+        for (int round = 0; round < 10; round++) {
+            __m256i p0 = _mm256_mul_epu32(c0, m0);
+            __m256i p1 = _mm256_mul_epu32(c2, m1);
+            c0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), c1), 
+                                  _mm256_set1_epi64x(k0));
+            c2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), c3), 
+                                  _mm256_set1_epi64x(k1));
+            c1 = _mm256_and_si256(p1, low);
+            c3 = _mm256_and_si256(p0, low);
+            k0 += 0x9E3779B9;
+            k1 += 0xBB67AE85;
+        }
+        __m256d even = ToUniformsAVX2(_mm256_or_si256(c0, _mm256_slli_epi64(c1, 32)));
+        __m256d odd = ToUniformsAVX2(_mm256_or_si256(c2, _mm256_slli_epi64(c3, 32)));
+        // Back into the order of the stream: (even,odd) of each block in turn
+        __m256d lo = _mm256_unpacklo_pd(even, odd);
+        __m256d hi = _mm256_unpackhi_pd(even, odd);
+        _mm256_storeu_pd(x + 2*b, _mm256_permute2f128_pd(lo, hi, 0x20));
+        _mm256_storeu_pd(x + 2*b + 4, _mm256_permute2f128_pd(lo, hi, 0x31));
+    }
+    _mm256_zeroupper();  // or the SSE code after this runs many times slower
+    UniformsScalar(seed, stream, block + b, blocks - b, x + 2*b);
+}
+// As NegLogsScalar, 4 at a time
+__attribute__((target("avx2")))
+static void NegLogsAVX2(double * x, unsigned int n) {
+    const __m256i exponentMask = _mm256_set1_epi64x(0x4330000000000000LL);
+    const __m256i mantissaMask = _mm256_set1_epi64x(0x000FFFFFFFFFFFFFLL);
+    const __m256i one = _mm256_set1_epi64x(0x3FF0000000000000LL);
+    unsigned int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i bits = _mm256_castpd_si256(_mm256_loadu_pd(x + i));
+        __m256d e = _mm256_castsi256_pd(_mm256_or_si256(_mm256_srli_epi64(bits, 52), exponentMask));
+        __m256d f = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, mantissaMask), one));
+        e = _mm256_sub_pd(e, _mm256_set1_pd(4503599627371519.0));
+        __m256d big = _mm256_cmp_pd(f, _mm256_set1_pd(SQRT2), _CMP_GT_OQ);
+        f = _mm256_blendv_pd(f, _mm256_mul_pd(f, _mm256_set1_pd(0.5)), big);
+        e = _mm256_add_pd(e, _mm256_and_pd(big, _mm256_set1_pd(1.0)));
+        __m256d s = _mm256_div_pd(_mm256_sub_pd(f, _mm256_set1_pd(1.0)), 
+                                  _mm256_add_pd(f, _mm256_set1_pd(1.0)));
+        __m256d z = _mm256_mul_pd(s, s);
+        __m256d p = _mm256_set1_pd(ATANH[9]);
+        for (int j = 8; j >= 0; j--) 
+            p = _mm256_add_pd(_mm256_mul_pd(p, z), _mm256_set1_pd(ATANH[j]));
+        __m256d r = _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), s), p);
+        r = _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(LN2_LO)), r);
+        r = _mm256_add_pd(_mm256_mul_pd(e, _mm256_set1_pd(LN2_HI)), r);
+        _mm256_storeu_pd(x + i, _mm256_sub_pd(_mm256_setzero_pd(), r));
+    }
+    _mm256_zeroupper();
+    NegLogsScalar(x + i, n - i);
+}
+#endif
+
+/*******************
+ * KERNEL CHOICE
+ *******************/
+static bool UseAVX2() {
+#ifdef AVX2_KERNELS
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+static const bool useAVX2 = UseAVX2();
+
+static void Uniforms(uint64_t seed, uint64_t stream, uint64_t block, 
+                     unsigned int blocks, double * x) {
+#ifdef AVX2_KERNELS
+    if (useAVX2) return UniformsAVX2(seed, stream, block, blocks, x);
+#endif
+    UniformsScalar(seed, stream, block, blocks, x);
+}
+static void NegLogs(double * x, unsigned int n) {
+#ifdef AVX2_KERNELS
+    if (useAVX2) return NegLogsAVX2(x, n);
+#endif
+    NegLogsScalar(x, n);
+}
+
+/*******************
+ * DO'S
+ *******************/
+//
+void randomStream::Seed(uint64_t seed, uint64_t stream) {
+    _seed = seed;
+    _stream = stream;
+    _position = 0;
+    _nextUniform = _endUniform = 0;
+    _nextExponential = _endExponential = 0;
+}
+//
+void randomStream::Skip(uint64_t n) {
+    _position += n;
+    _nextUniform = _endUniform = 0;
+    _nextExponential = _endExponential = 0;
+}
+// The next 'n' numbers of the stream.  Each block gives two numbers, so one 
+//   may be left over at either end.
+void randomStream::Uniforms(double * x, unsigned int n) {
+    if (n == 0) return;
+    double pair[2];
+    unsigned int i = 0;
+    if (_position & 1) {
+        UniformsScalar(_seed, _stream, _position >> 1, 1, pair);
+        x[i++] = pair[1];
+    }
+    unsigned int blocks = (n - i) / 2;
+    ::Uniforms(_seed, _stream, (_position + i) >> 1, blocks, x + i);
+    i += 2 * blocks;
+    if (i < n) {
+        UniformsScalar(_seed, _stream, (_position + i) >> 1, 1, pair);
+        x[i] = pair[0];
+    }
+    _position += n;
+}
+//
+void randomStream::Exponentials(double * x, unsigned int n) {
+    Uniforms(x, n);
+    NegLogs(x, n);
+}
+
+/*******************
+ * GET'S
+ *******************/
+//
+const char * randomStream::GetKernel() {
+    return useAVX2 ? "AVX2" : "scalar";
+}
+
+/*******************
+ * SELF TEST
+ *******************/
+// 'tft random [n]'.  Everything is drawn from seed 0, so the results are 
+//   the same every time (but for the timings).
+// The largest distance between the CDF of the sorted 'x' and 'CDF', 
+//   times sqrt(n): above 1.95, 'x' fails the Kolmogorov-Smirnov test 
+//   with p < 0.001.
+static double KolmogorovSmirnov(vector <double> & x, double (*CDF)(double)) {
+    sort(x.begin(), x.end());
+    double n = x.size(), D = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        double F = CDF(x[i]);
+        D = max(D, max(F - i / n, (i + 1) / n - F));
+    }
+    return D * sqrt(n);
+}
+static double UniformCDF(double x) {return x;}
+static double ExponentialCDF(double x) {return -expm1(-x);}
+// How many standard errors the mean and variance of 'x' are from 'mean' and 
+//   'variance' (with 'kurtosis', the fourth central moment / variance^2)
+static void Moments(const vector <double> & x, double mean, double variance, double kurtosis,
+                    double & zMean, double & zVariance) {
+    double n = x.size(), sum = 0.0, sum2 = 0.0;
+    for (size_t i = 0; i < x.size(); i++) {
+        sum += x[i] - mean;
+        sum2 += (x[i] - mean) * (x[i] - mean);
+    }
+    zMean = (sum / n) / sqrt(variance / n);
+    zVariance = (sum2 / n - variance) / (variance * sqrt((kurtosis - 1.0) / n));
+}
+// Bit for bit
+static uint64_t Differences(const vector <double> & a, const vector <double> & b) {
+    uint64_t differences = 0;
+    for (size_t i = 0; i < a.size(); i++) 
+        if (memcmp(&a[i], &b[i], sizeof(double)) != 0) differences++;
+    return differences;
+}
+static bool Check(const char * what, bool ok, double value) {
+    cout << (ok ? "\tpassed  " : "\tFAILED  ") << what << " " << value << endl;
+    return ok;
+}
+// Nanoseconds per number for 'repeats' calls of 'Get'
+template <class Get>
+static double Time(uint64_t repeats, Get get) {
+    volatile double sink = 0.0;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (uint64_t i = 0; i < repeats; i++) sink = sink + get();
+    chrono::duration <double, nano> t = chrono::steady_clock::now() - start;
+    return t.count() / repeats;
+}
+// Check the uniform and exponential numbers, and time them.  Returns false 
+//   if any check fails.
+bool randomStream::SelfTest(uint64_t n) {
+    bool ok = true;
+    randomStream stream;
+    stream.Seed(0);
+    cout << "Testing " << n << " uniform and exponential random numbers (Philox, " 
+         << GetKernel() << " kernels) ...\n";
+
+    // The AVX2 kernels must give exactly what the scalar ones do
+#ifdef AVX2_KERNELS
+    if (useAVX2) {
+        const unsigned int blocks = 4099;  // not a multiple of 4, from an odd block
+        vector <double> a(2 * blocks), b(2 * blocks);
+        UniformsAVX2(0, 7, 12345, blocks, a.data());
+        UniformsScalar(0, 7, 12345, blocks, b.data());
+        uint64_t differences = Differences(a, b);
+        ok &= Check("uniforms differing between the AVX2 and scalar kernels:", differences == 0, differences);
+        NegLogsAVX2(a.data(), a.size());
+        NegLogsScalar(b.data(), b.size());
+        differences = Differences(a, b);
+        ok &= Check("exponentials differing between the AVX2 and scalar kernels:", differences == 0, differences);
+    }
+#endif
+
+    // Uniforms are (k + 1/2) / 2^52 for integer k: never 0 or 1, and with 
+    //   all 52 bits random (the lowest as often odd as even)
+    vector <double> u(n);
+    stream.Uniforms(u.data(), n);
+    uint64_t outside = 0, notGrid = 0, odd = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (!(u[i] > 0.0 && u[i] < 1.0)) outside++;
+        double k = u[i] * 4503599627370496.0 - 0.5;
+        if (k != floor(k)) notGrid++;
+        else if (fmod(k, 2.0) == 1.0) odd++;
+    }
+    ok &= Check("uniforms outside (0,1):", outside == 0, outside);
+    ok &= Check("uniforms not (k + 1/2) / 2^52:", notGrid == 0, notGrid);
+    double zOdd = (odd - n / 2.0) / sqrt(n / 4.0);
+    ok &= Check("lowest bit of uniforms, standard errors from 1/2:", fabs(zOdd) < 5.0, zOdd);
+
+    // Exponentials are -log of the uniforms of the same stream, as the C 
+    //   library has it.  They come from another stream to the uniforms 
+    //   above, or their distributions would be tested twice over.
+    vector <double> e(n);
+    stream.Seed(0, 1);
+    stream.Exponentials(e.data(), n);
+    stream.Seed(0, 1);
+    double worst = 0.0;
+    for (uint64_t i = 0; i < n; i++) {
+        double exact = -log(stream.Uniform());
+        worst = max(worst, fabs(e[i] - exact) / exact);
+    }
+    // ... and at the ends of (0,1), and either side of sqrt(1/2) and 1/2
+    const double ends[] = {0.5 / 4503599627370496.0, 1.0 - 0.5 / 4503599627370496.0, 
+                           0.7071067811865475, 0.7071067811865476, 
+                           0.5, nextafter(0.5, 0.0), nextafter(0.5, 1.0)};
+    for (unsigned int i = 0; i < sizeof(ends) / sizeof(ends[0]); i++) {
+        double exact = -log(ends[i]);
+        worst = max(worst, fabs(NegLog(ends[i]) - exact) / exact);
+    }
+    ok &= Check("largest relative difference of exponentials from -log(uniform):", worst < 1e-15, worst);
+
+    // Their distributions
+    double zMean, zVariance;
+    Moments(u, 0.5, 1.0 / 12, 1.8, zMean, zVariance);
+    ok &= Check("mean of uniforms, standard errors from 1/2:", fabs(zMean) < 5.0, zMean);
+    ok &= Check("variance of uniforms, standard errors from 1/12:", fabs(zVariance) < 5.0, zVariance);
+    Moments(e, 1.0, 1.0, 9.0, zMean, zVariance);
+    ok &= Check("mean of exponentials, standard errors from 1:", fabs(zMean) < 5.0, zMean);
+    ok &= Check("variance of exponentials, standard errors from 1:", fabs(zVariance) < 5.0, zVariance);
+    double KS = KolmogorovSmirnov(u, UniformCDF);
+    ok &= Check("Kolmogorov-Smirnov statistic of uniforms (sqrt(n) D):", KS < 1.95, KS);
+    KS = KolmogorovSmirnov(e, ExponentialCDF);
+    ok &= Check("Kolmogorov-Smirnov statistic of exponentials (sqrt(n) D):", KS < 1.95, KS);
+
+    // Timings, one number at a time as the simulation asks for them
+    cout << "Nanoseconds per number:\n";
+    stream.Seed(0);
+    cout << "\tUniform()               " << Time(n, [&]() {return stream.Uniform();}) << endl;
+    cout << "\tExponential()           " << Time(n, [&]() {return stream.Exponential();}) << endl;
+    cout << "\t-log(Uniform())         " << Time(n, [&]() {return -log(stream.Uniform());}) << endl;
+    const unsigned int size = _bufferSize;
+    double buffer[size];
+    uint64_t batches = n / size + 1;
+    uint64_t block = 0;
+    cout << "\tscalar uniforms         " << Time(batches, [&]() {
+        UniformsScalar(0, 0, block, size / 2, buffer);
+        block += size / 2;
+        return buffer[0];}) / size << endl;
+    cout << "\tscalar exponentials     " << Time(batches, [&]() {
+        UniformsScalar(0, 0, block, size / 2, buffer);
+        NegLogsScalar(buffer, size);
+        block += size / 2;
+        return buffer[0];}) / size << endl;
+#ifdef AVX2_KERNELS
+    if (useAVX2) {
+        cout << "\tAVX2 uniforms           " << Time(batches, [&]() {
+            UniformsAVX2(0, 0, block, size / 2, buffer);
+            block += size / 2;
+            return buffer[0];}) / size << endl;
+        cout << "\tAVX2 exponentials       " << Time(batches, [&]() {
+            UniformsAVX2(0, 0, block, size / 2, buffer);
+            NegLogsAVX2(buffer, size);
+            block += size / 2;
+            return buffer[0];}) / size << endl;
+    }
+#endif
+    cout << (ok ? "All tests passed\n" : "!!! Some tests FAILED !!!\n");
+    return ok;
+}
@@ -0,0 +1,99 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'randomStream' gives uniform and exponential random numbers from the
+ * Philox4x32-10 generator (Salmon et al., SC11).  Philox is 
+ * counter-based: the n'th number of a stream is a fixed function of 
+ * the seed, the stream and n, so streams are independent of each 
+ * other, any number of them can be used at once (e.g. one per run: 
+ * see kmc::FRM), and skipping ahead costs nothing.
+ * Numbers are made in batches, into buffers, so that asking for one 
+ * is usually just a read from memory.  The batches are made with AVX2
+ * where the processor has it, and give the same numbers either way.
+ * Each thread has its own 'Random' stream.
+ ********************************************************************/
+#ifndef _RANDOMSTREAM_H
+#define	_RANDOMSTREAM_H
+#include <stdint.h>
+
+using namespace std;
+
+class randomStream{
+    private:
+        static const unsigned int _bufferSize = 128;
+        uint64_t _seed;
+        uint64_t _stream;
+        uint64_t _position;  // of the next number to be put in a buffer
+        double _uniforms[_bufferSize];
+        double _exponentials[_bufferSize];
+        unsigned int _nextUniform, _endUniform;
+        unsigned int _nextExponential, _endExponential;
+    // end of private:
+
+    public:
+        // Nothing needs setting up, so that 'Random' needs no constructing
+        //   (it starts as stream 0 of seed 0)
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Seed(uint64_t seed, uint64_t stream=0);  // go to the start of 'stream' of 'seed'
+        void SetStream(uint64_t stream) {Seed(_seed, stream);}
+        void Skip(uint64_t n);  // skip the next 'n' numbers (throwing away the buffers)
+        void Uniforms(double * x, unsigned int n);  // in (0,1)
+        void Exponentials(double * x, unsigned int n);  // with mean 1
+
+        /***********************************
+        * GET'S
+        ************************************/
+        // In (0,1): never exactly 0 or 1
+        double Uniform() {
+            if (_nextUniform == _endUniform) {
+                Uniforms(_uniforms, _bufferSize);
+                _nextUniform = 0;
+                _endUniform = _bufferSize;
+            }
+            return _uniforms[_nextUniform++];
+        }
+        // With mean 1 (e.g. the time to the next event, in units of 1/rate)
+        double Exponential() {
+            if (_nextExponential == _endExponential) {
+                Exponentials(_exponentials, _bufferSize);
+                _nextExponential = 0;
+                _endExponential = _bufferSize;
+            }
+            return _exponentials[_nextExponential++];
+        }
+        // In [0, n-1]
+        unsigned int UniformInt(unsigned int n) {
+            unsigned int i = (unsigned int)(Uniform() * n);
+            return (i < n) ? i : n - 1;
+        }
+        uint64_t GetSeed() const {return _seed;}
+        uint64_t GetStream() const {return _stream;}
+        static const char * GetKernel();  // "AVX2" or "scalar"
+
+        /***********************************
+        * SELF TEST ('tft random')
+        ************************************/
+        static bool SelfTest(uint64_t n);  // check 'n' of each kind of number, and time them
+    // end of public:
+};
+
+extern thread_local randomStream Random;
+#endif	/* _RANDOMSTREAM_H */
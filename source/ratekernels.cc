@@ -0,0 +1,222 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "ratekernels.h"
+#include <math.h>
+#include <string.h>
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && !defined(scalarRates)
+#define AVX2_KERNELS
+#include <immintrin.h>
+#endif
+
+/*******************
+ * SCALAR KERNELS
+ *******************/
+// Marcus
+static double MarcusScalar(const double * DEs, const double * DCs, const double * prefactors,
+                           const double * lambdas, const double * scales, const char * occupied,
+                           double * rates, unsigned int n, double & rateToOccupied) {
+    double total = 0.0, toOccupied = 0.0;
+    for (unsigned int i = 0; i < n; i++) {
+        double G = DEs[i] + DCs[i] + lambdas[i];
+        rates[i] = prefactors[i] * exp(G * G * scales[i]);
+        total += rates[i];
+        toOccupied += occupied[i] ? rates[i] : 0.0;
+    }
+    rateToOccupied = toOccupied;
+    return total;
+}
+// Miller-Abrahams
+static double MillerAbrahamsScalar(const double * DEs, const double * DCs, const double * prefactors,
+                                   const double * scales, const char * occupied,
+                                   double * rates, unsigned int n, double & rateToOccupied) {
+    double total = 0.0, toOccupied = 0.0;
+    for (unsigned int i = 0; i < n; i++) {
+        double DE = DEs[i] + DCs[i];
+        rates[i] = prefactors[i] * ((DE < 0.0) ? 1.0 : exp(DE * scales[i]));
+        total += rates[i];
+        toOccupied += occupied[i] ? rates[i] : 0.0;
+    }
+    rateToOccupied = toOccupied;
+    return total;
+}
+
+/*******************
+ * AVX2 KERNELS
+ *******************/
+#ifdef AVX2_KERNELS
+// exp(x) for x <= 0, 4 at a time.  x = n ln(2) + r, |r| <= ln(2)/2, and 
+//   exp(r) is summed from its Taylor series to r^13 (good to within 
+//   rounding) by Estrin's scheme, so that the terms don't all wait for 
+//   each other.  n is rounded by adding and subtracting 1.5*2^52, which 
+//   leaves n in the low bits, ready to be made into 2^n.  Below -708.39 
+//   (where the result would not be normal) gives 0.
+static const double LOG2E = 1.44269504088896338700;
+static const double LN2_HI = 6.93147180369123816490e-01;
+static const double LN2_LO = 1.90821492927058770002e-10;
+static const double ROUND = 6755399441055744.0;  // 1.5*2^52
+static const double SMALLEST = -708.39;
+static const double TAYLOR[14] = {1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 
+                                  1.0/5040, 1.0/40320, 1.0/362880, 1.0/3628800, 
+                                  1.0/39916800, 1.0/479001600, 1.0/6227020800.0};
+__attribute__((target("avx2")))
+static __m256d ExpAVX2(__m256d x) {
+    __m256d k = _mm256_add_pd(_mm256_mul_pd(x, _mm256_set1_pd(LOG2E)), _mm256_set1_pd(ROUND));
+    __m256d n = _mm256_sub_pd(k, _mm256_set1_pd(ROUND));
+    __m256d r = _mm256_sub_pd(_mm256_sub_pd(x, _mm256_mul_pd(n, _mm256_set1_pd(LN2_HI))), 
+                              _mm256_mul_pd(n, _mm256_set1_pd(LN2_LO)));
+    __m256d q[7];
+    for (int i = 0; i < 7; i++) 
+        q[i] = _mm256_add_pd(_mm256_set1_pd(TAYLOR[2*i]), _mm256_mul_pd(_mm256_set1_pd(TAYLOR[2*i+1]), r));
+    __m256d r2 = _mm256_mul_pd(r, r), r4 = _mm256_mul_pd(r2, r2), r8 = _mm256_mul_pd(r4, r4);
+    __m256d p0 = _mm256_add_pd(_mm256_add_pd(q[0], _mm256_mul_pd(q[1], r2)), 
+                               _mm256_mul_pd(_mm256_add_pd(q[2], _mm256_mul_pd(q[3], r2)), r4));
+    __m256d p1 = _mm256_add_pd(_mm256_add_pd(q[4], _mm256_mul_pd(q[5], r2)), _mm256_mul_pd(q[6], r4));
+    __m256d p = _mm256_add_pd(p0, _mm256_mul_pd(p1, r8));
+    __m256i scale = _mm256_slli_epi64(_mm256_add_epi64(_mm256_castpd_si256(k), 
+                                                       _mm256_set1_epi64x(1023)), 52);
+    __m256d y = _mm256_mul_pd(p, _mm256_castsi256_pd(scale));
+    __m256d normal = _mm256_cmp_pd(x, _mm256_set1_pd(SMALLEST), _CMP_GE_OQ);
+    return _mm256_and_pd(y, normal);
+}
+// Add 'rates' to 'total', and those to occupied neighbours to 'toOccupied'
+__attribute__((target("avx2")))
+static void SumAVX2(__m256d rates, const char * occupied, __m256d & total, __m256d & toOccupied) {
+    int four;
+    memcpy(&four, occupied, sizeof(four));
+    __m256i mask = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(four));
+    mask = _mm256_cmpgt_epi64(mask, _mm256_setzero_si256());
+    total = _mm256_add_pd(total, rates);
+    toOccupied = _mm256_add_pd(toOccupied, _mm256_and_pd(rates, _mm256_castsi256_pd(mask)));
+}
+//
+__attribute__((target("avx2")))
+static double HorizontalSum(__m256d x) {
+    __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(x), _mm256_extractf128_pd(x, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+}
+// Marcus.  The last n%4 edges are copied into one more, padded, set of 4,
+//   whose padding (with a prefactor of 0) adds nothing to the sums.
+__attribute__((target("avx2")))
+static double MarcusAVX2(const double * DEs, const double * DCs, const double * prefactors,
+                         const double * lambdas, const double * scales, const char * occupied,
+                         double * rates, unsigned int n, double & rateToOccupied) {
+    __m256d total = _mm256_setzero_pd(), toOccupied = _mm256_setzero_pd();
+    for (unsigned int i = 0; i < n; i += 4) {
+        double padDE[4] = {0.0}, padDC[4] = {0.0}, padPrefactor[4] = {0.0}, padLambda[4] = {0.0}, 
+               padScale[4] = {0.0}, padRate[4];
+        char padOccupied[4] = {0};
+        unsigned int m = (n - i < 4) ? n - i : 4;
+        const double * DE = DEs + i, * DC = DCs + i, * prefactor = prefactors + i;
+        const double * lambda = lambdas + i, * scale = scales + i;
+        const char * occ = occupied + i;
+        double * rate = rates + i;
+        if (m < 4) {
+            memcpy(padDE, DE, m * sizeof(double));  DE = padDE;
+            memcpy(padDC, DC, m * sizeof(double));  DC = padDC;
+            memcpy(padPrefactor, prefactor, m * sizeof(double));  prefactor = padPrefactor;
+            memcpy(padLambda, lambda, m * sizeof(double));  lambda = padLambda;
+            memcpy(padScale, scale, m * sizeof(double));  scale = padScale;
+            memcpy(padOccupied, occ, m);  occ = padOccupied;
+            rate = padRate;
+        }
+        __m256d G = _mm256_add_pd(_mm256_add_pd(_mm256_loadu_pd(DE), _mm256_loadu_pd(DC)),
+                                  _mm256_loadu_pd(lambda));
+        __m256d x = _mm256_mul_pd(_mm256_mul_pd(G, G), _mm256_loadu_pd(scale));
+        __m256d r = _mm256_mul_pd(_mm256_loadu_pd(prefactor), ExpAVX2(x));
+        _mm256_storeu_pd(rate, r);
+        SumAVX2(r, occ, total, toOccupied);
+        if (m < 4) memcpy(rates + i, padRate, m * sizeof(double));
+    }
+    rateToOccupied = HorizontalSum(toOccupied);
+    double sum = HorizontalSum(total);
+    _mm256_zeroupper();  // or the SSE code after this runs many times slower
+    return sum;
+}
+// Miller-Abrahams, as MarcusAVX2
+__attribute__((target("avx2")))
+static double MillerAbrahamsAVX2(const double * DEs, const double * DCs, const double * prefactors,
+                                 const double * scales, const char * occupied,
+                                 double * rates, unsigned int n, double & rateToOccupied) {
+    __m256d total = _mm256_setzero_pd(), toOccupied = _mm256_setzero_pd();
+    for (unsigned int i = 0; i < n; i += 4) {
+        double padDE[4] = {0.0}, padDC[4] = {0.0}, padPrefactor[4] = {0.0}, padScale[4] = {0.0}, 
+               padRate[4];
+        char padOccupied[4] = {0};
+        unsigned int m = (n - i < 4) ? n - i : 4;
+        const double * DE = DEs + i, * DC = DCs + i, * prefactor = prefactors + i, * scale = scales + i;
+        const char * occ = occupied + i;
+        double * rate = rates + i;
+        if (m < 4) {
+            memcpy(padDE, DE, m * sizeof(double));  DE = padDE;
+            memcpy(padDC, DC, m * sizeof(double));  DC = padDC;
+            memcpy(padPrefactor, prefactor, m * sizeof(double));  prefactor = padPrefactor;
+            memcpy(padScale, scale, m * sizeof(double));  scale = padScale;
+            memcpy(padOccupied, occ, m);  occ = padOccupied;
+            rate = padRate;
+        }
+        __m256d D = _mm256_add_pd(_mm256_loadu_pd(DE), _mm256_loadu_pd(DC));
+        D = _mm256_and_pd(D, _mm256_cmp_pd(D, _mm256_setzero_pd(), _CMP_GT_OQ));  // uphill only
+        __m256d x = _mm256_mul_pd(D, _mm256_loadu_pd(scale));
+        __m256d r = _mm256_mul_pd(_mm256_loadu_pd(prefactor), ExpAVX2(x));
+        _mm256_storeu_pd(rate, r);
+        SumAVX2(r, occ, total, toOccupied);
+        if (m < 4) memcpy(rates + i, padRate, m * sizeof(double));
+    }
+    rateToOccupied = HorizontalSum(toOccupied);
+    double sum = HorizontalSum(total);
+    _mm256_zeroupper();
+    return sum;
+}
+#endif
+
+/*******************
+ * KERNEL CHOICE
+ *******************/
+static bool UseAVX2() {
+#ifdef AVX2_KERNELS
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+static const bool useAVX2 = UseAVX2();
+
+//
+double MarcusRates(const double * DEs, const double * DCs, const double * prefactors,
+                   const double * lambdas, const double * scales, const char * occupied,
+                   double * rates, unsigned int n, double & rateToOccupied) {
+#ifdef AVX2_KERNELS
+    if (useAVX2) 
+        return MarcusAVX2(DEs, DCs, prefactors, lambdas, scales, occupied, rates, n, rateToOccupied);
+#endif
+    return MarcusScalar(DEs, DCs, prefactors, lambdas, scales, occupied, rates, n, rateToOccupied);
+}
+//
+double MillerAbrahamsRates(const double * DEs, const double * DCs, const double * prefactors,
+                           const double * scales, const char * occupied,
+                           double * rates, unsigned int n, double & rateToOccupied) {
+#ifdef AVX2_KERNELS
+    if (useAVX2) 
+        return MillerAbrahamsAVX2(DEs, DCs, prefactors, scales, occupied, rates, n, rateToOccupied);
+#endif
+    return MillerAbrahamsScalar(DEs, DCs, prefactors, scales, occupied, rates, n, rateToOccupied);
+}
+//
+const char * GetRateKernels() {
+    return useAVX2 ? "AVX2" : "scalar";
+}
@@ -0,0 +1,45 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * Rate kernels: the rates of a vertex's edges when 'hopperInteractions'
+ * are on, and so must be recalculated after every hop (see 
+ * vertex::UpdateRates_C).  Each kernel makes the rates, their total, 
+ * and the total to occupied neighbours in one pass over the edges.
+ * Everything that doesn't change between hops is worked out once per
+ * edge (see vertex::SetRatesPrefactor_C): for Marcus, the prefactor,
+ * the reorganisation energy lambda and -1/(4 lambda kT); for 
+ * Miller-Abrahams, J and -1/kT.
+ * The kernels are vectorised with AVX2 where the processor has it 
+ * (with their own exp, so the rates may differ from those without AVX2
+ * in the last bit or two).
+ ********************************************************************/
+#ifndef _RATEKERNELS_H
+#define	_RATEKERNELS_H
+
+using namespace std;
+
+// rate = prefactor * exp(scale * (DE + DC + lambda)^2)
+double MarcusRates(const double * DEs, const double * DCs, const double * prefactors,
+                   const double * lambdas, const double * scales, const char * occupied,
+                   double * rates, unsigned int n, double & rateToOccupied);
+// rate = prefactor * exp(scale * max(DE + DC, 0))
+double MillerAbrahamsRates(const double * DEs, const double * DCs, const double * prefactors,
+                           const double * scales, const char * occupied,
+                           double * rates, unsigned int n, double & rateToOccupied);
+const char * GetRateKernels();  // "AVX2" or "scalar"
+#endif	/* _RATEKERNELS_H */
@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "ratetree.h"
+
+//
+void rateTree::Resize(unsigned int n) {
+    _rates.assign(n, 0.0);
+    _tree.assign(n + 1, 0.0);
+    _total = 0.0;
+    _updates = 0;
+    _topBit = 1;
+    while (_topBit * 2 <= n) _topBit *= 2;
+    if (n == 0) _topBit = 0;
+}
+// Change the rate of entry 'i', and all the partial sums that include it.
+//   Every so often the sums are rebuilt from scratch so that rounding
+//   errors can't accumulate.
+void rateTree::Set(unsigned int i, double rate) {
+    double delta = rate - _rates[i];
+    if (delta == 0.0) return;
+    _rates[i] = rate;
+    if (++_updates > _rates.size()) {
+        Rebuild();
+        return;
+    }
+    _total += delta;
+    for (unsigned int j = i + 1; j < _tree.size(); j += j & (-j))
+        _tree[j] += delta;
+}
+// O(N)
+void rateTree::Rebuild() {
+    _total = 0.0;
+    for (unsigned int j = 1; j < _tree.size(); j++) {
+        _tree[j] = _rates[j - 1];
+        _total += _rates[j - 1];
+    }
+    for (unsigned int j = 1; j < _tree.size(); j++) {
+        unsigned int parent = j + (j & (-j));
+        if (parent < _tree.size()) _tree[parent] += _tree[j];
+    }
+    _updates = 0;
+}
+//
+void rateTree::Clear() {
+    _rates.assign(_rates.size(), 0.0);
+    _tree.assign(_tree.size(), 0.0);
+    _total = 0.0;
+    _updates = 0;
+}
+// The partial sums are saved as they are, rather than rebuilt, since 
+//   they carry the rounding errors of every Set since the last Rebuild
+void rateTree::SaveState(stateBuffer & state) const {
+    state.Put((uint64_t) _rates.size());
+    state.Put(_rates);
+    state.Put(_tree);
+    state.Put(_total);
+    state.Put(_updates);
+}
+//
+void rateTree::RestoreState(stateBuffer & state) {
+    state.Check((uint64_t) _rates.size(), "number of vertices");
+    state.Get(_rates);
+    state.Get(_tree);
+    state.Get(_total);
+    state.Get(_updates);
+}
+// Return the entry 'i' for which (sum of rates before i) <= X < (sum of rates up to i).
+//   'residual' is set to X - (sum of rates before i), so that it can be re-used
+//   to choose between the events that make up entry i without drawing another
+//   random number.
+unsigned int rateTree::Find(double X, double & residual) const {
+    unsigned int pos = 0;
+    for (unsigned int bit = _topBit; bit > 0; bit >>= 1) {
+        unsigned int next = pos + bit;
+        if (next < _tree.size() && _tree[next] <= X) {
+            X -= _tree[next];
+            pos = next;
+        }
+    }
+    // Rounding can leave us just beyond the last entry with a non-zero rate
+    while (pos >= _rates.size() || _rates[pos] == 0.0) {
+        if (pos == 0) break;
+        pos--;
+        X = _rates[pos];
+    }
+    residual = X;
+    return pos;
+}
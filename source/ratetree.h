@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'rateTree' is a Fenwick (binary indexed) tree of non-negative rates.
+ * It keeps running partial sums so that a single rate can be changed,
+ * and an entry chosen with probability proportional to its rate, in
+ * O(log N).  Used by the rejection-free ('algorithm bkl') KMC, where
+ * entry i is the total rate out of vertex i.
+ ********************************************************************/
+#ifndef _RATETREE_H
+#define	_RATETREE_H
+#include "global.h"
+#include "statebuffer.h"
+
+using namespace std;
+
+class rateTree{
+    private:
+        vector <double> _rates;  // rate of each entry
+        vector <double> _tree;  // partial sums, indexed from 1
+        double _total;
+        unsigned int _topBit;  // largest power of 2 <= number of entries
+        unsigned int _updates;  // number of Set's since the sums were last rebuilt
+    // end of private:
+
+    public:
+        rateTree(){
+            _total=0.0;
+            _topBit=0;
+            _updates=0;
+        }
+        ~rateTree(){
+            _rates.clear();
+            _tree.clear();
+        }
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void Resize(unsigned int n);
+        void Set(unsigned int i, double rate);
+        void Rebuild();  // recalculate partial sums, removing rounding errors
+        void Clear();  // set all rates to zero
+        void SaveState(stateBuffer &) const;  // for checkpoints
+        void RestoreState(stateBuffer &);
+
+        /***********************************
+        * GET'S
+        ************************************/
+        unsigned int Find(double X, double & residual) const;
+        const double & GetRate(unsigned int i) const {return _rates[i];}
+        const double & GetTotal() const {return _total;}
+        unsigned int Size() const {return _rates.size();}
+    // end of public:
+};
+#endif	/* _RATETREE_H */
@@ -0,0 +1,218 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "simparameters.h"
+#include <errno.h>
+#include <limits.h>
+
+/*******************
+ * THE PARAMETERS
+ *******************/
+enum parameterType {TEXT, NUMBER, INTEGER, UNSIGNED, FLAG, LIST};  // UNSIGNED: 64 bits, e.g. a seed
+struct parameter {
+    const char * key;
+    parameterType type;
+    const char * defaultValue;  // empty if it must be given (or is worked out from others)
+};
+// See docs/reference/sim_parameters.txt
+static const parameter PARAMETERS[] = {
+    {"algorithm",            TEXT,    "frm"},
+    {"alpha",                NUMBER,  ""},
+    {"checkpoint",           TEXT,    ""},  // no checkpoints
+    {"checkpointMinutes",    NUMBER,  "30"},
+    {"converged",            FLAG,    "0"},
+    {"coulombCutoff",        NUMBER,  "0"},
+    {"coulombDamping",       NUMBER,  ""},  // 2 / coulombCutoff
+    {"coulombPotential",     TEXT,    "shifted"},
+    {"coulombSum",           TEXT,    "direct"},
+    {"coulombTheta",         NUMBER,  "0.3"},
+    {"cyclesForConvergence", INTEGER, "15"},
+    {"deltaTime",            NUMBER,  ""},
+    {"dielectric",           NUMBER,  ""},
+    {"eventQueue",           TEXT,    "heap"},
+    {"ewaldGrid",            INTEGER, "32"},
+    {"fieldZ",               NUMBER,  ""},
+    {"hopperInteractions",   FLAG,    "0"},
+    {"hoppers",              INTEGER, ""},
+    {"hopRate",              TEXT,    "marcus"},
+    {"maxRuns",              NUMBER,  "inf"},
+    {"maxTime",              NUMBER,  ""},
+    {"mode",                 TEXT,    "tof"},
+    {"movesCycle",           NUMBER,  "2e4"},
+    {"printEdges",           FLAG,    "0"},
+    {"printEnergies",        FLAG,    "0"},
+    {"printOccupation",      FLAG,    "0"},
+    {"printVertices",        FLAG,    "0"},
+    {"rateUpdateTol",        NUMBER,  "0"},
+    {"reorg",                LIST,    ""},
+    {"seed",                 UNSIGNED, "0"},
+    {"siteEnergies",         FLAG,    "0"},
+    {"sizeX",                NUMBER,  ""},
+    {"sizeY",                NUMBER,  ""},
+    {"sizeZ",                NUMBER,  ""},
+    {"sweepJobs",            INTEGER, ""},  // the number of processors / threads
+    {"temp",                 NUMBER,  ""},
+    {"threads",              INTEGER, "1"},
+    {"timeout",              INTEGER, "0"},
+    {"tol",                  NUMBER,  "0"},
+    {"track",                FLAG,    "0"},
+    {"trackpop",             FLAG,    "0"},
+    {"Vds",                  NUMBER,  ""},
+    {"Vg",                   NUMBER,  ""},
+    {"verbosity",            TEXT,    "low"},
+};
+//
+static const parameter * Find(const string & key) {
+    for (unsigned int i = 0; i < sizeof(PARAMETERS) / sizeof(parameter); i++) {
+        if (key == PARAMETERS[i].key) return &PARAMETERS[i];
+    }
+    return NULL;
+}
+//
+static bool IsNumber(const string & value) {
+    char * end;
+    strtod(value.c_str(), &end);
+    return !value.empty() && *end == '\0';
+}
+// ... and fits in an int
+static bool IsInteger(const string & value) {
+    size_t i = (value[0] == '-' || value[0] == '+') ? 1 : 0;
+    if (i == value.size() || value.find_first_not_of("0123456789", i) != string::npos) return false;
+    errno = 0;
+    long long n = strtoll(value.c_str(), NULL, 10);
+    return errno != ERANGE && n >= INT_MIN && n <= INT_MAX;
+}
+// As read by strtoull (see GetUnsigned), but with no sign, and no more than 64 bits
+static bool IsUnsigned(const string & value) {
+    if (value.empty() || value.find_first_not_of("0123456789") != string::npos) return false;
+    errno = 0;
+    strtoull(value.c_str(), NULL, 10);
+    return errno != ERANGE;
+}
+
+/*******************
+ * SETUP
+ *******************/
+// Read every parameter, with all of its values.  If a parameter is given 
+//   more than once, the first is used (as it always has been).
+simParameters::simParameters(const char * filename) {
+    _filename = filename;
+    ifstream in(filename);
+    if (!in) {
+        cout << "***ERROR***: Unable to open " << filename << endl;
+        exit(-1);
+    }
+    for (string line; getline(in, line); ) {
+        istringstream iss(line);
+        vector <string> words;
+        string word;
+        while (iss >> word && word[0] != '#') words.push_back(word);
+        if (words.empty()) continue;
+        string key = words[0];
+        vector <string> values(words.begin() + 1, words.end());
+
+        const parameter * p = Find(key);
+        if (!p) {
+            cout << "!!! WARNING !!! : Don't understand parameter " << key << " in " << _filename << ", so ignoring it\n";
+            WARNINGS++;
+            continue;
+        }
+        if (values.empty()) ERROR(-1, "No value given for " + key + " in " + _filename);
+        for (unsigned int i = 0; i < values.size(); i++) {
+            if ((p->type == NUMBER || p->type == LIST) && !IsNumber(values[i]))
+                ERROR(-1, key + " must be a number, not " + values[i]);
+            if (p->type == INTEGER && !IsInteger(values[i]))
+                ERROR(-1, key + " must be a whole number from -2147483648 to 2147483647, not " + values[i]);
+            if (p->type == UNSIGNED && !IsUnsigned(values[i]))
+                ERROR(-1, key + " must be a whole number from 0 to 18446744073709551615, not " + values[i]);
+            if (p->type == FLAG && values[i] != "0" && values[i] != "1")
+                ERROR(-1, key + " must be 1 or 0, not " + values[i]);
+        }
+        if (Has(key)) {
+            if (_values[key] != values) {
+                cout << "!!! WARNING !!! : " << key << " is given more than once in " << _filename << ", so using the first\n";
+                WARNINGS++;
+            }
+            continue;
+        }
+        _keys.push_back(key);
+        _values[key] = values;
+    }
+    in.close();
+}
+
+/*******************
+ * DO'S
+ *******************/
+// For a single simulation: only lists use more than their first value
+void simParameters::CheckSingleValues() const {
+    for (unsigned int k = 0; k < _keys.size(); k++) {
+        const vector <string> & values = _values.at(_keys[k]);
+        if (values.size() > 1 && !IsList(_keys[k])) {
+            cout << "!!! WARNING !!! : " << _keys[k] << " has " << values.size() << " values, so using the first"
+                 << " (use 'tft sweep' to simulate them all)\n";
+            WARNINGS++;
+        }
+    }
+}
+
+/*******************
+ * GET'S
+ *******************/
+// The first value of 'key', or its default
+string simParameters::Get(const string & key) const {
+    const parameter * p = Find(key);
+    if (!p) ERROR(-1, "There's no parameter " + key);
+    map <string, vector <string> >::const_iterator it = _values.find(key);
+    if (it != _values.end()) return it->second[0];
+    if (p->defaultValue[0] == '\0') {
+        cout << "***ERROR***: Didn't find " << key << " in " << _filename << endl;
+        exit(-1);
+    }
+    return p->defaultValue;
+}
+//
+double simParameters::GetNumber(const string & key) const {
+    return atof(Get(key).c_str());
+}
+//
+int simParameters::GetInteger(const string & key) const {
+    return atoi(Get(key).c_str());
+}
+//
+uint64_t simParameters::GetUnsigned(const string & key) const {
+    return strtoull(Get(key).c_str(), NULL, 10);
+}
+//
+bool simParameters::GetFlag(const string & key) const {
+    return Get(key) == "1";
+}
+//
+vector <double> simParameters::GetNumbers(const string & key) const {
+    vector <double> numbers;
+    if (!Has(key)) {
+        numbers.push_back(GetNumber(key));  // the default, if there is one
+        return numbers;
+    }
+    const vector <string> & values = _values.at(key);
+    for (unsigned int i = 0; i < values.size(); i++) numbers.push_back(atof(values[i].c_str()));
+    return numbers;
+}
+//
+bool simParameters::IsList(const string & key) {
+    const parameter * p = Find(key);
+    return p && p->type == LIST;
+}
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+/*********************************************************************
+ * 'simParameters' holds the parameters of a ***.sim file, which is 
+ * read once, when it's made.  Every parameter must be one of those 
+ * listed in simparameters.cc (anything else gives a warning), where 
+ * its type and default are given, and every value is checked against 
+ * its type as it's read.  A parameter may be given several values, 
+ * e.g.
+ *     reorg 0.1 0.2
+ *     temp 250 300
+ * A list (reorg) uses them all; anything else uses the first, unless 
+ * the simulations are swept through (see sweep.h).  Anything from a 
+ * '#' to the end of a line is a comment.
+ ********************************************************************/
+#ifndef _SIMPARAMETERS_H
+#define	_SIMPARAMETERS_H
+#include "global.h"
+
+using namespace std;
+
+class simParameters{
+    private:
+        string _filename;
+        vector <string> _keys;  // in the order of ***.sim
+        map <string, vector <string> > _values;  // of each key
+    // end of private:
+
+    public:
+        simParameters(const char * filename);
+        ~simParameters(){}
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void CheckSingleValues() const;  // warn about values that aren't used
+
+        /***********************************
+        * GET'S
+        ************************************/
+        // Each of these stops with an error if the parameter has no value 
+        //   and no default
+        string Get(const string & key) const;
+        double GetNumber(const string & key) const;
+        int GetInteger(const string & key) const;
+        uint64_t GetUnsigned(const string & key) const;
+        bool GetFlag(const string & key) const;  // 1 or 0
+        vector <double> GetNumbers(const string & key) const;  // every value of a list
+        bool Has(const string & key) const {return _values.count(key) > 0;}  // given in ***.sim?
+        const string & GetFilename() const {return _filename;}
+        const vector <string> & GetKeys() const {return _keys;}
+        const vector <string> & GetValues(const string & key) const {return _values.at(key);}
+        static bool IsList(const string & key);
+    // end of public:
+};
+#endif	/* _SIMPARAMETERS_H */
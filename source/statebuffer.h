@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+/*********************************************************************
+ * 'stateBuffer' holds the state of a simulation, as raw bytes, for a 
+ * checkpoint (see checkpoint.h).  Each class that has state Put's it 
+ * into the buffer in SaveState, and Get's it back, in the same order, 
+ * in RestoreState.  Doubles are kept bit for bit, so a simulation 
+ * restored from a checkpoint carries on exactly as it would have.
+ ********************************************************************/
+#ifndef _STATEBUFFER_H
+#define	_STATEBUFFER_H
+#include "global.h"
+#include <stdint.h>
+#include <type_traits>
+
+using namespace std;
+
+class stateBuffer{
+    private:
+        vector <char> _data;
+        size_t _next;  // where the next Get reads from
+
+        void Take(void * to, size_t bytes) {
+            if (bytes > _data.size() - _next) ERROR(-1, "Checkpoint is shorter than expected");
+            memcpy(to, _data.data() + _next, bytes);
+            _next += bytes;
+        }
+    // end of private:
+
+    public:
+        stateBuffer(){
+            _next=0;
+        }
+        ~stateBuffer(){}
+
+        /***********************************
+        * DO'S
+        ************************************/
+        template <class T> void Put(const T & x) {
+            static_assert(is_trivially_copyable<T>::value, "Only plain data can be put in a stateBuffer");
+            const char * bytes = (const char *) &x;
+            _data.insert(_data.end(), bytes, bytes + sizeof(T));
+        }
+        template <class T> void Put(const vector <T> & x) {
+            static_assert(is_trivially_copyable<T>::value, "Only plain data can be put in a stateBuffer");
+            Put((uint64_t) x.size());
+            const char * bytes = (const char *) x.data();
+            _data.insert(_data.end(), bytes, bytes + x.size() * sizeof(T));
+        }
+        void Put(const string & x) {Put(vector <char> (x.begin(), x.end()));}
+
+        template <class T> void Get(T & x) {Take(&x, sizeof(T));}
+        template <class T> void Get(vector <T> & x) {
+            uint64_t n;
+            Get(n);
+            if (n > (_data.size() - _next) / sizeof(T)) ERROR(-1, "Checkpoint is shorter than expected");
+            x.resize(n);
+            Take(x.data(), n * sizeof(T));
+        }
+        void Get(string & x) {
+            vector <char> chars;
+            Get(chars);
+            x.assign(chars.begin(), chars.end());
+        }
+        // The next value, which must be 'expected' (e.g. the number of vertices)
+        template <class T> void Check(const T & expected, const string & what) {
+            T x;
+            Get(x);
+            if (x != expected) ERROR(-1, "Checkpoint has a different " + what + " from this simulation");
+        }
+        void Clear() {_data.clear(); _next=0;}
+        vector <char> & Data() {return _data;}
+
+        /***********************************
+        * GET'S
+        ************************************/
+        size_t Size() const {return _data.size();}
+        bool AtEnd() const {return _next == _data.size();}
+    // end of public:
+};
+#endif	/* _STATEBUFFER_H */
@@ -0,0 +1,150 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+#include "sweep.h"
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <errno.h>
+
+/*******************
+ * SETUP
+ *******************/
+// Every value of a list (e.g. reorg) is part of every simulation, 
+//   rather than one value of the sweep.
+sweep::sweep(const simParameters & sim) {
+    // The files of each point go in the current directory, named after ***.sim
+    string name = sim.GetFilename();
+    if (name.find_last_of('/') != string::npos) name = name.substr(name.find_last_of('/') + 1);
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".sim") == 0) name.erase(name.size() - 4);
+    _prefix = name + ".";
+    _nPoints = 1;
+    _keys = sim.GetKeys();
+    for (unsigned int k = 0; k < _keys.size(); k++) {
+        vector <string> values = sim.GetValues(_keys[k]);
+        if (simParameters::IsList(_keys[k])) {
+            string all = values[0];
+            for (unsigned int i = 1; i < values.size(); i++) all += " " + values[i];
+            values.assign(1, all);
+        }
+        _values.push_back(values);
+        _nPoints *= values.size();
+    }
+}
+
+/*******************
+ * DO'S
+ *******************/
+// Write the parameters of 'point', with one value each, to 'filename'
+void sweep::WritePoint(unsigned int point, const string & filename) const {
+    ofstream out(filename.c_str());
+    if (!out) ERROR(-1, "Unable to write " + filename);
+    for (unsigned int k = 0; k < _keys.size(); k++) {
+        out << _keys[k] << " " << GetValue(point, k) << "\n";
+    }
+    out.close();
+}
+//
+unsigned int sweep::Run(unsigned int jobs, int (*simulate)(unsigned int, char *)) {
+    if (jobs < 1) jobs = 1;
+    map <pid_t, unsigned int> running;  // point made by each process
+    unsigned int next = 0;
+    vector <unsigned int> failed;
+    while ((next < _nPoints && !RECEIVED_TERM_SIGNAL) || !running.empty()) {
+        while (running.size() < jobs && next < _nPoints && !RECEIVED_TERM_SIGNAL) {
+            string sim = GetName(next) + ".sim";
+            string out = GetName(next) + ".out";
+            WritePoint(next, sim);
+            cout << "Starting simulation " << next << " of " << _nPoints << " (" 
+                 << DescribePoint(next) << "), output in " << out << endl << flush;
+            pid_t pid = fork();
+            if (pid < 0) ERROR(-1, "Unable to start a process for simulation " + to_string(next));
+            if (pid == 0) {
+                if (!freopen(out.c_str(), "w", stdout)) ERROR(-1, "Unable to write " + out);
+                int status = simulate(next, &sim[0]);
+                cout << flush;
+                exit(status);
+            }
+            running[pid] = next++;
+        }
+        int status;
+        pid_t pid = wait(&status);
+        if (pid < 0) {
+            if (errno == EINTR) continue;  // interrupted by a signal
+            ERROR(-1, "Lost track of the processes of the sweep");
+        }
+        map <pid_t, unsigned int>::iterator it = running.find(pid);
+        if (it == running.end()) continue;
+        unsigned int point = it->second;
+        running.erase(it);
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            cout << "Finished simulation " << point << endl << flush;
+            continue;
+        }
+        string why;
+        if (WIFEXITED(status)) why = "exited with status " + to_string(WEXITSTATUS(status));
+        else if (WIFSIGNALED(status)) why = "was killed by signal " + to_string(WTERMSIG(status));
+        else why = "stopped";
+        cout << "!!! WARNING !!! : Simulation " << point << " (" << DescribePoint(point) << ") " 
+             << why << ", see " << GetName(point) << ".out\n" << flush;
+        WARNINGS++;
+        failed.push_back(point);
+    }
+    if (next < _nPoints) {
+        cout << "!!! WARNING !!! : Received interrupt or terminate signal, so only started " 
+             << next << " of " << _nPoints << " simulations\n";
+        WARNINGS++;
+    }
+    if (!failed.empty()) {
+        sort(failed.begin(), failed.end());
+        cout << "!!! WARNING !!! : " << failed.size() << " of " << next << " simulations failed:";
+        for (unsigned int i = 0; i < failed.size(); i++) cout << (i ? ", " : " ") << failed[i];
+        cout << endl;
+        WARNINGS++;
+    }
+    return failed.size();
+}
+
+/*******************
+ * GET'S
+ *******************/
+// The value of 'key' at 'point'.  The last key changes fastest.
+string sweep::GetValue(unsigned int point, unsigned int key) const {
+    for (unsigned int k = _keys.size() - 1; k > key; k--) {
+        if (_values[k].size() > 1) point /= _values[k].size();
+    }
+    return _values[key][point % _values[key].size()];
+}
+// Each point makes 'threads' runs at once
+unsigned int sweep::GetMaxThreads() const {
+    unsigned int threads = 1;
+    for (unsigned int k = 0; k < _keys.size(); k++) {
+        if (_keys[k] != "threads") continue;
+        for (unsigned int i = 0; i < _values[k].size(); i++) 
+            threads = max(threads, (unsigned int) max(1, atoi(_values[k][i].c_str())));
+    }
+    return threads;
+}
+//
+string sweep::DescribePoint(unsigned int point) const {
+    string description;
+    for (unsigned int k = 0; k < _keys.size(); k++) {
+        if (_values[k].size() < 2) continue;
+        if (!description.empty()) description += ", ";
+        description += _keys[k] + " " + GetValue(point, k);
+    }
+    return description;
+}
@@ -0,0 +1,72 @@
+///////////////////////////////////////////////////////////////////////
+//  This file is part of ToFeT.
+//  
+//  ToFeT is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//  
+//  ToFeT is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//  
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
+///////////////////////////////////////////////////////////////////////
+
+/*********************************************************************
+ * 'sweep' runs a simulation for every combination of the values given
+ * to the parameters in a ***.sim file, e.g.
+ *     temp 250 300
+ *     fieldZ -5e-3 -1e-2
+ * makes four simulations, numbered from 0 with the last parameter 
+ * changing fastest (as tft_run_batch.py did).  The values of a list
+ * (see simparameters.h) are all used by every simulation.  For a sweep
+ * of foo.sim, the parameters of simulation N are written to foo.N.sim 
+ * and its output to foo.N.out, so that sweeps of different ***.sim 
+ * files can share a directory.
+ * The simulations are made by a pool of processes forked from this 
+ * one, so that the vertices and edges only need reading once, and 
+ * each simulation still has its own output (and everything else that 
+ * is global) to itself.  A simulation that fails (exits with an error 
+ * or is killed) is reported as it finishes and again at the end.
+ ********************************************************************/
+#ifndef _SWEEP_H
+#define	_SWEEP_H
+#include "global.h"
+#include "simparameters.h"
+
+using namespace std;
+
+class sweep{
+    private:
+        vector <string> _keys;  // in the order of ***.sim
+        vector <vector <string> > _values;  // of each key
+        unsigned int _nPoints;
+        string _prefix;  // of the files of every point ('foo.' for foo.sim)
+    // end of private:
+
+    public:
+        sweep(const simParameters & sim);
+        ~sweep(){}
+
+        /***********************************
+        * DO'S
+        ************************************/
+        void WritePoint(unsigned int point, const string & filename) const;
+        // Make 'simulate(point, N.sim)' for every point, 'jobs' at a time.  
+        //   Returns the number that failed.
+        unsigned int Run(unsigned int jobs, int (*simulate)(unsigned int, char *));
+
+        /***********************************
+        * GET'S
+        ************************************/
+        unsigned int GetNumberPoints() const {return _nPoints;}
+        string GetName(unsigned int point) const {return _prefix + to_string(point);}  // of its files, e.g. 'foo.3'
+        unsigned int GetMaxThreads() const;  // the largest 'threads' of any point
+        string GetValue(unsigned int point, unsigned int key) const;
+        string DescribePoint(unsigned int point) const;  // the parameters that change
+    // end of public:
+};
+#endif	/* _SWEEP_H */
@@ -15,72 +15,52 @@
 //  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
 ///////////////////////////////////////////////////////////////////////
 //long SEED=-time(NULL);        // Unique
-#include "RandomB.h"
 #include "global.h"
 #include "graph.h"
 #include "hoppers.h"
 #include "kmc.h"
+#include "sweep.h"
 
-int main(int argc, char * argv[]) {
-
-    // Try to output results on detecting interrupt or terminate signals. 
-    struct sigaction sigHandler;
-    sigHandler.sa_handler = signal_handler;
-    sigemptyset(&sigHandler.sa_mask);
-    sigHandler.sa_flags = 0;
-    sigaction(SIGINT, &sigHandler, NULL);
-    sigaction(SIGTERM, &sigHandler, NULL);
+// Input files, and for sweeps, the vertices and edges read once for every simulation
+char sim[128], xyz[128], edge[128], occ[128];
+graph * readGraph = NULL;
 
-    // DETERMINE INPUT FILES
-    if(argc < 4)
-        ERROR(-1, "Expect at least three input files: .sim, .xyz, .edge");
-
-    char sim[128], xyz[128], edge[128], occ[128];
-    for (int i=1; i<argc; i++) {
-		if (strstr(argv[i],".sim"))  strcpy(sim,argv[i]);	
-		if (strstr(argv[i],".xyz"))  strcpy(xyz,argv[i]);	
-		if (strstr(argv[i],".edge")) strcpy(edge,argv[i]);	
-		if (strstr(argv[i],".occ")) strcpy(occ,argv[i]);	
-    }
-    cout << "Taking input from " << sim << ", " << xyz << ", " << edge << " ..." << endl;
-    cout << "Read simulation parameters ..." << endl;
-    PrintAll(sim);
-    // Check for incompatibilities in sim file
-    if ( Read(sim,"hopperInteractions","0")=="1" && Read(sim,"mode","tof") == "tof")
+// Check for incompatibilities in sim file, and read what's needed before anything else
+void CheckSim(const simParameters & sim) {
+    if ( sim.GetFlag("hopperInteractions") && sim.Get("mode") == "tof")
         ERROR(-1, "hopperInteractions aren't currently implemented in the 'tof' mode");
 
-    if (Read(sim, "hopperInteractions", "0") == "1" && Read(sim, "siteEnergies", "1") == "0")
+    if (sim.GetFlag("hopperInteractions") && sim.Has("siteEnergies") && !sim.GetFlag("siteEnergies"))
         ERROR(-1, "hopperInteractions incompatible with siteEnergies 0");
 
+    sim.CheckSingleValues();
+
     // Determine verbosity of output
-    VERBOSITY_HIGH = (Read(sim, "verbosity", "low") == "high");
+    VERBOSITY_HIGH = (sim.Get("verbosity") == "high");
+}
 
-    // Determine timeout interval
-    int timeoutMinutes = atoi(Read(sim, "timeout", "0").c_str());
-
-    // SETUP GSL RANDOM NUMBER GENERATOR (IF NEEDED)
-    #ifndef RandomB
-    cout << "Setting up GSL random number generator...\n";
-    const gsl_rng_type * T;				
-    gsl_rng_env_setup();
-    T = gsl_rng_default;
-    gslRand = gsl_rng_alloc (T);
-    printf ("\tGenerator type: %s\n", gsl_rng_name ( gslRand ));
-    printf ("\tSeed = %lu\n", gsl_rng_default_seed);
-    #else
-    cout << "Setting up RandomB random number generator...\n"; 
-    #endif
+// SETUP RANDOM NUMBER GENERATOR
+void SetupRandom(const simParameters & sim) {
+    cout << "Setting up Philox random number generator...\n";
+    uint64_t seed = sim.GetUnsigned("seed");
+    Random.Seed(seed);
+    cout << "\tSeed = " << seed << endl;
+    cout << "\tUsing the " << randomStream::GetKernel() << " kernels\n";
+}
 
-    // INITIALISE GRAPH
-    if ( VERBOSITY_HIGH ) cout << "Initialising Graph...\n";		
-    graph Graph(sim, xyz, edge);  
+// Run the simulation described by 'sim' on 'Graph', and print the results.
+//   'checkpointPrefix' goes in front of the name of its checkpoints.
+void Simulate(const simParameters & sim, graph & Graph, const string & checkpointPrefix="") {
+
+    // Determine timeout interval
+    int timeoutMinutes = sim.GetInteger("timeout");
 
     // INITIALISE HOPPERS
     int totalHoppers=0;
 	if ( VERBOSITY_HIGH ) cout << "Initialising Hoppers...\n";
 	hoppers Hoppers(&Graph,sim);
-    if ( Read(sim,"mode","tof")!="fet" ) { 
-        totalHoppers = atoi( Read(sim,"hoppers").c_str() ); 
+    if ( sim.Get("mode")!="fet" ) { 
+        totalHoppers = sim.GetInteger("hoppers"); 
     }
     else {
         if (strstr(occ,".occ")) {
@@ -97,13 +77,15 @@ int main(int argc, char * argv[]) {
     // INITIALISE KMC
 	if ( VERBOSITY_HIGH ) cout << "Initialising KMC...\n";
     kmc KMC(sim, &Hoppers, totalHoppers, &Graph, timeoutMinutes);
+    checkpoint Checkpoint(sim, checkpointPrefix);
+    if (Checkpoint.IsOn()) KMC.SetCheckpoint(&Checkpoint);
     cout << "All systems go!  Beginning KMC...\n"
          << ".................................\n"
          << ".................................\n";
     cout << flush;
 
     // RUN FET SIMULATIONS
-    if ( Read(sim,"mode","tof")=="fet" ) { 
+    if ( sim.Get("mode")=="fet" ) { 
 		if ( VERBOSITY_HIGH ) cout << "Using algorithm KMC::FRM_FET()\n";
 		KMC.FRM_FET(); 
 	}
@@ -120,7 +102,7 @@ int main(int argc, char * argv[]) {
     cout << "Simulation finished with " << WARNINGS << " warnings\n" 
          << ".................................\n"
          << ".................................\n";
-    if (Read(sim,"mode","tof")=="fet") {
+    if (sim.Get("mode")=="fet") {
         cout << "> TIME = " << KMC.GetTime() << endl
              << "> NUMBER OF HOPPERS LEFT = " << Hoppers.GetActive() << endl
              << "> TOTAL NUMBER OF HOPPERS COLLECTED AT DRAIN = " << Hoppers.GetCollectorCurrent() << endl
@@ -135,7 +117,7 @@ int main(int argc, char * argv[]) {
              << "\ttime (s)\tcurrent (A)\n";
         KMC.PrintCurrent();
 
-        if (Read(sim, "trackpop", "0") == "1") {
+        if (sim.GetFlag("trackpop")) {
             cout << "> POPULATION DENSITY TRANSIENT\n"
                  << "\ttime (s)\tg\tt\tc\n";
             KMC.PrintPops();
@@ -145,12 +127,12 @@ int main(int argc, char * argv[]) {
              << "> TOTAL SIMULATION TIME (s) = " << KMC.GetTotalTimeOverAllRuns() << endl
              << "> MOBILITY FROM TOTAL DISPLACEMENT AND TOTAL TIME (cm^2/V.s)= " << KMC.GetMu() << endl;
 
-        if (Read(sim, "mode", "tof") == "pb") {
+        if (sim.Get("mode") == "pb") {
             cout << "> TOTAL DISPLACEMENT (Angs)= " << KMC.GetSumDz() << endl
                  << "> AVERAGE DISPLACEMENT PER HOPPER (Angs)= " << KMC.GetSumDz() / totalHoppers << endl;
         }
 
-        if (Read(sim, "mode", "tof") == "regenerate" || Read(sim, "mode", "tof") == "tof") {
+        if (sim.Get("mode") == "regenerate" || sim.Get("mode") == "tof") {
             cout << "> MOBILITY FROM COLLECTION TIMES (cm^2/V.s)= "
                 << Hoppers.GetSumReciprocalCollTimes() / (double(Hoppers.GetTotalCollectionEvents())) * 1e-16
                 * (Graph.GetDepth() / -Graph.GetFieldZ()) << endl;
@@ -162,7 +144,7 @@ int main(int argc, char * argv[]) {
                 << "> PROBABILITY OF HOPPER BEING COLLECTED DURING RUN = "
                 << double(Hoppers.GetTotalCollectionEvents()) / (KMC.GetnRuns() * totalHoppers) << endl;
 
-            if (Read(sim, "mode", "tof") == "regenerate") {
+            if (sim.Get("mode") == "regenerate") {
                 double finalGenTime = Hoppers.GetGenerationTimeOfFinalHopper();
                 if (finalGenTime >= 0.0) {
                     cout << "> GENERATION TIME OF FINAL HOPPER (s) = " << finalGenTime << endl
@@ -174,26 +156,130 @@ int main(int argc, char * argv[]) {
 
         }
     }
+    Hoppers.PrintCoulombCutoffError();
     cout << "> TOTAL HOPS (seperated by reorganisation energy used) =";
     for (vector<unsigned int>::iterator it = KMC.GetHops().begin(); it != KMC.GetHops().end(); ++it) {
         cout << " " << *it;
     }
     cout << endl;
 
-    // for tofetOccupation simulations...
-    #ifdef printTotalOccupation
-    if (Read(sim,"printOccupation","0") == "1") {
+    // Occupations (see kernel.h)
+    if (sim.GetFlag("printOccupation")) {
         Graph.NormaliseOccupationTimes( KMC.GetTime(), totalHoppers );
         Graph.PrintTotalOccupationTimes();
     }
-	if (Read(sim,"printEnergies","0") == "1") { 
+	if (sim.GetFlag("printEnergies")) { 
         Graph.PrintEnergies();
     }
-    #endif 
+}
+
+// Make simulation 'point' of a sweep (in its own process: see sweep.h)
+int SimulatePoint(unsigned int point, char * pointSim) {
+    cout << "Simulation " << point << " of the sweep" << endl;
+    cout << "Taking input from " << pointSim << ", " << xyz << (edge[0] ? ", " : "") << edge << " ..." << endl;
+    cout << "Read simulation parameters ..." << endl;
+    PrintAll(pointSim);
+    simParameters parameters(pointSim);
+    CheckSim(parameters);
+    SetupRandom(parameters);
+    if ( VERBOSITY_HIGH ) cout << "Initialising Graph...\n";
+    graph Graph(parameters, *readGraph, xyz, edge);
+    string name(pointSim);  // e.g. foo.3.sim (see sweep.h)
+    Simulate(parameters, Graph, name.substr(0, name.size() - 4) + ".");
+    return 0;
+}
+
+int main(int argc, char * argv[]) {
+
+    // Try to output results on detecting interrupt or terminate signals. 
+    struct sigaction sigHandler;
+    sigHandler.sa_handler = signal_handler;
+    sigemptyset(&sigHandler.sa_mask);
+    sigHandler.sa_flags = 0;
+    sigaction(SIGINT, &sigHandler, NULL);
+    sigaction(SIGTERM, &sigHandler, NULL);
+
+    // CHECK AND TIME THE RANDOM NUMBERS (see randomStream::SelfTest)
+    if (argc >= 2 && strcmp(argv[1], "random") == 0)
+        return randomStream::SelfTest((argc > 2) ? strtoull(argv[2], NULL, 10) : 4000000) ? 0 : -1;
+
+    // DETERMINE INPUT FILES
+    if(argc < 3)
+        ERROR(-1, "Expect at least two input files: .sim and .tfg, or .sim, .xyz and .edge");
+
+    bool sweepAll = false, convert = false;
+    char binary[128];
+    sim[0] = xyz[0] = edge[0] = occ[0] = binary[0] = '\0';
+    for (int i=1; i<argc; i++) {
+		if (strstr(argv[i],".sim"))  strcpy(sim,argv[i]);	
+		if (strstr(argv[i],".xyz"))  strcpy(xyz,argv[i]);	
+		if (strstr(argv[i],".edge")) strcpy(edge,argv[i]);	
+		if (strstr(argv[i],".occ")) strcpy(occ,argv[i]);	
+		if (strstr(argv[i],".tfg")) strcpy(binary,argv[i]);	
+		if (strcmp(argv[i],"sweep") == 0) sweepAll = true;
+		if (strcmp(argv[i],"convert") == 0) convert = true;
+    }
+
+    // CONVERT ***.xyz AND ***.edge TO A BINARY GRAPH (see graph::WriteBinary)
+    if (convert) {
+        if (sim[0] == '\0' || xyz[0] == '\0' || edge[0] == '\0' || binary[0] == '\0')
+            ERROR(-1, "Expect 'tft convert foo.sim foo.xyz foo.edge foo.tfg'");
+        cout << "Converting " << xyz << " and " << edge << " (as read by " << sim << ") to " << binary << " ..." << endl;
+        simParameters parameters(sim);
+        VERBOSITY_HIGH = (parameters.Get("verbosity") == "high");
+        graph Graph(parameters, xyz, edge, false);
+        Graph.WriteBinary(binary);
+        return 0;
+    }
+    // A binary graph replaces both ***.xyz and ***.edge
+    if (binary[0] != '\0') {
+        strcpy(xyz, binary);
+        edge[0] = '\0';
+    }
+    else if (argc < 4)
+        ERROR(-1, "Expect at least three input files: .sim, .xyz, .edge");
+
+    // SWEEP THROUGH EVERY COMBINATION OF THE VALUES IN THE SIM FILE
+    if (sweepAll) {
+        simParameters parameters(sim);
+        sweep Sweep(parameters);
+        cout << "Sweeping through " << Sweep.GetNumberPoints() << " simulations from " << sim << ", " 
+             << xyz << (edge[0] ? ", " : "") << edge << " ..." << endl;
+        VERBOSITY_HIGH = (parameters.Get("verbosity") == "high");
+        // Read the vertices and edges as the first simulation would
+        string firstSim = Sweep.GetName(0) + ".sim";
+        Sweep.WritePoint(0, firstSim);
+        graph Graph(simParameters(firstSim.c_str()), xyz, edge, false);
+        readGraph = &Graph;
+        // Each simulation makes 'threads' runs at once, so by default only 
+        //   as many simulations are made at once as there are then processors for
+        unsigned int processors = max(1u, thread::hardware_concurrency());
+        unsigned int threads = Sweep.GetMaxThreads();
+        unsigned int jobs = parameters.Has("sweepJobs") ? max(1, parameters.GetInteger("sweepJobs"))
+                                                        : max(1u, processors / threads);
+        if (parameters.Has("sweepJobs") && jobs * threads > processors) {
+            cout << "!!! WARNING !!! : " << jobs << " simulations of up to " << threads << " threads each at once, on " 
+                 << processors << " processors\n";
+            WARNINGS++;
+        }
+        cout << "Simulations made at once: " << jobs << endl;
+        unsigned int failed = Sweep.Run(jobs, SimulatePoint);
+        cout << "Sweep finished with " << WARNINGS << " warnings\n";
+        return (failed > 0) ? -1 : 0;
+    }
+
+    cout << "Taking input from " << sim << ", " << xyz << (edge[0] ? ", " : "") << edge << " ..." << endl;
+    cout << "Read simulation parameters ..." << endl;
+    PrintAll(sim);
+    simParameters parameters(sim);
+    CheckSim(parameters);
+    SetupRandom(parameters);
+
+    // INITIALISE GRAPH
+    if ( VERBOSITY_HIGH ) cout << "Initialising Graph...\n";		
+    graph Graph(parameters, xyz, edge);  
 
-    #ifndef RandomB
-    gsl_rng_free(gslRand);
-    #endif
+    Simulate(parameters, Graph);
 
     return 0;
 }
@@ -15,63 +15,86 @@
 //  along with ToFeT.  If not, see <http://www.gnu.org/licenses/>.
 ///////////////////////////////////////////////////////////////////////
 #include "vertex.h"
+#include "ratekernels.h"
+
+// Below this fraction of '_totalRate', '_totalRate - _rateToOccupied' is 
+//   not trusted (see CalcTotalRateToUnoccupied)
+static const double CANCELLATION_TOL = 1e-8;
+// '_rateToOccupied' is summed afresh after this many updates
+static const unsigned int RESUM_UPDATES = 1024;
 
 /***************************
  * MISCELLANEOUS
  **************************/
 // Print edge during simulation.  Useful for debugging
 void vertex::PrintEdges() {
-    vector <vertex *>::iterator it=_neighbours.begin();
-    for (unsigned int i=0; i<_neighbours.size(); i++,it++) {
-	cout << "... to (" << (*it)->GetX() << ", " << (*it)->GetY() << ", " << (*it)->GetZ() << "), type " << (*it)->GetType() 
-	     << ", DE_static = "  << GetDE(i) << ", DC = " << GetDC(i) 
-	     << ", J  = "  << _Js.at(i) << ", rate = " << _rates.at(i);
-	     if ((*it)->IsOccupied()) cout << ", occupied";
+    for (unsigned int i=0; i<_numberNeighbours; i++) {
+        vertex * neighbour = GetNeighbour(i);
+	cout << "... to (" << neighbour->GetX() << ", " << neighbour->GetY() << ", " << neighbour->GetZ() << "), type " << neighbour->GetType() 
+	     << ", DE_static = "  << GetDE(i);
+	     if (!_edges->_DCs.empty()) cout << ", DC = " << GetDC(i);
+	     cout << ", J  = "  << GetJ(i) << ", rate = " << GetRate(i);
+	     if (neighbour->IsOccupied()) cout << ", occupied";
 	     cout << endl;
     } 
 }
 // 
 void vertex::ClearDCs() {
-    vector <double>::iterator it=_DCs.begin();
-    for (; it!=_DCs.end(); it++) {
-        (*it) = 0.0;
-    }
+    double * DCs = _edges->_DCs.data() + _first;
+    for (unsigned int i=0; i<_numberNeighbours; i++) DCs[i] = 0.0;
 }
 //
-void vertex::SetOccupied(const double & time) {
+void vertex::SetOccupied() {
+    if (!_occupied) {
+        for (unsigned int i=0; i<_numberNeighbours; i++)
+            GetNeighbour(i)->NeighbourOccupied(_edges->_reverse[_first + i]);
+    }
     _occupied = true;
-    #ifdef printTotalOccupation
-    _timeOfOccupation = time;
-    _timesOccupied++;
-    #endif
 }
 //
-void vertex::SetUnoccupied(double time){
+void vertex::SetUnoccupied(){
+    if (_occupied) {
+        for (unsigned int i=0; i<_numberNeighbours; i++)
+            GetNeighbour(i)->NeighbourUnoccupied(_edges->_reverse[_first + i]);
+    }
     _occupied = false;
-    #ifdef printTotalOccupation
-    _totalOccupationTime += time - _timeOfOccupation;
-    #endif
+}
+// Neighbour 'i' has just been occupied
+void vertex::NeighbourOccupied(const unsigned int & i) {
+    _neighbourOccupied[i] = 1;
+    _occupiedNeighbours++;
+    _rateToOccupied += _edges->_rates[_first + i];
+    if (++_rateToOccupiedUpdates == RESUM_UPDATES) ResumRateToOccupied();
+}
+// Neighbour 'i' has just been vacated.  Once no neighbours are occupied
+//   the sum is reset, so that rounding errors can't build up.
+void vertex::NeighbourUnoccupied(const unsigned int & i) {
+    _neighbourOccupied[i] = 0;
+    _occupiedNeighbours--;
+    if (_occupiedNeighbours == 0) {
+        _rateToOccupied = 0.0;
+        _rateToOccupiedUpdates = 0;
+    }
+    else {
+        _rateToOccupied -= _edges->_rates[_first + i];
+        if (++_rateToOccupiedUpdates == RESUM_UPDATES) ResumRateToOccupied();
+    }
+}
+// Rounding errors in the running sum '_rateToOccupied' would otherwise 
+//   build up for as long as any neighbour stays occupied.  O(neighbours), 
+//   once every RESUM_UPDATES updates.
+void vertex::ResumRateToOccupied() {
+    const double * rates = _edges->_rates.data() + _first;
+    _rateToOccupied = 0.0;
+    for (unsigned int i = 0; i < _numberNeighbours; i++)
+        if (_neighbourOccupied[i]) _rateToOccupied += rates[i];
+    _rateToOccupiedUpdates = 0;
 }
 
 /***************************
  * SETUP
  **************************/
 //
-void vertex::AddNeighbour(vertex *v, const double &J, const double &DE, const double &DZ, const double &RG, const unsigned int &RGenum) {
-    if(find(_neighbours.begin(),_neighbours.end(),v)!=_neighbours.end()) {
-        cout << "***ERROR***: Duplicated edges\n";
-        exit(-1);
-    }
-    _neighbours.push_back(v);
-    _Js.push_back(J);
-    _RGs.push_back(RG);
-    _DZs.push_back(DZ);
-    _DEs.push_back(DE);
-    _DCs.push_back(0.0);
-    _rates.push_back(0.0);
-    _reorgenums.push_back(RGenum);
-}
-//
 void vertex::SetPos(const vec & pos){
     _pos = pos;
     _posZ = pos.getZ();
@@ -80,7 +103,7 @@ void vertex::SetPos(const vec & pos){
 void vertex::SetType(string type) {
     if (type != "c" && type != "g" && type != "-")
         ERROR(-1, "Don't understand vertex type " + type);
-    _type = type;
+    _type = type[0];
     _electrode = (type != "-");
 }
 //
@@ -89,9 +112,10 @@ void vertex::SetE(double E) {
 }
 // Modify deltaE's to reflect an applied field.
 void vertex::ModifyDEsUsingField(const double & field) {
-    vector <vertex *>::iterator it=_neighbours.begin();
-    for (unsigned int i=0; i<_neighbours.size(); i++,it++) {
-        _DEs.at(i) += field * _DZs.at(i);
+    double * DEs = _edges->_DEs.data() + _first;
+    const double * DZs = _edges->_DZs.data() + _first;
+    for (unsigned int i=0; i<_numberNeighbours; i++) {
+        DEs[i] += field * DZs[i];
     }
 }
 /*************************************
@@ -100,123 +124,209 @@ void vertex::ModifyDEsUsingField(const double & field) {
 // Marcus hopping model
 // When there are no 'hopperInteractions', can get away with simply calculating rates once:
 void vertex::SetRates_DE(const double & kT) {
-    double G;
+    double G, RG;
+    const double * Js = _edges->_Js.data() + _first;
+    const double * DEs = _edges->_DEs.data() + _first;
+    const char * occupied = _neighbourOccupied;
+    double * rates = _edges->_rates.data() + _first;
     _totalRate = 0.0;
-    for (unsigned int i=0; i<_neighbours.size(); i++) {
-        G=_DEs.at(i) + _RGs.at(i);
-        _rates[i] = ((_Js.at(i) * _Js.at(i) / hbar_eVs) * sqrt(pi / (_RGs.at(i) * kT))
-                      * exp(-G * G / (4 * _RGs.at(i) * kT)));
-        _totalRate += _rates[i];
+    _rateToOccupied = 0.0;
+    _rateToOccupiedUpdates = 0;
+    for (unsigned int i=0; i<_numberNeighbours; i++) {
+        RG = GetRG(i);
+        G = DEs[i] + RG;
+        rates[i] = ((Js[i] * Js[i] / hbar_eVs) * sqrt(pi / (RG * kT))
+                      * exp(-G * G / (4 * RG * kT)));
+        _totalRate += rates[i];
+        if (occupied[i]) _rateToOccupied += rates[i];
     }
+    _aliasValid = false;
 }
 // Miller-Abrahams hopping model
 // When there are no 'hopperInteractions', can get away with simply calculating rates once:
 void vertex::SetRates_MA(const double& kT) {
     double DE;
+    const double * Js = _edges->_Js.data() + _first;
+    const double * DEs = _edges->_DEs.data() + _first;
+    const char * occupied = _neighbourOccupied;
+    double * rates = _edges->_rates.data() + _first;
     _totalRate = 0.0;
-    for (unsigned int i = 0; i < _neighbours.size(); i++) {
-        DE = _DEs.at(i);
-        _rates[i] = _Js.at(i) * ((DE < 0.0) ? 1.0 : exp(-DE / kT));
-        _totalRate += _rates[i];
+    _rateToOccupied = 0.0;
+    _rateToOccupiedUpdates = 0;
+    for (unsigned int i = 0; i < _numberNeighbours; i++) {
+        DE = DEs[i];
+        rates[i] = Js[i] * ((DE < 0.0) ? 1.0 : exp(-DE / kT));
+        _totalRate += rates[i];
+        if (occupied[i]) _rateToOccupied += rates[i];
     }
+    _aliasValid = false;
 }
 // Marcus hopping model
 // When there *are* 'hopperInteractions', need to constantly update rates.
 // This calculates the pre-factor in the Marcus expression 
-//   (everything except the energetics)
+//   (everything except the energetics), and the reorganisation energy and 
+//   -1/(4 lambda kT) of each edge, so that UpdateRates_C needn't look them up.
 void vertex::SetRatesPrefactor_C(const double & kT) {
-    for (unsigned int i=0; i<_neighbours.size(); i++) { 
-        _ratesPrefactor.push_back((_Js.at(i) * _Js.at(i) / hbar_eVs) * sqrt(pi / (_RGs.at(i) * kT)));
+    const double * Js = _edges->_Js.data() + _first;
+    double * ratesPrefactor = _edges->_ratesPrefactor.data() + _first;
+    double * ratesReorg = _edges->_ratesReorg.data() + _first;
+    double * ratesScale = _edges->_ratesScale.data() + _first;
+    for (unsigned int i=0; i<_numberNeighbours; i++) { 
+        ratesPrefactor[i] = (Js[i] * Js[i] / hbar_eVs) * sqrt(pi / (GetRG(i) * kT));
+        ratesReorg[i] = GetRG(i);
+        ratesScale[i] = -1.0 / (4.0 * GetRG(i) * kT);
     }
 }
 // Miller-Abrahams hopping model
 // When there *are* 'hopperInteractions', need to constantly update rates.
-// This calculates the pre-factor in the Marcus expression 
-//   (everything except the energetics)
-void vertex::SetRatesPrefactor_CMA() {
-    for (unsigned int i = 0; i < _neighbours.size(); i++) {
-        _ratesPrefactor.push_back(_Js.at(i));
+// This calculates the pre-factor in the Miller-Abrahams expression 
+//   (everything except the energetics), and -1/kT.
+void vertex::SetRatesPrefactor_CMA(const double & kT) {
+    const double * Js = _edges->_Js.data() + _first;
+    double * ratesPrefactor = _edges->_ratesPrefactor.data() + _first;
+    double * ratesScale = _edges->_ratesScale.data() + _first;
+    for (unsigned int i = 0; i < _numberNeighbours; i++) {
+        ratesPrefactor[i] = Js[i];
+        ratesScale[i] = -1.0 / kT;
     }
 }
-// Whenever a charge is moved, all Coulombic energies need to be updated.
-void vertex::IncrementDCs(int i, double C) {
-    _DCs.at(i)+=C;
-}
 // Marcus hopping model
-// Update the rates, given the updated _DCs.
-void vertex::UpdateRates_C(const double & kT) {
-    double G;
-    _totalRate=0.;
-    for (unsigned int i=0; i<_neighbours.size(); i++) { 
-        G = _DEs.at(i) + _DCs.at(i) + _RGs.at(i);
-        _rates[i]   = _ratesPrefactor[i] * exp(-G * G / (4.0 * _RGs.at(i) * kT));
-        _totalRate += _rates[i];
-    }
+// Update the rates, given the updated _DCs (see ratekernels.h).
+void vertex::UpdateRates_C() {
+    unsigned int f = _first;
+    _totalRate = MarcusRates(_edges->_DEs.data() + f, _edges->_DCs.data() + f, 
+                             _edges->_ratesPrefactor.data() + f, _edges->_ratesReorg.data() + f, 
+                             _edges->_ratesScale.data() + f, _neighbourOccupied, 
+                             _edges->_rates.data() + f, _numberNeighbours, _rateToOccupied);
+    _rateToOccupiedUpdates = 0;
+    _aliasValid = false;
 }
 // Miller-Abrahams hopping model
 // Update the rates, given the updated _DCs.
-void vertex::UpdateRates_CMA(const double& kT) {
-    double DE;
-    _totalRate = 0.;
-    for (unsigned int i = 0; i < _neighbours.size(); i++) {
-        DE = _DEs.at(i) + _DCs.at(i);
-        _rates[i] = _ratesPrefactor[i] * ((DE < 0.0) ? 1.0 : exp(-DE / kT));
-        _totalRate += _rates[i];
-    }
+void vertex::UpdateRates_CMA() {
+    unsigned int f = _first;
+    _totalRate = MillerAbrahamsRates(_edges->_DEs.data() + f, _edges->_DCs.data() + f, 
+                                     _edges->_ratesPrefactor.data() + f, _edges->_ratesScale.data() + f, 
+                                     _neighbourOccupied, _edges->_rates.data() + f, 
+                                     _numberNeighbours, _rateToOccupied);
+    _rateToOccupiedUpdates = 0;
+    _aliasValid = false;
 }
 
 /************************************
  * CHOOSE DESTINATION OF HOPPER
  ***********************************/
+// Build the alias table for the current rates (Vose's method).
+//   Neighbour i is split into two parts: with probability _aliasProb[i]
+//   it is chosen, otherwise _alias[i] is chosen instead.  Each part 
+//   holds exactly 1/N of the total rate, so a single uniform random 
+//   number picks a neighbour without walking through all the rates.
+void vertex::BuildAliasTable() {
+    unsigned int n = _numberNeighbours;
+    const double * rates = _edges->_rates.data() + _first;
+    double * aliasProb = _edges->_aliasProb.data() + _first;
+    unsigned int * alias = _edges->_alias.data() + _first;
+    // Kept between calls, since this is called after most hops with hopperInteractions,
+    //   and big enough for any vertex, so they never grow during a simulation
+    static thread_local vector <unsigned int> small, large;
+    small.reserve(_edges->_maxNeighbours);
+    large.reserve(_edges->_maxNeighbours);
+    small.clear();
+    large.clear();
+    for (unsigned int i = 0; i < n; i++) {
+        aliasProb[i] = (_totalRate > 0.0) ? rates[i] * n / _totalRate : 1.0;
+        alias[i] = i;
+        if (aliasProb[i] < 1.0) small.push_back(i);
+        else large.push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+        unsigned int s = small.back(); small.pop_back();
+        unsigned int l = large.back();
+        alias[s] = l;
+        aliasProb[l] -= 1.0 - aliasProb[s];
+        if (aliasProb[l] < 1.0) {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+    // Whatever is left over should be exactly 1, but for rounding errors
+    for (unsigned int i = 0; i < small.size(); i++) aliasProb[small[i]] = 1.0;
+    for (unsigned int i = 0; i < large.size(); i++) aliasProb[large[i]] = 1.0;
+    _aliasValid = true;
+}
 // Choose the destination, assuming that all neighbours are unoccupied
 // Return neighbour index
-int vertex::ChooseNeighbour() const {
-#ifdef RandomB
-    double X = Uniform() * _totalRate;
-#else
-    double X = gsl_rng_uniform(gslRand) * _totalRate;
-#endif
-    for (unsigned int i = 0; i < _rates.size(); i++) {
-        X -= _rates[i];
-        if (X <= 0.) return i;
-    }
-    cout << "***ERROR***: ChooseNeighbour() in Vertex.h has not found anywhere to hop to (can't handle this yet!)\n";
-    exit(-1);
-    return -1;
+int vertex::ChooseNeighbour() {
+    if (_numberNeighbours == 0) {
+        cout << "***ERROR***: ChooseNeighbour() in Vertex.h has not found anywhere to hop to (can't handle this yet!)\n";
+        exit(-1);
+    }
+    if (!_aliasValid) BuildAliasTable();
+    double X = Random.Uniform() * _numberNeighbours;
+    unsigned int i = (unsigned int) X;
+    if (i >= _numberNeighbours) i = _numberNeighbours - 1;
+    return (X - i < _edges->_aliasProb[_first + i]) ? i : _edges->_alias[_first + i];
 }
 // Choose the destination, but check the occupation of the neighbours first
 //   (called only if an attempt is made to hop to an occupied vertex)
+// If most of the rate is to unoccupied neighbours, keep drawing from the
+//   alias table until one is found (on average no more than twice).
+//   Otherwise walk through the unoccupied neighbours.
 // Return neighbour index
-int vertex::ChooseNeighbourUnoccupied(double totalRate) const {
-#ifdef RandomB
-    double X = Uniform() * totalRate;
-#else
-    double X = gsl_rng_uniform(gslRand) * totalRate;
-#endif
-    for (unsigned int i = 0; i < _rates.size(); i++) {
-        if (!_neighbours[i]->IsOccupied()) {
-            X -= _rates[i];
-            if (X <= 0.) return i;
+int vertex::ChooseNeighbourUnoccupied(double totalRate) {
+    if (totalRate > 0. && totalRate >= 0.5 * _totalRate) {
+        while (true) {
+            int i = ChooseNeighbour();
+            if (!IsNeighbourOccupied(i)) return i;
         }
     }
+    double X = Random.Uniform() * totalRate;
+    int i = PickNeighbourUnoccupied(X);
+    if (i >= 0) return i;
     cout << "***ERROR***: ChooseNeighbourUnoccupied() in Vertex.cc has not found anywhere to hop to (can't handle this yet!)\n";
     cout << scientific << "             X = " << X << endl;
     exit(-1);
     return -1;
 }
-
-// Recalculate the totalRate to unoccupied neighbours.
-double vertex::CalcTotalRateToUnoccupied() {
-    double totalRateToUnoccupied = 0.;
-    for (unsigned int i=0; i<_neighbours.size(); ++i){
-        if (!_neighbours[i]->IsOccupied()) totalRateToUnoccupied += _rates[i]; 
+// Given 0 <= X < (total rate to unoccupied neighbours), return the index
+//   of the unoccupied neighbour whose share of the total rate X falls in.
+//   If rounding errors leave X slightly too large, return the last 
+//   unoccupied neighbour that can be hopped to.
+//   Return -1 if there is none.
+int vertex::PickNeighbourUnoccupied(double X) const {
+    int last = -1;
+    const double * rates = _edges->_rates.data() + _first;
+    const char * occupied = _neighbourOccupied;
+    for (unsigned int i = 0; i < _numberNeighbours; i++) {
+        if (!occupied[i] && rates[i] > 0.) {
+            X -= rates[i];
+            if (X <= 0.) return i;
+            last = i;
+        }
     }
+    return last;
+}
+
+// The totalRate to unoccupied neighbours, without looking at the neighbours
+//   unless the occupied ones take nearly all of '_totalRate' (as they 
+//   may in the channel of a fet).  The difference would then have lost 
+//   most of its digits, or even come out as 0, freezing a hopper that 
+//   could still hop, so the rates to unoccupied neighbours are summed.
+double vertex::CalcTotalRateToUnoccupied() const {
+    if (_occupiedNeighbours == 0) return _totalRate;
+    if (_occupiedNeighbours == _numberNeighbours) return 0.;
+    double totalRateToUnoccupied = _totalRate - _rateToOccupied;
+    if (totalRateToUnoccupied > CANCELLATION_TOL * _totalRate) return totalRateToUnoccupied;
+    const double * rates = _edges->_rates.data() + _first;
+    totalRateToUnoccupied = 0.0;
+    for (unsigned int i = 0; i < _numberNeighbours; i++)
+        if (!_neighbourOccupied[i]) totalRateToUnoccupied += rates[i];
     return totalRateToUnoccupied;
 }
 
 /*************************************************************
  * ANALYSIS
- * These functions are only called if 'printTotalOccupation'
+ * These functions are only called by kernels that keep occupations
  ************************************************************/
 // Increment the Coulombic energy experienced by a hopper on this
 //   vertex.
@@ -237,3 +347,43 @@ void vertex::NormaliseTotalOccupationTime(const double maxTime, int totalHoppers
     _totalOccupationTime = _totalOccupationTime / (maxTime);
 }
 
+
+/*************************************************************
+ * CHECKPOINTS (see checkpoint.h)
+ ************************************************************/
+// Everything that changes as hoppers move.  The alias table depends only
+//   on the rates, so is built again rather than saved.
+void vertex::SaveState(stateBuffer & state, bool occupation) const {
+    state.Put(_totalRate);
+    state.Put(_occupied);
+    state.Put(_aliasValid);
+    state.Put(_occupiedNeighbours);
+    state.Put(_rateToOccupied);
+    state.Put(_rateToOccupiedUpdates);
+    if (occupation) {
+        state.Put(_EC);
+        state.Put(_EC_time);
+        state.Put(_oldTime);
+        state.Put(_totalOccupationTime);
+        state.Put(_timeOfOccupation);
+        state.Put(_timesOccupied);
+    }
+}
+// Call once the rates have been restored
+void vertex::RestoreState(stateBuffer & state, bool occupation) {
+    state.Get(_totalRate);
+    state.Get(_occupied);
+    state.Get(_aliasValid);
+    state.Get(_occupiedNeighbours);
+    state.Get(_rateToOccupied);
+    state.Get(_rateToOccupiedUpdates);
+    if (occupation) {
+        state.Get(_EC);
+        state.Get(_EC_time);
+        state.Get(_oldTime);
+        state.Get(_totalOccupationTime);
+        state.Get(_timeOfOccupation);
+        state.Get(_timesOccupied);
+    }
+    if (_aliasValid) BuildAliasTable();
+}
@@ -18,11 +18,15 @@
 /*********************************************************************
  * 'vertex' is the object that describes a single molecule, including 
  * position, list of neighbours, and rates to those neighbours.
+ * The neighbours and rates themselves are stored, with those of every 
+ * other vertex, in the graph's 'edges'.
  ********************************************************************/
 #ifndef _VERTEX_H
 #define	_VERTEX_H
 #include "vec.h"
 #include "global.h"
+#include "edges.h"
+#include "statebuffer.h"
 #include <algorithm>
 
 using namespace std;
@@ -32,26 +36,29 @@ class vertex{
     private:
         int _ID;  // ID of vertex in graph::_vertices
         double _posZ;  // position along the 'z' axis
-        vector <vertex *> _neighbours;
-        vector <double> _Js;
-        vector <double> _RGs;  // reorganisation energy between vertices
-        vector <double> _DEs;  // deltaE between vertices
-        vector <double> _DZs;  // deltaZ between vertices
+        edges * _edges;  // where the edges of this vertex are stored...
+        unsigned int _first;  // ... starting from this one
+        char * _neighbourOccupied;  // is each neighbour occupied?  (see graph::graph(const graph &))
+        unsigned int _numberNeighbours;
+        unsigned int _rateToOccupiedUpdates;  // since _rateToOccupied (below) was last summed afresh
         double _E;  // site energy, as read in from ***.xyz
-        vector <double> _rates;
-        vector <unsigned int> _reorgenums;
         double _totalRate; 
         bool _occupied;
-        string _type;		// generator (g), collector (c), other (-)
-        // The following are only used when 'hopperInteractions'
-        //   are enabled.
-        vector <double> _DCs;  // difference in Coulomb energies 
-                               //   between vertices 
-        vector <double> _ratesPrefactor; 
+        char _type;		// generator (g), collector (c), other (-)
+        bool _aliasValid;  // alias table is rebuilt (when next needed) whenever the rates change
+        // So that hops to unoccupied neighbours can be chosen without 
+        //   looking at every neighbour, each vertex keeps track of which 
+        //   of its neighbours are occupied, and the total rate to them.  
+        //   These are updated by the neighbours themselves, in 
+        //   SetOccupied / SetUnoccupied, and _rateToOccupied is summed 
+        //   afresh every so often (see ResumRateToOccupied).
+        unsigned int _occupiedNeighbours;
+        double _rateToOccupied;
+        void ResumRateToOccupied();
         double _EC;  // Coulomb energy of a charge on this vertex 
         double _EC_time;  // a running sum of _EC * time (used for calculating potentials)
         double _oldTime;  // last time the occupation status of this vertex changed 
-        // The following are used when 'printTotalOccupation' is enabled
+        // The following are only kept by kernels that keep occupations (see kernel.h)
         double _totalOccupationTime;  // total time this vertex is occupied by a hopper
         double _timeOfOccupation;  // when a hopper last moved onto the vertex
         unsigned int _timesOccupied;
@@ -62,31 +69,37 @@ class vertex{
         vertex(){
             _occupied = false;
             _totalOccupationTime=0.0;
+            _timeOfOccupation=0.0;
             _ID=-1;
             _E=0.0;
-            #ifdef printTotalOccupation
             _EC=0.0;
             _EC_time=0.0;
             _oldTime=0.0;
             _timesOccupied=0;
-            #endif
             _electrode=false;
+            _edges=0;
+            _first=0;
+            _neighbourOccupied=0;
+            _numberNeighbours=0;
+            _totalRate=0.0;
+            _aliasValid=false;
+            _occupiedNeighbours=0;
+            _rateToOccupied=0.0;
+            _rateToOccupiedUpdates=0;
         }
-        ~vertex(){
-            _neighbours.clear();
-            _rates.clear();
-            _reorgenums.clear();
-            _Js.clear();
-            _RGs.clear();
-            _DEs.clear();
-            _DZs.clear();
-            _DCs.clear();
-        }
+        ~vertex(){}
         
         /*******************************
          * SETUP
          ******************************/
-        void AddNeighbour(vertex *, const double &, const double &, const double &, const double &, const unsigned int &); 
+        void SetEdges(edges * E, unsigned int first, unsigned int numberNeighbours) {
+            _edges = E;
+            _first = first;
+            _numberNeighbours = numberNeighbours;
+            _neighbourOccupied = E->_occupied.data() + first;
+        }
+        // Keep track of which neighbours are occupied in 'occupied' (one per edge) instead
+        void SetOccupiedMask(char * occupied) {_neighbourOccupied = occupied + _first;}
         void SetPos(const vec & pos);
         void SetType (string);
         void SetID(int i) 	{_ID = i;}
@@ -99,25 +112,41 @@ class vertex{
         void SetRates_DE(const double &);
         void SetRates_MA(const double &);
         void SetRatesPrefactor_C(const double &);
-        void SetRatesPrefactor_CMA();
-        void UpdateRates_C(const double &);
-        void UpdateRates_CMA(const double &);
+        void SetRatesPrefactor_CMA(const double &);
+        void UpdateRates_C();
+        void UpdateRates_CMA();
+        void BuildAliasTable();
 
         /*******************************
          * MISCELLANEOUS
          *******************************/
-        void SetOccupied(const double & time);
-        void SetUnoccupied(double time);
+        void SetOccupied();
+        void SetUnoccupied();
+        // Keep the occupation times (see above)
+        void StartOccupation(const double & time) {
+            _timeOfOccupation = time;
+            _timesOccupied++;
+        }
+        void EndOccupation(const double & time) {_totalOccupationTime += time - _timeOfOccupation;}
+        void NeighbourOccupied(const unsigned int &);
+        void NeighbourUnoccupied(const unsigned int &);
         void IncrementEC(const double newEC, const double time);
         void SetEC(const double newEC, const double time);
-        double CalcTotalRateToUnoccupied(); 
-        int ChooseNeighbour() const;
-        int ChooseNeighbourUnoccupied(double) const;
-        void IncrementDCs(int, double);
+        double CalcTotalRateToUnoccupied() const; 
+        int ChooseNeighbour();
+        int ChooseNeighbourUnoccupied(double);
+        int PickNeighbourUnoccupied(double) const;
+        void IncrementDCs(int i, double C) {_edges->_DCs[_first + i] += C;}
         void IncrementTotalOccupationTime(const double & time) {_totalOccupationTime+=time;}
         void NormaliseTotalOccupationTime(const double maxTime, int totalHoppers);
         void ClearDCs();
 
+        /*******************************
+         * CHECKPOINTS
+         *******************************/
+        void SaveState(stateBuffer &, bool occupation) const;
+        void RestoreState(stateBuffer &, bool occupation);
+
         /*******************
          * PRINTS and GETS 
          ******************/
@@ -125,27 +154,31 @@ class vertex{
         void PrintPos() {cout << "(" << _pos.getX() << ", " << _pos.getY() << ", " << GetZ() <<  "), " << _type ;} 
         const int &GetID() const {return _ID;}
         const double &GetTotalRate() const {return _totalRate;} 
-        const double &GetRate(int i) const {return _rates.at(i);}
-        const double &GetJ(const int & i) {return _Js.at(i);}
-        const double &GetRG(const int& i) { return _RGs.at(i); }
-        const double &GetDE(const int & i) {return _DEs.at(i);}
-        const double &GetDZ(const int & i) {return _DZs.at(i);}
-        const double &GetDC(const int & i) {return _DCs.at(i);}
+        const double &GetRate(int i) const {return _edges->_rates[_first + i];}
+        const double &GetJ(const int & i) {return _edges->_Js[_first + i];}
+        const double &GetRG(const int& i) {return _edges->_reorgs[_edges->_reorgenums[_first + i]];}
+        const double &GetDE(const int & i) {return _edges->_DEs[_first + i];}
+        const double &GetDZ(const int & i) {return _edges->_DZs[_first + i];}
+        const double &GetDC(const int & i) {return _edges->_DCs[_first + i];}
         const double &GetE() {return _E;}
         const double &GetEC_time() {return _EC_time;}
         const double &GetX() const {return _pos.getX();}
         const double &GetY() const {return _pos.getY();}
         const double &GetZ() const {return _posZ;}
         const vec &GetPos() const {return _pos;}
-        const string &GetType() const {return _type;}
-        unsigned int GetNumberNeighbours() {return _neighbours.size();}
-        vector <vertex *> & GetNeighbours()	{return _neighbours;}
+        const char &GetType() const {return _type;}
+        unsigned int GetNumberNeighbours() const {return _numberNeighbours;}
+        // Vertices are contiguous and in order of ID, so neighbours are found from 'this' 
+        //   (which also works for the vertices of a copy of the graph)
+        vertex * GetNeighbour(const unsigned int & i) const {
+            return const_cast<vertex *>(this) + (int(_edges->_to[_first + i]) - _ID);
+        }
+        unsigned int GetReorgEnum(const unsigned int & i) const {return _edges->_reorgenums[_first + i];}
         const bool & IsOccupied() const	{return _occupied;}
-        vector < double > & GetRates() {return _rates;}
-        vector < unsigned int > & GetReorgEnums() { return _reorgenums; }
+        bool IsNeighbourOccupied(const unsigned int & i) const {return _neighbourOccupied[i];}
         const double & GetTotalOccupationTime() {return _totalOccupationTime;}
         unsigned int GetTimesOccupied()	{return _timesOccupied;}
-        const bool IsCollector() const {if (_type=="c") return true; else return false;}
-        const bool IsGenerator() const {if (_type=="g") return true; else return false;}
+        const bool IsCollector() const {return _type=='c';}
+        const bool IsGenerator() const {return _type=='g';}
 };
 #endif	/* _VERTEX_H */